@@ -0,0 +1,78 @@
+// Census matching cost, the faster alternative to the ZNCC score (--cost=census):
+//   census_transform : 64-bit bitstring of every pixel, one bit per neighbour of the CENSUS_HALFWINSIZEX x
+//                      CENSUS_HALFWINSIZEY window (9 x 7, 62 bits), set when the neighbour is darker than the
+//                      centre; neighbours outside the image give 0
+//   census_match     : Hamming distance (XOR + popcount) of the bitstrings summed over the same window
+//                      and disparity range as zncc.cl, the disparity with the lowest mean distance per
+//                      window pixel wins (compared as cost*count products, the first one on a tie)
+// Integer arithmetic only, cpu_census_match (zncc_cpu.c) gives the same maps whatever its summation order.
+
+#define CENSUS_HALFWINSIZEX 4   // must match zncc_cpu.h
+#define CENSUS_HALFWINSIZEY 3
+
+__kernel void census_transform(__global uchar *leftImg, __global uchar *rightImg, __global ulong *censusL, __global ulong *censusR, int w, int h) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    int ii, jj, y, x;
+    uchar centreL, centreR;
+    ulong bitsL, bitsR;
+    if (i >= h || j >= w)
+        return;
+
+    centreL = leftImg[i*w + j];
+    centreR = rightImg[i*w + j];
+    bitsL = bitsR = 0;
+    for (ii = -CENSUS_HALFWINSIZEY; ii <= CENSUS_HALFWINSIZEY; ii++) {
+        for (jj = -CENSUS_HALFWINSIZEX; jj <= CENSUS_HALFWINSIZEX; jj++) {
+            if (ii == 0 && jj == 0)
+                continue;
+            y = i + ii;
+            x = j + jj;
+            bitsL <<= 1;
+            bitsR <<= 1;
+            if (0 <= y && y < h && 0 <= x && x < w) {
+                bitsL |= leftImg[y*w + x] < centreL;
+                bitsR |= rightImg[y*w + x] < centreR;
+            }
+        }
+    }
+    censusL[i*w + j] = bitsL;
+    censusR[i*w + j] = bitsR;
+}
+
+__kernel void census_match(__global ulong *censusL, __global ulong *censusR, __global uchar *dispMap, int w, int h, int halfwinsizex, int halfwinsizey, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    // Rows of the window inside the image, the same for every disparity
+    const int r0 = max(-halfwinsizey, -i);
+    const int r1 = min(halfwinsizey, h - i);
+    int ii, jj, d, best_d, c0, c1;
+    uint cost, count, bestCost, bestCount;
+    if (i >= h || j >= w)
+        return;
+
+    best_d = maxd;
+    bestCost = 1;
+    bestCount = 0;
+    for (d = mind; d <= maxd; d++) {
+        // Columns of the window inside both images
+        c0 = max(-halfwinsizex, max(-j, d - j));
+        c1 = min(halfwinsizex, min(w - j, w - j + d));
+        if (c0 >= c1)
+            continue;
+        cost = 0;
+        for (ii = r0; ii < r1; ii++)
+            for (jj = c0; jj < c1; jj++)
+                cost += (uint)popcount(censusL[(i+ii)*w + (j+jj)] ^ censusR[(i+ii)*w + (j+jj-d)]);
+        count = (r1 - r0)*(c1 - c0);
+        // Lower mean distance: cost/count < bestCost/bestCount
+        if (cost*bestCount < bestCost*count) {
+            bestCost = cost;
+            bestCount = count;
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
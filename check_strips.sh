@@ -0,0 +1,78 @@
+#!/bin/sh
+# Strip regression check: the depth map (and the --subpixel PFM) computed in strips
+# under a memory budget, or in bands over the workers of --backend=all, must be byte
+# for byte the one of the whole map. The bands only split with an OpenCL device.
+# Run from the directory holding im0.png, im1.png & the .cl files:
+#     ./check_strips.sh [path/to/run_zncc]
+# depthmap.png of the directory is kept.
+
+RUN=${1:-./run_zncc}
+TMP=${TMPDIR:-/tmp}/check_strips.$$
+BUDGETS="0.3 0.05"
+failed=0
+
+mkdir -p "$TMP" || exit 1
+[ -f depthmap.png ] && cp depthmap.png "$TMP/kept.png"
+
+# run <name> <options...> : depth map (and PFM with SUBPIXEL=1) of one run into $TMP/<name>.*
+run() {
+    name=$1
+    shift
+    [ $SUBPIXEL -eq 1 ] && set -- "$@" --subpixel="$TMP/$name.pfm"
+    if ! "$RUN" "$@" > "$TMP/$name.log" 2>&1; then
+        echo "FAIL $RUN $* (see $TMP/$name.log)"
+        failed=1
+    fi
+    cp depthmap.png "$TMP/$name.png"
+}
+
+# check <options...> : whole map vs strips at every budget
+check() {
+    label="$*"
+    [ $SUBPIXEL -eq 1 ] && label="$label --subpixel"
+    run whole "$@"
+    for budget in $BUDGETS; do
+        run strips "$@" --memory-budget=$budget
+        if cmp -s "$TMP/whole.png" "$TMP/strips.png" && { [ $SUBPIXEL -eq 0 ] || cmp -s "$TMP/whole.pfm" "$TMP/strips.pfm"; }; then
+            echo "ok   $label --memory-budget=$budget"
+        else
+            echo "DIFF $label --memory-budget=$budget"
+            failed=1
+        fi
+    done
+}
+
+# check_bands <options...> : one worker vs the bands of --backend=all (every OpenCL device + the CPU)
+check_bands() {
+    label="$*"
+    [ $SUBPIXEL -eq 1 ] && label="$label --subpixel"
+    run whole "$@" --backend=cpu
+    run strips "$@" --backend=all
+    if cmp -s "$TMP/whole.png" "$TMP/strips.png" && { [ $SUBPIXEL -eq 0 ] || cmp -s "$TMP/whole.pfm" "$TMP/strips.pfm"; }; then
+        echo "ok   $label --backend=all"
+    else
+        echo "DIFF $label --backend=all"
+        failed=1
+    fi
+}
+
+SUBPIXEL=0
+check
+check --downscale=2.5
+check --zncc=integral
+check --pyramid=2
+check --pyramid=3 --downscale=2.5
+check --cost=census
+check --cost=census --downscale=2.5
+check_bands
+check_bands --downscale=2.5
+check_bands --pyramid=2
+check_bands --cost=census --downscale=2.5
+check_bands --memory-budget=0.05 --downscale=2.5
+SUBPIXEL=1
+check
+check_bands
+
+[ -f "$TMP/kept.png" ] && cp "$TMP/kept.png" depthmap.png
+[ $failed -eq 0 ] && rm -rf "$TMP"
+exit $failed
@@ -0,0 +1,174 @@
+/******************************************************************************
+ * FILENAME :        kernel_cache.c
+ *
+ * DESCRIPTION :
+ *       On-disk OpenCL program binary cache, see kernel_cache.h
+ *       + key   : 64-bit FNV-1a of source, build options, CL_DEVICE_NAME and
+ *                 CL_DRIVER_VERSION, so a driver update invalidates the entries
+ *       + entry : <dir>/<key>.bin, the raw device binary, written to a temporary
+ *                 file first and renamed so that a reader never sees half of it
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_NO_OPENCL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kernel_cache.h"
+
+static uint64_t fnv1a(uint64_t hash, const char *s)
+{
+    // Hash the terminating '\0' too, so that ("ab", "c") and ("a", "bc") differ
+    do {
+        hash ^= (unsigned char)*s;
+        hash *= 0x100000001b3ULL;
+    } while (*s++);
+    return hash;
+}
+
+static char *device_string(cl_device_id device, cl_device_info param)
+{
+    size_t size = 0;
+    char *res;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || !size)
+        return strdup("");
+    res = (char*) malloc(size + 1);
+    if (!res || clGetDeviceInfo(device, param, size, res, NULL) != CL_SUCCESS) {
+        free(res);
+        return strdup("");
+    }
+    res[size] = '\0';
+    return res;
+}
+
+static void cache_path(char *path, size_t size, const char *dir, cl_device_id device, const char *source, const char *options)
+{
+    char *name    = device_string(device, CL_DEVICE_NAME);
+    char *version = device_string(device, CL_DRIVER_VERSION);
+    uint64_t key  = 0xcbf29ce484222325ULL;
+
+    key = fnv1a(key, source);
+    key = fnv1a(key, options);
+    key = fnv1a(key, name);
+    key = fnv1a(key, version);
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+    free(name);
+    free(version);
+}
+
+/******************************************************************************
+ *  Program from a cached binary, NULL when there is no entry or the driver rejects it
+ */
+static cl_program load_binary(kernel_cache_t *cache, cl_context ctx, cl_device_id device, const char *path, const char *options)
+{
+    cl_int status, binaryStatus;
+    cl_program program;
+    unsigned char *binary;
+    size_t size;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    binary = (unsigned char*) malloc(size ? size : 1);
+    if (!binary || fread(binary, 1, size, f) < size) {
+        free(binary);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    program = clCreateProgramWithBinary(ctx, 1, &device, &size, (const unsigned char**)&binary, &binaryStatus, &status);
+    free(binary);
+    if (status != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        cache->rejected++;
+        return NULL;
+    }
+    // Binaries still need a build call before kernels can be created
+    if (clBuildProgram(program, 1, &device, options, NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        cache->rejected++;
+        return NULL;
+    }
+    return program;
+}
+
+static void store_binary(cl_program program, const char *dir, const char *path)
+{
+    size_t size = 0;
+    unsigned char *binary;
+    char tmp[1024 + 32];
+    FILE *f;
+
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || !size)
+        return;
+    binary = (unsigned char*) malloc(size);
+    if (!binary)
+        return;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) != CL_SUCCESS) {
+        free(binary);
+        return;
+    }
+
+    mkdir(dir, 0755);
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "Fail to write the kernel cache entry '%s' !\n", path);
+        free(binary);
+        return;
+    }
+    if (fwrite(binary, 1, size, f) < size) {
+        fclose(f);
+        remove(tmp);
+    } else {
+        fclose(f);
+        rename(tmp, path);
+    }
+    free(binary);
+}
+
+cl_program kernel_cache_build(kernel_cache_t *cache, cl_context ctx, cl_device_id device, const char *source, const char *options)
+{
+    char path[1024];
+    cl_program program;
+    cl_int status;
+    size_t sizes[] = { strlen(source) };
+
+    if (!options)
+        options = "";
+    if (cache->dir) {
+        cache_path(path, sizeof(path), cache->dir, device, source, options);
+        program = load_binary(cache, ctx, device, path, options);
+        if (program) {
+            cache->hits++;
+            return program;
+        }
+    }
+
+    // ******** Miss: build from source and refresh the entry ********
+    cache->misses++;
+    program = clCreateProgramWithSource(ctx, 1, &source, sizes, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create program from source !\n");
+        abort();
+    }
+    status = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if(status != CL_SUCCESS){
+        char log[4096] = "";
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, NULL);
+        fprintf(stderr, "Fail to build program (options '%s'):\n%s\n", options, log);
+        clReleaseProgram(program);
+        return NULL;
+    }
+    if (cache->dir)
+        store_binary(program, cache->dir, path);
+    return program;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/******************************************************************************
+ * FILENAME :        kernel_cache.h
+ *
+ * DESCRIPTION :
+ *       On-disk cache of compiled OpenCL programs. A program is stored as the
+ *       output of clGetProgramInfo(CL_PROGRAM_BINARIES) under a file named
+ *       after a hash of its source, build options, device name and driver
+ *       version, and reloaded with clCreateProgramWithBinary on the next start.
+ *       A binary the driver rejects falls back to a source build, which then
+ *       refreshes the cache entry.
+ *
+ ******************************************************************************/
+
+#ifndef KERNEL_CACHE_H
+#define KERNEL_CACHE_H
+
+#ifndef ZNCC_NO_OPENCL
+#include <stdint.h>
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+typedef struct {
+    const char *dir;            // cache directory, NULL = always build from source
+    uint32_t hits;              // programs loaded from a cached binary
+    uint32_t misses;            // programs built from source
+    uint32_t rejected;          // cached binaries the driver refused (counted in misses too)
+} kernel_cache_t;
+
+// Built program for source + options on device, NULL (build log printed) when the source does not build
+cl_program kernel_cache_build(kernel_cache_t *cache, cl_context ctx, cl_device_id device, const char *source, const char *options);
+
+#endif
+#endif
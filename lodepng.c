@@ -37,6 +37,30 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+#if defined(LODEPNG_COMPILE_SIMD) && defined(LODEPNG_COMPILE_DECODER)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LODEPNG_UNFILTER_SIMD
+#define LODEPNG_UNFILTER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LODEPNG_UNFILTER_SIMD
+#define LODEPNG_UNFILTER_NEON
+#include <arm_neon.h>
+#endif
+#endif /*LODEPNG_COMPILE_SIMD && LODEPNG_COMPILE_DECODER*/
+
+#if defined(LODEPNG_COMPILE_THREADS) && defined(LODEPNG_COMPILE_DECODER)
+#include <pthread.h>
+#endif /*LODEPNG_COMPILE_THREADS && LODEPNG_COMPILE_DECODER*/
+
+#if defined(LODEPNG_COMPILE_DISK) && (defined(__unix__) || defined(__APPLE__))
+#define LODEPNG_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /*LODEPNG_COMPILE_DISK && (__unix__ || __APPLE__)*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -377,6 +401,67 @@ unsigned lodepng_load_file(unsigned char** out, size_t* outsize, const char* fil
   return 0;
 }
 
+/*
+POSIX: map the file read-only, its pages are read on demand and belong to the page cache, they are
+not allocated memory of the process. Elsewhere the file is loaded with lodepng_load_file.
+*/
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename)
+{
+#ifdef LODEPNG_MMAP
+  int fd;
+  struct stat st;
+  void* data;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+  *outsize = 0;
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) return 78;
+  if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    close(fd);
+    return 78;
+  }
+  if((unsigned long long)st.st_size > (size_t)(-1))
+  {
+    close(fd);
+    return 83; /*does not fit in the address space*/
+  }
+  if(st.st_size == 0)
+  {
+    close(fd);
+    return 0; /*nothing to map, an empty buffer*/
+  }
+
+  data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /*the mapping keeps the file open*/
+  if(data == MAP_FAILED) return 78;
+#ifdef MADV_SEQUENTIAL
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL); /*the decoder reads it from start to end*/
+#endif /*MADV_SEQUENTIAL*/
+
+  *out = (const unsigned char*)data;
+  *outsize = (size_t)st.st_size;
+  return 0;
+#else /*LODEPNG_MMAP*/
+  unsigned char* buffer;
+  unsigned error = lodepng_load_file(&buffer, outsize, filename);
+  *out = buffer;
+  return error;
+#endif /*LODEPNG_MMAP*/
+}
+
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize)
+{
+#ifdef LODEPNG_MMAP
+  if(buffer) munmap((void*)buffer, buffersize);
+#else /*LODEPNG_MMAP*/
+  (void)buffersize;
+  lodepng_free((void*)buffer);
+#endif /*LODEPNG_MMAP*/
+}
+
 /*write given buffer to the file, overwriting the file, it doesn't append to it.*/
 unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const char* filename)
 {
@@ -397,6 +482,9 @@ unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_ZLIB
+/*size of the word-sized bit buffers of the fast inflater and of the deflate bit writer*/
+#define BITBUFFER_BITS (sizeof(size_t) * 8u)
+
 #ifdef LODEPNG_COMPILE_ENCODER
 /*TODO: this ignores potential out of memory errors*/
 #define addBitToStream(/*size_t**/ bitpointer, /*ucvector**/ bitstream, /*unsigned char*/ bit)\
@@ -494,6 +582,9 @@ typedef struct HuffmanTree
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  /*lookup tables of the fast inflate path, see HuffmanTree_makeTable (null when not built)*/
+  unsigned char* table_len; /*length of the code, or of the longest code of the second level table*/
+  unsigned short* table_value; /*the symbol, or the offset of the second level table*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -514,6 +605,8 @@ static void HuffmanTree_init(HuffmanTree* tree)
   tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
@@ -521,6 +614,8 @@ static void HuffmanTree_cleanup(HuffmanTree* tree)
   lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table_len);
+  lodepng_free(tree->table_value);
 }
 
 /*the tree representation used by the decoder. return value is error*/
@@ -931,6 +1026,319 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/* ////////////////////////////////////////////////////////////////////////// */
+/* / Fast inflate: lookup tables & bit buffer (settings->fast_inflate)      / */
+/* ////////////////////////////////////////////////////////////////////////// */
+
+/*
+Instead of walking tree2d one bit at a time, a symbol is found with one or two
+table lookups: the first FIRSTBITS bits of the stream index the primary table,
+longer codes continue in a second level table indexed by their remaining bits.
+The bits are taken from a bit buffer the size of size_t (64 bits on 64-bit
+targets), refilled a whole word at a time, so the length and distance extra bits
+are read with a shift and a mask. Gives the same output as inflateHuffmanBlock.
+The reader also walks from one input segment to the next (the IDAT chunks of a
+PNG), so the chunks are inflated where they are, without concatenating them.
+*/
+
+#define FIRSTBITS 10u
+/*table_len value of an entry that no code reaches*/
+#define INVALIDLENGTH 16u
+#define MAX_MATCH_LENGTH 258u
+
+/*a code of the tree: its bits in stream order from the lsb, its length & its symbol*/
+typedef struct HuffmanLeaf
+{
+  unsigned code;
+  unsigned len;
+  unsigned symbol;
+} HuffmanLeaf;
+
+/*
+collect the leaves below the given node of tree2d, in which every slot is a symbol or
+a child: unused codes of an incomplete tree decode as symbol 0 there, and do so here too.
+Slots pointing outside of the tree (an error in huffmanDecodeSymbol) are left out
+*/
+static void HuffmanTree_collectLeaves(const HuffmanTree* tree, unsigned node, unsigned code, unsigned depth,
+                                      HuffmanLeaf* leaves, size_t* numleaves)
+{
+  unsigned bit;
+  for(bit = 0; bit != 2; ++bit)
+  {
+    unsigned ct = tree->tree2d[(node << 1) + bit];
+    unsigned bitcode = code | (bit << depth);
+    if(ct < tree->numcodes)
+    {
+      leaves[*numleaves].code = bitcode;
+      leaves[*numleaves].len = depth + 1;
+      leaves[*numleaves].symbol = ct;
+      ++(*numleaves);
+    }
+    else if(ct - tree->numcodes < tree->numcodes && depth + 1 < 15)
+    {
+      HuffmanTree_collectLeaves(tree, ct - tree->numcodes, bitcode, depth + 1, leaves, numleaves);
+    }
+  }
+}
+
+/*build table_len & table_value from tree2d, so that they decode exactly like it. return value is error*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  static const unsigned headsize = 1u << FIRSTBITS;
+  static const unsigned mask = (1u << FIRSTBITS) - 1u;
+  size_t i, size, pointer, numleaves = 0;
+  unsigned* maxlens = (unsigned*)lodepng_malloc(headsize * sizeof(unsigned));
+  /*every node of tree2d has two slots and there are at most numcodes nodes*/
+  HuffmanLeaf* leaves = (HuffmanLeaf*)lodepng_malloc(tree->numcodes * 2 * sizeof(HuffmanLeaf));
+  if(!maxlens || !leaves)
+  {
+    lodepng_free(maxlens);
+    lodepng_free(leaves);
+    return 83; /*alloc fail*/
+  }
+  HuffmanTree_collectLeaves(tree, 0, 0, 0, leaves, &numleaves);
+
+  /*step 1: longest code behind every primary entry, they size the second level tables*/
+  memset(maxlens, 0, headsize * sizeof(unsigned));
+  for(i = 0; i != numleaves; ++i)
+  {
+    unsigned l = leaves[i].len;
+    unsigned index = leaves[i].code & mask;
+    if(l > FIRSTBITS && l > maxlens[index]) maxlens[index] = l;
+  }
+  size = headsize;
+  for(i = 0; i != headsize; ++i)
+  {
+    if(maxlens[i] > FIRSTBITS) size += (size_t)1u << (maxlens[i] - FIRSTBITS);
+  }
+
+  tree->table_len = (unsigned char*)lodepng_malloc(size * sizeof(unsigned char));
+  tree->table_value = (unsigned short*)lodepng_malloc(size * sizeof(unsigned short));
+  if(!tree->table_len || !tree->table_value)
+  {
+    lodepng_free(maxlens);
+    lodepng_free(leaves);
+    return 83; /*alloc fail*/
+  }
+  for(i = 0; i != size; ++i) tree->table_len[i] = INVALIDLENGTH;
+  for(i = 0; i != size; ++i) tree->table_value[i] = 0;
+
+  /*step 2: primary entries pointing to the second level tables*/
+  pointer = headsize;
+  for(i = 0; i != headsize; ++i)
+  {
+    unsigned l = maxlens[i];
+    if(l <= FIRSTBITS) continue;
+    tree->table_len[i] = (unsigned char)l;
+    tree->table_value[i] = (unsigned short)pointer;
+    pointer += (size_t)1u << (l - FIRSTBITS);
+  }
+
+  /*step 3: every code fills all the entries whose low bits are its code*/
+  for(i = 0; i != numleaves; ++i)
+  {
+    unsigned l = leaves[i].len;
+    unsigned code = leaves[i].code;
+    unsigned j, num;
+    if(l <= FIRSTBITS)
+    {
+      num = 1u << (FIRSTBITS - l);
+      for(j = 0; j < num; ++j)
+      {
+        unsigned index = code | (j << l);
+        tree->table_len[index] = (unsigned char)l;
+        tree->table_value[index] = (unsigned short)leaves[i].symbol;
+      }
+    }
+    else
+    {
+      unsigned maxlen = maxlens[code & mask];
+      unsigned start = tree->table_value[code & mask];
+      num = 1u << (maxlen - l);
+      for(j = 0; j < num; ++j)
+      {
+        unsigned index = start + ((code >> FIRSTBITS) | (j << (l - FIRSTBITS)));
+        tree->table_len[index] = (unsigned char)l;
+        tree->table_value[index] = (unsigned short)leaves[i].symbol;
+      }
+    }
+  }
+
+  lodepng_free(maxlens);
+  lodepng_free(leaves);
+  return 0;
+}
+
+/*
+the input of the inflater: one buffer, or the data of every IDAT chunk of a PNG in file order,
+read as one stream without concatenating them
+*/
+typedef struct LodePNGSegments
+{
+  const unsigned char* const* data;
+  const size_t* size;
+  size_t count;
+} LodePNGSegments;
+
+/*bits of the deflate stream, lsb first: the lowest "bits" bits of "buffer" are the next ones*/
+typedef struct LodePNGBitReader
+{
+  const LodePNGSegments* segments;
+  size_t segment; /*index of the current segment*/
+  const unsigned char* data; /*the current segment*/
+  size_t size; /*size of data in bytes*/
+  size_t pos; /*next byte of data to load in the buffer*/
+  size_t loaded; /*bytes loaded in the buffer so far, counted from the start of the first segment*/
+  size_t total; /*bytes of all segments*/
+  size_t buffer;
+  unsigned bits; /*number of valid bits in buffer*/
+} LodePNGBitReader;
+
+/*start reading at bit bp of the concatenated segments*/
+static void LodePNGBitReader_init(LodePNGBitReader* reader, const LodePNGSegments* segments, size_t bp)
+{
+  size_t i, skip = bp >> 3;
+  reader->segments = segments;
+  reader->total = 0;
+  for(i = 0; i != segments->count; ++i) reader->total += segments->size[i];
+  reader->segment = 0;
+  while(reader->segment < segments->count && skip >= segments->size[reader->segment])
+  {
+    skip -= segments->size[reader->segment];
+    ++reader->segment;
+  }
+  reader->data = reader->segment < segments->count ? segments->data[reader->segment] : 0;
+  reader->size = reader->segment < segments->count ? segments->size[reader->segment] : 0;
+  reader->pos = skip;
+  reader->loaded = bp >> 3;
+  reader->buffer = 0;
+  reader->bits = 0;
+  if(bp & 7u)
+  {
+    reader->buffer = reader->pos < reader->size ? (size_t)(reader->data[reader->pos] >> (bp & 7u)) : 0;
+    reader->bits = 8u - (unsigned)(bp & 7u);
+    ++reader->pos;
+    ++reader->loaded;
+  }
+}
+
+/*move on to the next non-empty segment once the current one is read, the last one stays*/
+static void LodePNGBitReader_nextSegment(LodePNGBitReader* reader)
+{
+  while(reader->pos >= reader->size && reader->segment + 1 < reader->segments->count)
+  {
+    ++reader->segment;
+    reader->data = reader->segments->data[reader->segment];
+    reader->size = reader->segments->size[reader->segment];
+    reader->pos = 0;
+  }
+}
+
+/*next byte of the segments, 0 past their end*/
+static unsigned char LodePNGBitReader_nextByte(LodePNGBitReader* reader)
+{
+  LodePNGBitReader_nextSegment(reader);
+  ++reader->loaded;
+  if(reader->pos < reader->size) return reader->data[reader->pos++];
+  return 0;
+}
+
+/*refill at the end of a segment: byte by byte, into the next one*/
+static void LodePNGBitReader_refillBytes(LodePNGBitReader* reader)
+{
+  while(reader->bits <= BITBUFFER_BITS - 8u)
+  {
+    reader->buffer |= (size_t)LodePNGBitReader_nextByte(reader) << reader->bits;
+    reader->bits += 8u;
+  }
+}
+
+/*
+fill the buffer up to at least BITBUFFER_BITS - 8 bits. Past the end of the data
+zero bits come in, the callers compare LodePNGBitReader_consumed with the input size.
+*/
+static void LodePNGBitReader_refill(LodePNGBitReader* reader)
+{
+  if(reader->pos + sizeof(size_t) <= reader->size)
+  {
+    /*one little endian word; the bits above the new count are the next ones of the segment
+    too, they are loaded again by the next refill*/
+    size_t word = 0, i, n = (BITBUFFER_BITS - 1u - reader->bits) >> 3;
+    for(i = 0; i != sizeof(size_t); ++i) word |= (size_t)reader->data[reader->pos + i] << (8u * i);
+    reader->buffer |= word << reader->bits;
+    reader->pos += n;
+    reader->loaded += n;
+    reader->bits |= BITBUFFER_BITS - 8u;
+  }
+  else LodePNGBitReader_refillBytes(reader);
+}
+
+/*make sure at least nbits (at most BITBUFFER_BITS - 8) bits are in the buffer*/
+static void LodePNGBitReader_ensure(LodePNGBitReader* reader, unsigned nbits)
+{
+  if(reader->bits < nbits) LodePNGBitReader_refill(reader);
+}
+
+static unsigned LodePNGBitReader_read(LodePNGBitReader* reader, unsigned nbits)
+{
+  unsigned result = (unsigned)(reader->buffer & (((size_t)1u << nbits) - 1u));
+  reader->buffer >>= nbits;
+  reader->bits -= nbits;
+  return result;
+}
+
+/*bit pointer in the concatenated segments of the next unread bit, may be past their end*/
+static size_t LodePNGBitReader_consumed(const LodePNGBitReader* reader)
+{
+  return reader->loaded * 8u - reader->bits;
+}
+
+/*skip to the next byte boundary, then copy n bytes (which must exist) to out*/
+static void LodePNGBitReader_copyBytes(LodePNGBitReader* reader, unsigned char* out, size_t n)
+{
+  reader->buffer >>= reader->bits & 7u;
+  reader->bits -= reader->bits & 7u;
+  while(n && reader->bits)
+  {
+    *out++ = (unsigned char)LodePNGBitReader_read(reader, 8);
+    --n;
+  }
+  if(!n) return;
+  /*the buffer is empty, only the bytes past its count may remain in it*/
+  reader->buffer = 0;
+  while(n)
+  {
+    size_t part;
+    LodePNGBitReader_nextSegment(reader);
+    part = reader->size - reader->pos < n ? reader->size - reader->pos : n;
+    if(part == 0) break; /*the caller checked the size, cannot happen*/
+    memcpy(out, reader->data + reader->pos, part);
+    out += part;
+    n -= part;
+    reader->pos += part;
+    reader->loaded += part;
+  }
+}
+
+/*returns the symbol, or (unsigned)(-1) for a code outside the tree. The buffer must hold 15 bits*/
+static unsigned huffmanDecodeSymbolFast(LodePNGBitReader* reader, const HuffmanTree* codetree)
+{
+  size_t index = reader->buffer & ((1u << FIRSTBITS) - 1u);
+  unsigned l = codetree->table_len[index];
+  unsigned value = codetree->table_value[index];
+  if(l > FIRSTBITS)
+  {
+    if(l == INVALIDLENGTH) return (unsigned)(-1);
+    index = value + ((reader->buffer >> FIRSTBITS) & ((1u << (l - FIRSTBITS)) - 1u));
+    l = codetree->table_len[index];
+    value = codetree->table_value[index];
+    if(l == INVALIDLENGTH) return (unsigned)(-1);
+  }
+  reader->buffer >>= l;
+  reader->bits -= l;
+  return value;
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Inflator (Decompressor)                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -943,14 +1351,16 @@ static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
   generateFixedDistanceTree(tree_d);
 }
 
-/*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
-                                      const unsigned char* in, size_t* bp, size_t inlength)
+/*
+get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree.
+Read through the bit reader, for both inflaters
+*/
+static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d, LodePNGBitReader* reader)
 {
   /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated*/
   unsigned error = 0;
   unsigned n, HLIT, HDIST, HCLEN, i;
-  size_t inbitlength = inlength * 8;
+  size_t inbitlength = reader->total * 8;
 
   /*see comments in deflateDynamic for explanation of the context and these variables, it is analogous*/
   unsigned* bitlen_ll = 0; /*lit,len code lengths*/
@@ -959,16 +1369,19 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   unsigned* bitlen_cl = 0;
   HuffmanTree tree_cl; /*the code tree for code length codes (the huffman tree for compressed huffman trees)*/
 
-  if((*bp) + 14 > (inlength << 3)) return 49; /*error: the bit pointer is or will go past the memory*/
+  /*error: the bit pointer is or will go past the memory*/
+  if(LodePNGBitReader_consumed(reader) + 14 > inbitlength) return 49;
 
+  LodePNGBitReader_ensure(reader, 14);
   /*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already*/
-  HLIT =  readBitsFromStream(bp, in, 5) + 257;
+  HLIT =  LodePNGBitReader_read(reader, 5) + 257;
   /*number of distance codes. Unlike the spec, the value 1 is added to it here already*/
-  HDIST = readBitsFromStream(bp, in, 5) + 1;
+  HDIST = LodePNGBitReader_read(reader, 5) + 1;
   /*number of code length codes. Unlike the spec, the value 4 is added to it here already*/
-  HCLEN = readBitsFromStream(bp, in, 4) + 4;
+  HCLEN = LodePNGBitReader_read(reader, 4) + 4;
 
-  if((*bp) + HCLEN * 3 > (inlength << 3)) return 50; /*error: the bit pointer is or will go past the memory*/
+  /*error: the bit pointer is or will go past the memory*/
+  if(LodePNGBitReader_consumed(reader) + HCLEN * 3 > inbitlength) return 50;
 
   HuffmanTree_init(&tree_cl);
 
@@ -981,11 +1394,13 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
     for(i = 0; i != NUM_CODE_LENGTH_CODES; ++i)
     {
-      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBitsFromStream(bp, in, 3);
+      LodePNGBitReader_ensure(reader, 3);
+      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = LodePNGBitReader_read(reader, 3);
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
 
     error = HuffmanTree_makeFromLengths(&tree_cl, bitlen_cl, NUM_CODE_LENGTH_CODES, 7);
+    if(!error) error = HuffmanTree_makeTable(&tree_cl);
     if(error) break;
 
     /*now we can use this tree to read the lengths for the tree that this function will return*/
@@ -999,7 +1414,11 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     i = 0;
     while(i < HLIT + HDIST)
     {
-      unsigned code = huffmanDecodeSymbol(in, bp, &tree_cl, inbitlength);
+      unsigned code;
+      LodePNGBitReader_ensure(reader, 7 + 7); /*the code & the extra bits of a repeat*/
+      code = huffmanDecodeSymbolFast(reader, &tree_cl);
+      /*bits past the end are zeros, a code read from them is no code*/
+      if(LodePNGBitReader_consumed(reader) > inbitlength) code = (unsigned)(-1);
       if(code <= 15) /*a length code*/
       {
         if(i < HLIT) bitlen_ll[i] = code;
@@ -1013,8 +1432,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
         if(i == 0) ERROR_BREAK(54); /*can't repeat previous if i is 0*/
 
-        if((*bp + 2) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 2);
+        /*error, bit pointer jumps past memory*/
+        if(LodePNGBitReader_consumed(reader) + 2 > inbitlength) ERROR_BREAK(50);
+        replength += LodePNGBitReader_read(reader, 2);
 
         if(i < HLIT + 1) value = bitlen_ll[i - 1];
         else value = bitlen_d[i - HLIT - 1];
@@ -1030,8 +1450,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 17) /*repeat "0" 3-10 times*/
       {
         unsigned replength = 3; /*read in the bits that indicate repeat length*/
-        if((*bp + 3) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 3);
+        /*error, bit pointer jumps past memory*/
+        if(LodePNGBitReader_consumed(reader) + 3 > inbitlength) ERROR_BREAK(50);
+        replength += LodePNGBitReader_read(reader, 3);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1046,8 +1467,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 18) /*repeat "0" 11-138 times*/
       {
         unsigned replength = 11; /*read in the bits that indicate repeat length*/
-        if((*bp + 7) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 7);
+        /*error, bit pointer jumps past memory*/
+        if(LodePNGBitReader_consumed(reader) + 7 > inbitlength) ERROR_BREAK(50);
+        replength += LodePNGBitReader_read(reader, 7);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1059,13 +1481,13 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
           ++i;
         }
       }
-      else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+      else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbolFast returns (unsigned)(-1) in case of error*/
       {
         if(code == (unsigned)(-1))
         {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inbitlength ? 10 : 11;
+          /*wrong jump outside of tree, or the end of the input: the bit by bit walk this replaces
+          stopped at the last bit there, and gave 11 for both*/
+          error = 11;
         }
         else error = 16; /*unexisting code, this can never happen*/
         break;
@@ -1104,7 +1526,17 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   HuffmanTree_init(&tree_d);
 
   if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
-  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
+  else if(btype == 2)
+  {
+    LodePNGSegments segments;
+    LodePNGBitReader reader;
+    segments.data = &in;
+    segments.size = &inlength;
+    segments.count = 1;
+    LodePNGBitReader_init(&reader, &segments, *bp);
+    error = getTreeInflateDynamic(&tree_ll, &tree_d, &reader);
+    *bp = LodePNGBitReader_consumed(&reader);
+  }
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
@@ -1186,6 +1618,151 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
+/*deflate window: the farthest back a match can reach*/
+#define INFLATE_WINDOW 32768u
+/*with stream_output, output handed over to progress at a time (when a block is larger)*/
+#define INFLATE_STREAM_PIECE (1u << 18)
+
+/*
+hand the output after *reported over to progress. With stream_output, out then only keeps the deflate
+window: the last INFLATE_WINDOW bytes move to the start
+*/
+static unsigned inflateFlush(ucvector* out, size_t* pos, size_t* reported, const LodePNGDecompressSettings* settings)
+{
+  unsigned error = 0;
+  if(settings->progress && *pos > *reported)
+  {
+    error = settings->progress(settings->progress_context, out->data + *reported, *pos - *reported);
+  }
+  *reported = *pos;
+  if(!error && settings->stream_output && settings->progress && *pos > INFLATE_WINDOW)
+  {
+    memmove(out->data, out->data + *pos - INFLATE_WINDOW, INFLATE_WINDOW);
+    *pos = *reported = INFLATE_WINDOW;
+  }
+  out->size = *pos;
+  return error;
+}
+
+/*
+same as inflateHuffmanBlock, with the lookup tables & the bit buffer. With stream_output, the output
+is flushed whenever out is full instead of growing it
+*/
+static unsigned inflateHuffmanBlockFast(ucvector* out, LodePNGBitReader* stream, size_t* pos, size_t* reported,
+                                        unsigned btype, const LodePNGDecompressSettings* settings)
+{
+  unsigned stream_output = settings->stream_output && settings->progress;
+  unsigned error = 0;
+  HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
+  HuffmanTree tree_d; /*the huffman tree for distance codes*/
+  LodePNGBitReader reader;
+  size_t inbitlength = stream->total * 8;
+
+  HuffmanTree_init(&tree_ll);
+  HuffmanTree_init(&tree_d);
+
+  if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
+  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, stream);
+
+  if(!error) error = HuffmanTree_makeTable(&tree_ll);
+  if(!error) error = HuffmanTree_makeTable(&tree_d);
+
+  /*a local copy, the stores to out (unsigned char) can't alias it, so the bit buffer stays in registers*/
+  reader = *stream;
+
+  while(!error) /*decode all symbols until end reached, breaks at end code*/
+  {
+    unsigned code_ll;
+    /*room for the longest match, plus the 8 bytes a wide copy may write past it*/
+    if(out->allocsize < *pos + MAX_MATCH_LENGTH + 8)
+    {
+      if(stream_output && *pos > INFLATE_WINDOW)
+      {
+        error = inflateFlush(out, pos, reported, settings);
+        if(error) break;
+      }
+      if(!ucvector_reserve(out, *pos + MAX_MATCH_LENGTH + 8)) ERROR_BREAK(83 /*alloc fail*/);
+    }
+
+    /*code_ll is literal, length or end code*/
+    LodePNGBitReader_ensure(&reader, 15);
+    code_ll = huffmanDecodeSymbolFast(&reader, &tree_ll);
+    if(LodePNGBitReader_consumed(&reader) > inbitlength)
+      ERROR_BREAK(10); /*error: end of input memory reached without endcode*/
+
+    if(code_ll <= 255) /*literal symbol*/
+    {
+      out->data[(*pos)++] = (unsigned char)code_ll;
+    }
+    else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/
+    {
+      unsigned code_d, distance;
+      unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
+      size_t backward, length;
+      unsigned char* dest;
+      const unsigned char* src;
+
+      /*part 1 & 2: length base & its extra bits (5 at most)*/
+      length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
+      numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
+      LodePNGBitReader_ensure(&reader, 5 + 15);
+      length += LodePNGBitReader_read(&reader, numextrabits_l);
+
+      /*part 3: get distance code*/
+      code_d = huffmanDecodeSymbolFast(&reader, &tree_d);
+      if(code_d > 29)
+      {
+        if(LodePNGBitReader_consumed(&reader) > inbitlength) error = 10; /*no endcode*/
+        else if(code_d == (unsigned)(-1)) error = 11; /*code outside of the tree*/
+        else error = 18; /*error: invalid distance code (30-31 are never used)*/
+        break;
+      }
+
+      /*part 4: get extra bits from distance (13 at most)*/
+      distance = DISTANCEBASE[code_d];
+      numextrabits_d = DISTANCEEXTRA[code_d];
+      LodePNGBitReader_ensure(&reader, 13);
+      distance += LodePNGBitReader_read(&reader, numextrabits_d);
+      if(LodePNGBitReader_consumed(&reader) > inbitlength) ERROR_BREAK(51); /*error, bit pointer jumped past memory*/
+
+      /*part 5: copy the match, 8 bytes at a time when the distance allows it*/
+      if(distance > *pos) ERROR_BREAK(52); /*too long backward distance*/
+      backward = *pos - distance;
+      dest = out->data + *pos;
+      src = out->data + backward;
+      if(distance >= 8)
+      {
+        size_t i;
+        for(i = 0; i < length; i += 8) memcpy(dest + i, src + i, 8);
+      }
+      else if(distance == 1) memset(dest, *src, length);
+      else
+      {
+        size_t i;
+        for(i = 0; i != length; ++i) dest[i] = src[i];
+      }
+      *pos += length;
+    }
+    else if(code_ll == 256)
+    {
+      break; /*end code, break the loop*/
+    }
+    else /*invalid code or (unsigned)(-1): code outside of the tree*/
+    {
+      error = 11;
+      break;
+    }
+  }
+
+  out->size = *pos;
+  *stream = reader;
+
+  HuffmanTree_cleanup(&tree_ll);
+  HuffmanTree_cleanup(&tree_d);
+
+  return error;
+}
+
 static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
 {
   size_t p;
@@ -1214,6 +1791,70 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   return error;
 }
 
+/*same as inflateNoCompression, through the bit reader*/
+static unsigned inflateNoCompressionFast(ucvector* out, LodePNGBitReader* reader, size_t* pos)
+{
+  unsigned LEN, NLEN;
+  /*byte position of LEN, after the first boundary of byte*/
+  size_t p = (LodePNGBitReader_consumed(reader) + 7) / 8;
+
+  /*read LEN (2 bytes) and NLEN (2 bytes)*/
+  if(p + 4 >= reader->total) return 52; /*error, bit pointer will jump past memory*/
+  reader->buffer >>= reader->bits & 7u;
+  reader->bits -= reader->bits & 7u;
+  LodePNGBitReader_ensure(reader, 16);
+  LEN = LodePNGBitReader_read(reader, 16);
+  LodePNGBitReader_ensure(reader, 16);
+  NLEN = LodePNGBitReader_read(reader, 16);
+
+  /*check if 16-bit NLEN is really the one's complement of LEN*/
+  if(LEN + NLEN != 65535) return 21; /*error: NLEN is not one's complement of LEN*/
+
+  if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
+
+  /*read the literal data: LEN bytes are now stored in the out buffer*/
+  if(p + 4 + LEN > reader->total) return 23; /*error: reading outside of in buffer*/
+  LodePNGBitReader_copyBytes(reader, out->data + *pos, LEN);
+  *pos += LEN;
+
+  return 0;
+}
+
+/*lodepng_inflatev with fast_inflate: all the blocks of the deflate stream read by the reader*/
+static unsigned inflateFast(ucvector* out, LodePNGBitReader* reader, const LodePNGDecompressSettings* settings)
+{
+  unsigned BFINAL = 0;
+  size_t pos = 0; /*byte position in the out buffer*/
+  size_t reported = 0; /*bytes of out handed over to progress*/
+  unsigned error = 0;
+
+  /*with stream_output, out holds the window & one piece*/
+  if(settings->stream_output && settings->progress && !ucvector_reserve(out, INFLATE_WINDOW + INFLATE_STREAM_PIECE))
+  {
+    return 83; /*alloc fail*/
+  }
+
+  while(!BFINAL)
+  {
+    unsigned BTYPE;
+    /*error, bit pointer will jump past memory*/
+    if(LodePNGBitReader_consumed(reader) + 2 >= reader->total * 8) return 52;
+    LodePNGBitReader_ensure(reader, 3);
+    BFINAL = LodePNGBitReader_read(reader, 1);
+    BTYPE = LodePNGBitReader_read(reader, 2);
+
+    if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
+    else if(BTYPE == 0) error = inflateNoCompressionFast(out, reader, &pos); /*no compression*/
+    else error = inflateHuffmanBlockFast(out, reader, &pos, &reported, BTYPE, settings); /*compression, BTYPE 01 or 10*/
+
+    if(error) return error;
+    error = inflateFlush(out, &pos, &reported, settings);
+    if(error) return error;
+  }
+
+  return error;
+}
+
 static unsigned lodepng_inflatev(ucvector* out,
                                  const unsigned char* in, size_t insize,
                                  const LodePNGDecompressSettings* settings)
@@ -1222,9 +1863,19 @@ static unsigned lodepng_inflatev(ucvector* out,
   size_t bp = 0;
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
+  size_t reported = 0; /*bytes of out handed over to progress*/
   unsigned error = 0;
 
-  (void)settings;
+  if(settings->fast_inflate)
+  {
+    LodePNGSegments segments;
+    LodePNGBitReader reader;
+    segments.data = &in;
+    segments.size = &insize;
+    segments.count = 1;
+    LodePNGBitReader_init(&reader, &segments, 0);
+    return inflateFast(out, &reader, settings);
+  }
 
   while(!BFINAL)
   {
@@ -1239,6 +1890,9 @@ static unsigned lodepng_inflatev(ucvector* out,
     else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
+    if(settings->progress) error = settings->progress(settings->progress_context, out->data + reported, pos - reported);
+    reported = pos;
+    if(error) return error;
   }
 
   return error;
@@ -1340,6 +1994,8 @@ typedef struct Hash
   int* headz; /*similar to head, but for chainz*/
   unsigned short* chainz; /*those with same amount of zeros*/
   unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+
+  unsigned* last; /*LMS_GREEDY: last position + 1 of every 4-byte hash value, 0 if none*/
 } Hash;
 
 static unsigned hash_init(Hash* hash, unsigned windowsize)
@@ -1352,6 +2008,7 @@ static unsigned hash_init(Hash* hash, unsigned windowsize)
   hash->zeros = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
   hash->headz = (int*)lodepng_malloc(sizeof(int) * (MAX_SUPPORTED_DEFLATE_LENGTH + 1));
   hash->chainz = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
+  hash->last = 0;
 
   if(!hash->head || !hash->chain || !hash->val  || !hash->headz|| !hash->chainz || !hash->zeros)
   {
@@ -1378,6 +2035,26 @@ static void hash_cleanup(Hash* hash)
   lodepng_free(hash->zeros);
   lodepng_free(hash->headz);
   lodepng_free(hash->chainz);
+  lodepng_free(hash->last);
+}
+
+/*hash_init for LMS_GREEDY & LMS_RLE: no chains, the greedy matcher only has its table*/
+static unsigned hash_init_fast(Hash* hash, LodePNGMatchStrategy strategy)
+{
+  hash->head = 0;
+  hash->val = 0;
+  hash->chain = 0;
+  hash->zeros = 0;
+  hash->headz = 0;
+  hash->chainz = 0;
+  hash->last = 0;
+  if(strategy == LMS_GREEDY)
+  {
+    hash->last = (unsigned*)lodepng_malloc(sizeof(unsigned) * HASH_NUM_VALUES);
+    if(!hash->last) return 83; /*alloc fail*/
+    memset(hash->last, 0, sizeof(unsigned) * HASH_NUM_VALUES);
+  }
+  return 0;
 }
 
 
@@ -1612,6 +2289,88 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+/*16-bit hash of the 4 bytes at data, for the single probe of LMS_GREEDY*/
+static unsigned getHash4(const unsigned char* data)
+{
+  unsigned value = (unsigned)data[0] | ((unsigned)data[1] << 8u)
+                 | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+  return ((value * 2654435761u) >> 16u) & HASH_BIT_MASK;
+}
+
+/*
+LZ77 of LMS_GREEDY & LMS_RLE, same values as encodeLZ77. One candidate per position: the
+previous byte for LMS_RLE, the last position with the same 4-byte hash for LMS_GREEDY. A match
+is taken as soon as it is found, the positions it covers are skipped without being hashed.
+*/
+static unsigned encodeLZ77Fast(uivector* out, Hash* hash,
+                               const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
+                               unsigned minmatch, LodePNGMatchStrategy strategy)
+{
+  size_t pos = inpos;
+
+  if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
+  if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+  if(minmatch < 3) minmatch = 3;
+  /*at most one value per input byte*/
+  if(!uivector_reserve(out, (out->size + insize - inpos) * sizeof(unsigned))) return 83; /*alloc fail*/
+
+  while(pos < insize)
+  {
+    size_t length = 0, distance = 0;
+    size_t maxlength = insize - pos < MAX_SUPPORTED_DEFLATE_LENGTH ? insize - pos : MAX_SUPPORTED_DEFLATE_LENGTH;
+
+    if(strategy == LMS_RLE)
+    {
+      if(pos > 0)
+      {
+        unsigned char previous = in[pos - 1];
+        while(length != maxlength && in[pos + length] == previous) ++length;
+        distance = 1;
+      }
+    }
+    else if(maxlength >= 4)
+    {
+      unsigned hashval = getHash4(&in[pos]);
+      size_t candidate = hash->last[hashval];
+      hash->last[hashval] = (unsigned)(pos + 1);
+      if(candidate != 0 && pos + 1 - candidate <= windowsize)
+      {
+        const unsigned char* foreptr = &in[pos];
+        const unsigned char* backptr;
+        distance = pos + 1 - candidate;
+        backptr = foreptr - distance;
+        while(length != maxlength && foreptr[length] == backptr[length]) ++length;
+      }
+    }
+
+    if(length >= minmatch)
+    {
+      addLengthDistance(out, length, distance);
+      pos += length;
+    }
+    else
+    {
+      if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+      ++pos;
+    }
+  }
+
+  return 0;
+}
+
+/*the LZ77 of the match strategy of the settings*/
+static unsigned encodeMatches(uivector* out, Hash* hash, const unsigned char* in, size_t inpos, size_t insize,
+                              const LodePNGCompressSettings* settings)
+{
+  if(settings->match_strategy == LMS_GREEDY || settings->match_strategy == LMS_RLE)
+  {
+    return encodeLZ77Fast(out, hash, in, inpos, insize, settings->windowsize,
+                          settings->minmatch, settings->match_strategy);
+  }
+  return encodeLZ77(out, hash, in, inpos, insize, settings->windowsize,
+                    settings->minmatch, settings->nicematch, settings->lazymatching);
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
 static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
@@ -1651,19 +2410,108 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
   return 0;
 }
 
+/*
+bits of the deflate stream, lsb first, gathered in a word and written out a byte at a time,
+instead of one addBitToStream per bit
+*/
+typedef struct LodePNGBitWriter
+{
+  ucvector* out;
+  size_t buffer;
+  unsigned bits; /*number of bits in buffer*/
+  unsigned error;
+} LodePNGBitWriter;
+
+/*continue the stream at the bit pointer bp, its last byte may be partly written*/
+static void LodePNGBitWriter_init(LodePNGBitWriter* writer, ucvector* out, size_t bp)
+{
+  writer->out = out;
+  writer->buffer = 0;
+  writer->bits = (unsigned)(bp & 7u);
+  writer->error = 0;
+  if(writer->bits)
+  {
+    writer->buffer = out->data[out->size - 1];
+    --out->size;
+  }
+}
+
+/*write out the whole bytes of the buffer*/
+static void LodePNGBitWriter_flush(LodePNGBitWriter* writer)
+{
+  ucvector* out = writer->out;
+  if(!ucvector_reserve(out, out->size + sizeof(size_t)))
+  {
+    writer->error = 83; /*alloc fail*/
+    writer->bits &= 7u;
+    return;
+  }
+  while(writer->bits >= 8)
+  {
+    out->data[out->size++] = (unsigned char)writer->buffer;
+    writer->buffer >>= 8;
+    writer->bits -= 8;
+  }
+}
+
+/*nbits is at most 24*/
+static void LodePNGBitWriter_add(LodePNGBitWriter* writer, unsigned value, unsigned nbits)
+{
+  writer->buffer |= (size_t)value << writer->bits;
+  writer->bits += nbits;
+  if(writer->bits >= BITBUFFER_BITS - 24u) LodePNGBitWriter_flush(writer);
+}
+
+/*write out the rest, the last byte partly if needed, and give the bit pointer. Returns the error*/
+static unsigned LodePNGBitWriter_finish(LodePNGBitWriter* writer, size_t* bp)
+{
+  LodePNGBitWriter_flush(writer);
+  if(writer->bits && !writer->error)
+  {
+    if(!ucvector_push_back(writer->out, (unsigned char)writer->buffer)) writer->error = 83; /*alloc fail*/
+  }
+  *bp = writer->out->size * 8u - (writer->bits ? 8u - writer->bits : 0u);
+  return writer->error;
+}
+
+/*code of a Huffman symbol in stream order (the first bit of the code in the lsb)*/
+static unsigned reverseBits(unsigned bits, unsigned num)
+{
+  unsigned i, result = 0;
+  for(i = 0; i < num; ++i) result |= ((bits >> (num - i - 1u)) & 1u) << i;
+  return result;
+}
+
 /*
 write the lz77-encoded data, which has lit, len and dist codes, to compressed stream using huffman trees.
 tree_ll: the tree for lit and len codes.
 tree_d: the tree for distance codes.
+The codes are reversed into tables once, then written through a LodePNGBitWriter. Returns the error
 */
-static void writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encoded,
-                          const HuffmanTree* tree_ll, const HuffmanTree* tree_d)
+static unsigned writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encoded,
+                              const HuffmanTree* tree_ll, const HuffmanTree* tree_d)
 {
   size_t i = 0;
+  unsigned code_ll[NUM_DEFLATE_CODE_SYMBOLS], code_d[NUM_DISTANCE_SYMBOLS];
+  unsigned length_ll[NUM_DEFLATE_CODE_SYMBOLS], length_d[NUM_DISTANCE_SYMBOLS];
+  LodePNGBitWriter writer;
+
+  for(i = 0; i != NUM_DEFLATE_CODE_SYMBOLS; ++i)
+  {
+    length_ll[i] = i < tree_ll->numcodes ? HuffmanTree_getLength(tree_ll, (unsigned)i) : 0;
+    code_ll[i] = length_ll[i] ? reverseBits(HuffmanTree_getCode(tree_ll, (unsigned)i), length_ll[i]) : 0;
+  }
+  for(i = 0; i != NUM_DISTANCE_SYMBOLS; ++i)
+  {
+    length_d[i] = i < tree_d->numcodes ? HuffmanTree_getLength(tree_d, (unsigned)i) : 0;
+    code_d[i] = length_d[i] ? reverseBits(HuffmanTree_getCode(tree_d, (unsigned)i), length_d[i]) : 0;
+  }
+
+  LodePNGBitWriter_init(&writer, out, *bp);
   for(i = 0; i != lz77_encoded->size; ++i)
   {
     unsigned val = lz77_encoded->data[i];
-    addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_ll, val), HuffmanTree_getLength(tree_ll, val));
+    LodePNGBitWriter_add(&writer, code_ll[val], length_ll[val]);
     if(val > 256) /*for a length code, 3 more things have to be added*/
     {
       unsigned length_index = val - FIRST_LENGTH_CODE_INDEX;
@@ -1676,12 +2524,12 @@ static void writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encode
       unsigned n_distance_extra_bits = DISTANCEEXTRA[distance_index];
       unsigned distance_extra_bits = lz77_encoded->data[++i];
 
-      addBitsToStream(bp, out, length_extra_bits, n_length_extra_bits);
-      addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_d, distance_code),
-                       HuffmanTree_getLength(tree_d, distance_code));
-      addBitsToStream(bp, out, distance_extra_bits, n_distance_extra_bits);
+      LodePNGBitWriter_add(&writer, length_extra_bits, n_length_extra_bits);
+      LodePNGBitWriter_add(&writer, code_d[distance_code], length_d[distance_code]);
+      LodePNGBitWriter_add(&writer, distance_extra_bits, n_distance_extra_bits);
     }
   }
+  return LodePNGBitWriter_finish(&writer, bp);
 }
 
 /*Deflate for a block of type "dynamic", that is, with freely, optimally, created huffman trees*/
@@ -1746,8 +2594,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   {
     if(settings->use_lz77)
     {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeMatches(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     }
     else
@@ -1905,7 +2752,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
     }
 
     /*write the compressed data symbols*/
-    writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+    error = writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+    if(error) break;
     /*error: the length of the end code 256 must be larger than 0*/
     if(HuffmanTree_getLength(&tree_ll, 256) == 0) ERROR_BREAK(64);
 
@@ -1956,9 +2804,8 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   {
     uivector lz77_encoded;
     uivector_init(&lz77_encoded);
-    error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                       settings->minmatch, settings->nicematch, settings->lazymatching);
-    if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+    error = encodeMatches(&lz77_encoded, hash, data, datapos, dataend, settings);
+    if(!error) error = writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
     uivector_cleanup(&lz77_encoded);
   }
   else /*no LZ77, but still will be Huffman compressed*/
@@ -2000,8 +2847,16 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   numdeflateblocks = (insize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
-  if(error) return error;
+  if(settings->match_strategy == LMS_GREEDY || settings->match_strategy == LMS_RLE)
+  {
+    error = hash_init_fast(&hash, settings->match_strategy);
+  }
+  else error = hash_init(&hash, settings->windowsize);
+  if(error)
+  {
+    hash_cleanup(&hash);
+    return error;
+  }
 
   for(i = 0; i != numdeflateblocks && !error; ++i)
   {
@@ -2087,11 +2942,44 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*streamed zlib stream: progress of the inflater, sums the Adler-32 of every piece before passing it on*/
+typedef struct ZlibStream
+{
+  const LodePNGDecompressSettings* settings;
+  unsigned adler;
+} ZlibStream;
+
+static unsigned ZlibStream_progress(void* context, const unsigned char* data, size_t size)
+{
+  ZlibStream* stream = (ZlibStream*)context;
+  stream->adler = update_adler32(stream->adler, data, (unsigned)size);
+  return stream->settings->progress(stream->settings->progress_context, data, size);
+}
+
+/*
+whether the built in fast inflater streams its output (stream_output), the output is then not kept
+and the checksum is taken piece by piece: *inflater gets the settings to inflate with
+*/
+static unsigned ZlibStream_init(ZlibStream* stream, LodePNGDecompressSettings* inflater,
+                                const LodePNGDecompressSettings* settings)
+{
+  *inflater = *settings;
+  if(!settings->stream_output || !settings->fast_inflate || !settings->progress || settings->custom_inflate) return 0;
+  stream->settings = settings;
+  stream->adler = 1;
+  inflater->progress = ZlibStream_progress;
+  inflater->progress_context = stream;
+  return 1;
+}
+
 unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                  size_t insize, const LodePNGDecompressSettings* settings)
 {
   unsigned error = 0;
   unsigned CM, CINFO, FDICT;
+  ZlibStream stream;
+  LodePNGDecompressSettings inflater;
+  unsigned streamed;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
   /*read information from zlib header*/
@@ -2119,13 +3007,71 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     return 26;
   }
 
-  error = inflate(out, outsize, in + 2, insize - 2, settings);
+  streamed = ZlibStream_init(&stream, &inflater, settings);
+  error = inflate(out, outsize, in + 2, insize - 2, &inflater);
   if(error) return error;
 
   if(!settings->ignore_adler32)
   {
     unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-    unsigned checksum = adler32(*out, (unsigned)(*outsize));
+    unsigned checksum = streamed ? stream.adler : adler32(*out, (unsigned)(*outsize));
+    if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
+  }
+
+  return 0; /*no error*/
+}
+
+/*
+lodepng_zlib_decompress of a zlib stream split in segments (the IDAT chunks of a PNG), inflated where
+they are by the fast inflater, into out. For fast_inflate without custom_zlib nor custom_inflate
+*/
+static unsigned zlibDecompressSegments(ucvector* out, const LodePNGSegments* segments,
+                                       const LodePNGDecompressSettings* settings)
+{
+  unsigned error = 0;
+  unsigned CMF, FLG, CM, CINFO, FDICT;
+  LodePNGBitReader reader;
+  ZlibStream stream;
+  LodePNGDecompressSettings inflater;
+  unsigned streamed = ZlibStream_init(&stream, &inflater, settings);
+
+  LodePNGBitReader_init(&reader, segments, 0);
+  if(reader.total < 2) return 53; /*error, size of zlib data too small*/
+  /*read information from zlib header*/
+  LodePNGBitReader_ensure(&reader, 16);
+  CMF = LodePNGBitReader_read(&reader, 8);
+  FLG = LodePNGBitReader_read(&reader, 8);
+  if((CMF * 256 + FLG) % 31 != 0)
+  {
+    /*error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way*/
+    return 24;
+  }
+
+  CM = CMF & 15;
+  CINFO = (CMF >> 4) & 15;
+  FDICT = (FLG >> 5) & 1;
+
+  /*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec*/
+  if(CM != 8 || CINFO > 7) return 25;
+  /*error: the specification of PNG says about the zlib stream:
+    "The additional flags shall not specify a preset dictionary."*/
+  if(FDICT != 0) return 26;
+
+  error = inflateFast(out, &reader, &inflater);
+  if(error) return error;
+
+  if(!settings->ignore_adler32)
+  {
+    /*the last 4 bytes of the stream, big endian, maybe split over two segments*/
+    unsigned ADLER32 = 0, i, checksum;
+    if(reader.total < 6) return 58; /*no room for the checksum after the header*/
+    LodePNGBitReader_init(&reader, segments, (reader.total - 4) * 8);
+    for(i = 0; i != 4; ++i)
+    {
+      LodePNGBitReader_ensure(&reader, 8);
+      ADLER32 = (ADLER32 << 8) | LodePNGBitReader_read(&reader, 8);
+    }
+    checksum = streamed ? stream.adler : adler32(out->data, (unsigned)out->size);
     if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
   }
 
@@ -2243,13 +3189,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->match_strategy = LMS_HASH_CHAIN;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, LMS_HASH_CHAIN,
+                                                                   0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2259,13 +3207,17 @@ const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT
 void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings)
 {
   settings->ignore_adler32 = 0;
+  settings->fast_inflate = 0;
 
   settings->custom_zlib = 0;
   settings->custom_inflate = 0;
   settings->custom_context = 0;
+  settings->progress = 0;
+  settings->progress_context = 0;
+  settings->stream_output = 0;
 }
 
-const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0};
+const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0, 0, 0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -3881,21 +4833,250 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
     unsigned checksum = lodepng_crc32(&in[12], 17);
     if(CRC != checksum)
     {
-      CERROR_RETURN_ERROR(state->error, 57); /*invalid CRC*/
+      CERROR_RETURN_ERROR(state->error, 57); /*invalid CRC*/
+    }
+  }
+
+  /*error: only compression method 0 is allowed in the specification*/
+  if(info->compression_method != 0) CERROR_RETURN_ERROR(state->error, 32);
+  /*error: only filter method 0 is allowed in the specification*/
+  if(info->filter_method != 0) CERROR_RETURN_ERROR(state->error, 33);
+  /*error: only interlace methods 0 and 1 exist in the specification*/
+  if(info->interlace_method > 1) CERROR_RETURN_ERROR(state->error, 34);
+
+  state->error = checkColorValidity(info->color.colortype, info->color.bitdepth);
+  return state->error;
+}
+
+#ifdef LODEPNG_UNFILTER_SIMD
+
+/*
+Vectorized unfilterScanline. Up adds 16 (NEON: 8) bytes at a time; Sub, Average and Paeth depend on
+the pixel to the left, so for 3 and 4 byte pixels they reconstruct one whole pixel per step, its bytes
+in the lanes of one register. The results are the same as the byte loops of unfilterScanline. recon
+may be the same memory as scanline or lie before it (the in place unfilter): every pixel and every Up
+chunk is loaded before it is stored, and only its own bytes are stored.
+*/
+
+#if defined(LODEPNG_UNFILTER_SSE2)
+
+#define LODEPNG_SIMD_TARGET __attribute__((target("sse2")))
+
+/*the bytewidth (3 or 4) bytes at p in the low lanes, the other lanes 0*/
+LODEPNG_SIMD_TARGET static __m128i loadPixel(const unsigned char* p, size_t bytewidth)
+{
+  unsigned v;
+  if(bytewidth == 4) memcpy(&v, p, 4);
+  else v = p[0] | ((unsigned)p[1] << 8) | ((unsigned)p[2] << 16);
+  return _mm_cvtsi32_si128((int)v);
+}
+
+LODEPNG_SIMD_TARGET static void storePixel(unsigned char* p, __m128i x, size_t bytewidth)
+{
+  unsigned v = (unsigned)_mm_cvtsi128_si32(x);
+  if(bytewidth == 4) memcpy(p, &v, 4);
+  else
+  {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+  }
+}
+
+/*|x - y| of 16-bit lanes*/
+LODEPNG_SIMD_TARGET static __m128i absDiff16(__m128i x, __m128i y)
+{
+  return _mm_max_epi16(_mm_sub_epi16(x, y), _mm_sub_epi16(y, x));
+}
+
+/*returns 1 if the scanline was unfiltered, 0 if the byte loops must do it*/
+LODEPNG_SIMD_TARGET static unsigned unfilterScanlineSimd(unsigned char* recon, const unsigned char* scanline,
+                                                        const unsigned char* precon, size_t bytewidth,
+                                                        unsigned char filterType, size_t length)
+{
+  size_t i;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a, b, c, x;
+
+  if(filterType == 2 && precon)
+  {
+    for(i = 0; i + 16 <= length; i += 16)
+    {
+      x = _mm_loadu_si128((const __m128i*)(scanline + i));
+      b = _mm_loadu_si128((const __m128i*)(precon + i));
+      _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+    }
+    for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+    return 1;
+  }
+  if(bytewidth != 3 && bytewidth != 4) return 0;
+
+  switch(filterType)
+  {
+    case 1:
+      a = loadPixel(scanline, bytewidth);
+      storePixel(recon, a, bytewidth);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        a = _mm_add_epi8(loadPixel(scanline + i, bytewidth), a);
+        storePixel(recon + i, a, bytewidth);
+      }
+      return 1;
+    case 3:
+      if(!precon) return 0;
+      b = loadPixel(precon, bytewidth);
+      /*(0 + b) >> 1: _mm_avg_epu8 rounds up, remove the carried 1 of odd sums*/
+      a = _mm_add_epi8(loadPixel(scanline, bytewidth), _mm_srli_epi16(_mm_and_si128(b, _mm_set1_epi8((char)0xfe)), 1));
+      storePixel(recon, a, bytewidth);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        b = loadPixel(precon + i, bytewidth);
+        c = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+        a = _mm_add_epi8(loadPixel(scanline + i, bytewidth), c);
+        storePixel(recon + i, a, bytewidth);
+      }
+      return 1;
+    case 4:
+      if(!precon) return 0;
+      /*paethPredictor(0, b, 0) is always b*/
+      c = loadPixel(precon, bytewidth);
+      a = _mm_add_epi8(loadPixel(scanline, bytewidth), c);
+      storePixel(recon, a, bytewidth);
+      c = _mm_unpacklo_epi8(c, zero);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        __m128i a16, pa, pb, pc, usec, useb, pred;
+        b = _mm_unpacklo_epi8(loadPixel(precon + i, bytewidth), zero);
+        a16 = _mm_unpacklo_epi8(a, zero);
+        /*same comparisons as paethPredictor, in 16-bit lanes*/
+        pa = absDiff16(b, c);
+        pb = absDiff16(a16, c);
+        pc = absDiff16(_mm_add_epi16(a16, b), _mm_add_epi16(c, c));
+        usec = _mm_and_si128(_mm_cmplt_epi16(pc, pa), _mm_cmplt_epi16(pc, pb));
+        useb = _mm_andnot_si128(usec, _mm_cmplt_epi16(pb, pa));
+        pred = _mm_or_si128(_mm_and_si128(usec, c),
+               _mm_or_si128(_mm_and_si128(useb, b), _mm_andnot_si128(_mm_or_si128(usec, useb), a16)));
+        a = _mm_add_epi8(loadPixel(scanline + i, bytewidth), _mm_packus_epi16(pred, pred));
+        storePixel(recon + i, a, bytewidth);
+        c = b;
+      }
+      return 1;
+    default: return 0;
+  }
+}
+
+/*SSE2 is part of x86-64, 32-bit x86 builds check the CPU once*/
+static unsigned unfilterSimdSupported(void)
+{
+#if defined(__SSE2__)
+  return 1;
+#else
+  static int supported = -1;
+  if(supported < 0)
+  {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("sse2") ? 1 : 0;
+  }
+  return (unsigned)supported;
+#endif
+}
+
+#elif defined(LODEPNG_UNFILTER_NEON)
+
+/*the bytewidth (3 or 4) bytes at p in the low lanes, the other lanes 0*/
+static uint8x8_t loadPixel(const unsigned char* p, size_t bytewidth)
+{
+  unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  memcpy(bytes, p, bytewidth);
+  return vld1_u8(bytes);
+}
+
+static void storePixel(unsigned char* p, uint8x8_t x, size_t bytewidth)
+{
+  unsigned char bytes[8];
+  vst1_u8(bytes, x);
+  memcpy(p, bytes, bytewidth);
+}
+
+/*returns 1 if the scanline was unfiltered, 0 if the byte loops must do it*/
+static unsigned unfilterScanlineSimd(unsigned char* recon, const unsigned char* scanline,
+                                     const unsigned char* precon, size_t bytewidth,
+                                     unsigned char filterType, size_t length)
+{
+  size_t i;
+  uint8x8_t a, b, c;
+
+  if(filterType == 2 && precon)
+  {
+    for(i = 0; i + 16 <= length; i += 16)
+    {
+      vst1q_u8(recon + i, vaddq_u8(vld1q_u8(scanline + i), vld1q_u8(precon + i)));
     }
+    for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+    return 1;
   }
+  if(bytewidth != 3 && bytewidth != 4) return 0;
 
-  /*error: only compression method 0 is allowed in the specification*/
-  if(info->compression_method != 0) CERROR_RETURN_ERROR(state->error, 32);
-  /*error: only filter method 0 is allowed in the specification*/
-  if(info->filter_method != 0) CERROR_RETURN_ERROR(state->error, 33);
-  /*error: only interlace methods 0 and 1 exist in the specification*/
-  if(info->interlace_method > 1) CERROR_RETURN_ERROR(state->error, 34);
+  switch(filterType)
+  {
+    case 1:
+      a = loadPixel(scanline, bytewidth);
+      storePixel(recon, a, bytewidth);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        a = vadd_u8(loadPixel(scanline + i, bytewidth), a);
+        storePixel(recon + i, a, bytewidth);
+      }
+      return 1;
+    case 3:
+      if(!precon) return 0;
+      a = vadd_u8(loadPixel(scanline, bytewidth), vshr_n_u8(loadPixel(precon, bytewidth), 1));
+      storePixel(recon, a, bytewidth);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        /*vhadd_u8 is (a + b) >> 1 without overflow*/
+        a = vadd_u8(loadPixel(scanline + i, bytewidth), vhadd_u8(a, loadPixel(precon + i, bytewidth)));
+        storePixel(recon + i, a, bytewidth);
+      }
+      return 1;
+    case 4:
+      if(!precon) return 0;
+      /*paethPredictor(0, b, 0) is always b*/
+      c = loadPixel(precon, bytewidth);
+      a = vadd_u8(loadPixel(scanline, bytewidth), c);
+      storePixel(recon, a, bytewidth);
+      for(i = bytewidth; i < length; i += bytewidth)
+      {
+        uint16x8_t pa, pb, pc, usec, useb;
+        uint8x8_t pred;
+        b = loadPixel(precon + i, bytewidth);
+        /*same comparisons as paethPredictor, in 16-bit lanes*/
+        pa = vabdl_u8(b, c);
+        pb = vabdl_u8(a, c);
+        pc = vreinterpretq_u16_s16(vabdq_s16(vreinterpretq_s16_u16(vaddl_u8(a, b)),
+                                             vreinterpretq_s16_u16(vaddl_u8(c, c))));
+        usec = vandq_u16(vcltq_u16(pc, pa), vcltq_u16(pc, pb));
+        useb = vbicq_u16(vcltq_u16(pb, pa), usec);
+        pred = vbsl_u8(vmovn_u16(usec), c, vbsl_u8(vmovn_u16(useb), b, a));
+        a = vadd_u8(loadPixel(scanline + i, bytewidth), pred);
+        storePixel(recon + i, a, bytewidth);
+        c = b;
+      }
+      return 1;
+    default: return 0;
+  }
+}
 
-  state->error = checkColorValidity(info->color.colortype, info->color.bitdepth);
-  return state->error;
+/*NEON is part of every target this is compiled for*/
+static unsigned unfilterSimdSupported(void)
+{
+  return 1;
 }
 
+#endif
+
+#endif /*LODEPNG_UNFILTER_SIMD*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length)
 {
@@ -3909,6 +5090,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#ifdef LODEPNG_UNFILTER_SIMD
+  if(unfilterSimdSupported() && unfilterScanlineSimd(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif /*LODEPNG_UNFILTER_SIMD*/
   switch(filterType)
   {
     case 0:
@@ -4448,16 +5632,104 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*the IDAT chunks of a PNG, their data is read where it is in the PNG buffer*/
+typedef struct IdatChunks
+{
+  const unsigned char** data;
+  size_t* size;
+  size_t count;
+  size_t allocsize; /*entries allocated in data & size*/
+  size_t total; /*bytes of all the chunks*/
+} IdatChunks;
+
+static void IdatChunks_init(IdatChunks* idat)
+{
+  idat->data = 0;
+  idat->size = 0;
+  idat->count = idat->allocsize = idat->total = 0;
+}
+
+static void IdatChunks_cleanup(IdatChunks* idat)
+{
+  lodepng_free((void*)idat->data);
+  lodepng_free(idat->size);
+  IdatChunks_init(idat);
+}
+
+/*returns 1 if success, 0 if failure ---> nothing done*/
+static unsigned IdatChunks_push_back(IdatChunks* idat, const unsigned char* data, size_t size)
+{
+  if(idat->count == idat->allocsize)
+  {
+    size_t allocsize = idat->allocsize ? idat->allocsize * 2 : 8;
+    void* newdata = lodepng_realloc((void*)idat->data, allocsize * sizeof(const unsigned char*));
+    void* newsize;
+    if(!newdata) return 0;
+    idat->data = (const unsigned char**)newdata;
+    newsize = lodepng_realloc(idat->size, allocsize * sizeof(size_t));
+    if(!newsize) return 0;
+    idat->size = (size_t*)newsize;
+    idat->allocsize = allocsize;
+  }
+  idat->data[idat->count] = data;
+  idat->size[idat->count] = size;
+  ++idat->count;
+  idat->total += size;
+  return 1;
+}
+
+/*whether zlibDecompressIdat inflates with the built in fast inflater, which can stream its output*/
+static unsigned idatStreamable(const LodePNGDecompressSettings* settings)
+{
+#ifdef LODEPNG_COMPILE_ZLIB
+  return settings->fast_inflate && !settings->custom_zlib && !settings->custom_inflate;
+#else /*LODEPNG_COMPILE_ZLIB*/
+  (void)settings;
+  return 0;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+}
+
+/*
+inflate the zlib stream of the IDAT chunks into out: in place with fast_inflate, the custom functions
+and the bit by bit inflater take the chunks concatenated into one buffer
+*/
+static unsigned zlibDecompressIdat(ucvector* out, const IdatChunks* idat, const LodePNGDecompressSettings* settings)
+{
+  unsigned error;
+  ucvector joined;
+  size_t i, pos = 0;
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(idatStreamable(settings))
+  {
+    LodePNGSegments segments;
+    segments.data = idat->data;
+    segments.size = idat->size;
+    segments.count = idat->count;
+    return zlibDecompressSegments(out, &segments, settings);
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  ucvector_init(&joined);
+  if(!ucvector_resize(&joined, idat->total)) return 83; /*alloc fail*/
+  for(i = 0; i != idat->count; ++i)
+  {
+    memcpy(joined.data + pos, idat->data[i], idat->size[i]);
+    pos += idat->size[i];
+  }
+  error = zlib_decompress(&out->data, &out->size, joined.data, joined.size, settings);
+  ucvector_cleanup(&joined);
+  return error;
+}
+
+/*
+read the chunks of a PNG, collecting the IDAT chunks into idat (to be cleaned up by the caller, even on error),
+the PNG buffer must outlive it. Returns the size of the inflated scanlines, filter bytes included
+*/
+static size_t decodeChunks(IdatChunks* idat, unsigned* w, unsigned* h,
+                           LodePNGState* state,
+                           const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  size_t i;
-  ucvector idat; /*the data from idat chunks*/
-  ucvector scanlines;
   size_t predict;
   size_t numpixels;
 
@@ -4467,21 +5739,17 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
-  if(state->error) return;
+  if(state->error) return 0;
 
   numpixels = *w * *h;
 
   /*multiplication overflow*/
-  if(*h != 0 && numpixels / *h != *w) CERROR_RETURN(state->error, 92);
+  if(*h != 0 && numpixels / *h != *w) { state->error = 92; return 0; }
   /*multiplication overflow possible further below. Allows up to 2^31-1 pixel
   bytes with 16-bit RGBA, the rest is room for filter bytes.*/
-  if(numpixels > 268435455) CERROR_RETURN(state->error, 92);
+  if(numpixels > 268435455) { state->error = 92; return 0; }
 
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4509,9 +5777,7 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT"))
     {
-      size_t oldsize = idat.size;
-      if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+      if(!IdatChunks_push_back(idat, data, chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4605,7 +5871,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
 
-  ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
   If the decompressed size does not match the prediction, the image must be corrupt.*/
   if(state->info_png.interlace_method == 0)
@@ -4626,33 +5891,387 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(*w > 1) predict += lodepng_get_raw_size_idat((*w + 0) >> 1, (*h + 1) >> 1, color) + ((*h + 1) >> 1);
     predict += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, color) + ((*h + 0) >> 1);
   }
-  if(!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
+  return predict;
+}
+
+/*inflate the IDAT data given by decodeChunks into scanlines, still filtered (and interlaced, if Adam7)*/
+static void inflateScanlines(ucvector* scanlines, const IdatChunks* idat, size_t predict, LodePNGState* state)
+{
+  if(!state->error && !ucvector_reserve(scanlines, predict)) state->error = 83; /*alloc fail*/
   if(!state->error)
   {
-    state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-                                   idat.size, &state->decoder.zlibsettings);
-    if(!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
+    state->error = zlibDecompressIdat(scanlines, idat, &state->decoder.zlibsettings);
+    if(!state->error && scanlines->size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
+  }
+}
+
+/*unfilter the scanlines of a non-interlaced image in place, handing over every row as soon as it is reconstructed*/
+static unsigned unfilterRows(unsigned char* in, unsigned w, unsigned h, const LodePNGColorMode* color,
+                             lodepng_row_callback callback, void* user)
+{
+  unsigned y;
+  unsigned char* prevline = 0;
+  unsigned bpp = lodepng_get_bpp(color);
+  size_t bytewidth = (bpp + 7) / 8;
+  size_t linebytes = (w * bpp + 7) / 8;
+  if(bpp == 0) return 31; /*error: invalid colortype*/
+
+  for(y = 0; y < h; ++y)
+  {
+    /*same in place layout as unfilter: the reconstructed rows stay packed at the start of the buffer, behind
+    the scanlines still to come, and each row starts at a byte boundary (padding bits are never removed)*/
+    size_t outindex = linebytes * y;
+    size_t inindex = (1 + linebytes) * y;
+    unsigned char filterType = in[inindex];
+
+    CERROR_TRY_RETURN(unfilterScanline(&in[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes));
+
+    prevline = &in[outindex];
+    callback(user, y, prevline, w, color);
+  }
+  return 0;
+}
+
+/*progress of the streamed inflate of unfilterRowsSequential: scanlines are gathered & unfiltered as they come*/
+typedef struct RowStream
+{
+  unsigned char* line; /*the scanline being gathered, filter byte first*/
+  unsigned char* rows; /*the current & previous unfiltered rows*/
+  size_t stride; /*bytes of a scanline with its filter byte*/
+  size_t filled; /*bytes of line gathered so far*/
+  size_t received; /*bytes of the inflated stream so far*/
+  size_t bytewidth, linebytes;
+  unsigned w, h, y;
+  const LodePNGColorMode* color;
+  lodepng_row_callback callback;
+  void* user;
+  unsigned error; /*unfilter error, only reported once the inflate went right, as with unfilterRows*/
+} RowStream;
+
+static unsigned RowStream_push(void* context, const unsigned char* data, size_t size)
+{
+  RowStream* stream = (RowStream*)context;
+  stream->received += size;
+  while(size && stream->y < stream->h && !stream->error)
+  {
+    const unsigned char* scanline = data;
+    unsigned char* recon = stream->rows + (stream->y & 1) * stream->linebytes;
+    const unsigned char* prevline = stream->y ? stream->rows + ((stream->y - 1) & 1) * stream->linebytes : 0;
+    if(stream->filled != 0 || size < stream->stride)
+    {
+      /*the scanline is split between pieces, gather it*/
+      size_t n = stream->stride - stream->filled;
+      if(n > size) n = size;
+      memcpy(stream->line + stream->filled, data, n);
+      stream->filled += n;
+      data += n;
+      size -= n;
+      if(stream->filled != stream->stride) break;
+      scanline = stream->line;
+      stream->filled = 0;
+    }
+    else
+    {
+      /*whole in the piece, unfiltered from there*/
+      data += stream->stride;
+      size -= stream->stride;
+    }
+    stream->error = unfilterScanline(recon, scanline + 1, prevline, stream->bytewidth, scanline[0], stream->linebytes);
+    if(!stream->error) stream->callback(stream->user, stream->y, recon, stream->w, stream->color);
+    ++stream->y;
+  }
+  return 0;
+}
+
+/*
+inflate & unfilter the scanlines of a non-interlaced image, the rows go to the callback in order. With the
+fast inflater the output is streamed: only the deflate window, one scanline & two rows are held, whatever
+the image size. Otherwise the whole image is inflated, then unfiltered in place
+*/
+static unsigned unfilterRowsSequential(const IdatChunks* idat, size_t predict, unsigned w, unsigned h,
+                                       const LodePNGColorMode* color, const LodePNGDecompressSettings* zlibsettings,
+                                       lodepng_row_callback callback, void* user)
+{
+  unsigned error = 0;
+  ucvector scanlines;
+  RowStream stream;
+  LodePNGDecompressSettings settings;
+  unsigned bpp = lodepng_get_bpp(color);
+
+  ucvector_init(&scanlines);
+  if(!idatStreamable(zlibsettings))
+  {
+    if(!ucvector_reserve(&scanlines, predict)) error = 83; /*alloc fail*/
+    if(!error) error = zlibDecompressIdat(&scanlines, idat, zlibsettings);
+    if(!error && scanlines.size != predict) error = 91; /*decompressed size doesn't match prediction*/
+    if(!error) error = unfilterRows(scanlines.data, w, h, color, callback, user);
+    ucvector_cleanup(&scanlines);
+    return error;
+  }
+  if(bpp == 0) return 31; /*error: invalid colortype*/
+
+  stream.linebytes = ((size_t)w * bpp + 7) / 8;
+  stream.bytewidth = (bpp + 7) / 8;
+  stream.stride = stream.linebytes + 1;
+  stream.filled = stream.received = 0;
+  stream.w = w;
+  stream.h = h;
+  stream.y = 0;
+  stream.color = color;
+  stream.callback = callback;
+  stream.user = user;
+  stream.error = 0;
+  stream.line = (unsigned char*)lodepng_malloc(stream.stride);
+  stream.rows = (unsigned char*)lodepng_malloc(stream.linebytes * 2);
+  if(!stream.line || !stream.rows) error = 83; /*alloc fail*/
+
+  settings = *zlibsettings;
+  settings.progress = RowStream_push;
+  settings.progress_context = &stream;
+  settings.stream_output = 1;
+  if(!error) error = zlibDecompressIdat(&scanlines, idat, &settings);
+  if(!error && stream.received != predict) error = 91; /*decompressed size doesn't match prediction*/
+  if(!error) error = stream.error;
+
+  ucvector_cleanup(&scanlines);
+  lodepng_free(stream.line);
+  lodepng_free(stream.rows);
+  return error;
+}
+
+#ifdef LODEPNG_COMPILE_THREADS
+
+/*
+Parallel inflate (LodePNGDecoderSettings.parallel_inflate) of a non-interlaced image: a producer thread
+inflates the IDAT data, its progress callback copies every complete scanline (filter byte included) into
+a bounded ring of slots, blocking while the ring is full. The calling thread takes them out in order,
+unfilters each one against the previous row and hands it to a row callback, so unfiltering & color
+conversion overlap with the inflate. The inflater streams its output (stream_output): it only keeps the
+32 KB deflate window, whose back-references still see the filtered bytes.
+*/
+
+/*size of the ring, at least SCANLINE_RING_MIN scanlines*/
+#define SCANLINE_RING_BYTES (1u << 20)
+#define SCANLINE_RING_MIN 4u
+
+typedef struct ScanlineRing
+{
+  unsigned char* slots;
+  size_t stride; /*bytes of a scanline with its filter byte*/
+  unsigned numslots;
+  unsigned h;
+  unsigned pushed; /*scanlines copied into the ring so far*/
+  size_t filled; /*bytes of the next scanline copied so far*/
+  size_t received; /*bytes of the inflated stream so far*/
+  unsigned count; /*scanlines in the ring, not taken out yet*/
+  unsigned done; /*the producer has finished*/
+  unsigned stop; /*the consumer gave up, the producer must stop*/
+  unsigned error; /*error of the producer*/
+  const IdatChunks* idat;
+  size_t predict;
+  const LodePNGDecompressSettings* zlibsettings;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty, notFull;
+} ScanlineRing;
+
+/*progress callback of the inflater: copy the new output into the slots, counting in the complete scanlines*/
+static unsigned ScanlineRing_push(void* context, const unsigned char* data, size_t size)
+{
+  ScanlineRing* ring = (ScanlineRing*)context;
+  ring->received += size;
+  while(size && ring->pushed < ring->h)
+  {
+    size_t n = ring->stride - ring->filled;
+    if(ring->filled == 0)
+    {
+      unsigned stop;
+      pthread_mutex_lock(&ring->lock);
+      while(ring->count == ring->numslots && !ring->stop) pthread_cond_wait(&ring->notFull, &ring->lock);
+      stop = ring->stop;
+      pthread_mutex_unlock(&ring->lock);
+      if(stop) return 1; /*any error stops the inflate, the consumer has its own*/
+    }
+
+    /*the slot is free, the consumer only reads the ones counted in*/
+    if(n > size) n = size;
+    memcpy(ring->slots + (size_t)(ring->pushed % ring->numslots) * ring->stride + ring->filled, data, n);
+    ring->filled += n;
+    data += n;
+    size -= n;
+    if(ring->filled != ring->stride) break;
+    ring->filled = 0;
+    ++ring->pushed;
+
+    pthread_mutex_lock(&ring->lock);
+    ++ring->count;
+    pthread_cond_signal(&ring->notEmpty);
+    pthread_mutex_unlock(&ring->lock);
+  }
+  return 0;
+}
+
+static void* inflateScanlinesThread(void* arg)
+{
+  ScanlineRing* ring = (ScanlineRing*)arg;
+  LodePNGDecompressSettings settings = *ring->zlibsettings;
+  ucvector scanlines;
+  unsigned error = 0;
+  /*the fast inflater only keeps its window, the others the whole output*/
+  unsigned streamed = idatStreamable(&settings);
+
+  settings.progress = ScanlineRing_push;
+  settings.progress_context = ring;
+  settings.stream_output = 1;
+  ucvector_init(&scanlines);
+  if(!streamed && !ucvector_reserve(&scanlines, ring->predict)) error = 83; /*alloc fail*/
+  if(!error) error = zlibDecompressIdat(&scanlines, ring->idat, &settings);
+  if(!error && (streamed ? ring->received : scanlines.size) != ring->predict)
+  {
+    error = 91; /*decompressed size doesn't match prediction*/
+  }
+  /*custom_zlib & custom_inflate do not report progress, hand everything over at the end*/
+  if(!error && !streamed && scanlines.size > ring->received)
+  {
+    error = ScanlineRing_push(ring, scanlines.data + ring->received, scanlines.size - ring->received);
+  }
+  ucvector_cleanup(&scanlines);
+
+  pthread_mutex_lock(&ring->lock);
+  ring->error = error;
+  ring->done = 1;
+  pthread_cond_signal(&ring->notEmpty);
+  pthread_mutex_unlock(&ring->lock);
+  return 0;
+}
+
+/*inflate & unfilter the scanlines of a non-interlaced image in two threads, the rows go to the callback in order*/
+static unsigned unfilterRowsParallel(const IdatChunks* idat, size_t predict, unsigned w, unsigned h,
+                                     const LodePNGColorMode* color, const LodePNGDecompressSettings* zlibsettings,
+                                     lodepng_row_callback callback, void* user)
+{
+  ScanlineRing ring;
+  pthread_t producer;
+  unsigned y, error = 0, threaded = 1;
+  unsigned bpp = lodepng_get_bpp(color);
+  size_t bytewidth = (bpp + 7) / 8;
+  size_t linebytes = (w * bpp + 7) / 8;
+  unsigned char* rows; /*the current & previous unfiltered rows*/
+  unsigned char* prevline = 0;
+  if(bpp == 0) return 31; /*error: invalid colortype*/
+
+  ring.stride = linebytes + 1;
+  ring.numslots = (unsigned)(SCANLINE_RING_BYTES / ring.stride);
+  if(ring.numslots < SCANLINE_RING_MIN) ring.numslots = SCANLINE_RING_MIN;
+  if(ring.numslots > h) ring.numslots = h ? h : 1;
+  ring.h = h;
+  ring.pushed = ring.count = ring.done = ring.stop = ring.error = 0;
+  ring.filled = ring.received = 0;
+  ring.idat = idat;
+  ring.predict = predict;
+  ring.zlibsettings = zlibsettings;
+  ring.slots = (unsigned char*)lodepng_malloc((size_t)ring.numslots * ring.stride);
+  rows = (unsigned char*)lodepng_malloc(linebytes * 2);
+  if(!ring.slots || !rows)
+  {
+    lodepng_free(ring.slots);
+    lodepng_free(rows);
+    return 83; /*alloc fail*/
+  }
+  pthread_mutex_init(&ring.lock, 0);
+  pthread_cond_init(&ring.notEmpty, 0);
+  pthread_cond_init(&ring.notFull, 0);
+  if(pthread_create(&producer, 0, inflateScanlinesThread, &ring) != 0)
+  {
+    /*no second thread: inflate & unfilter here*/
+    error = unfilterRowsSequential(idat, predict, w, h, color, zlibsettings, callback, user);
+    threaded = 0;
+  }
+
+  for(y = 0; threaded && y < h && !error; ++y)
+  {
+    const unsigned char* slot;
+    unsigned char* recon = rows + (y & 1) * linebytes;
+
+    pthread_mutex_lock(&ring.lock);
+    while(ring.count == 0 && !ring.done) pthread_cond_wait(&ring.notEmpty, &ring.lock);
+    if(ring.count == 0) error = ring.error ? ring.error : 91; /*the producer stopped early*/
+    pthread_mutex_unlock(&ring.lock);
+    if(error) break;
+
+    slot = ring.slots + (size_t)(y % ring.numslots) * ring.stride;
+    error = unfilterScanline(recon, slot + 1, prevline, bytewidth, slot[0], linebytes);
+    if(error) break;
+    prevline = recon;
+    callback(user, y, recon, w, color);
+
+    pthread_mutex_lock(&ring.lock);
+    --ring.count;
+    pthread_cond_signal(&ring.notFull);
+    pthread_mutex_unlock(&ring.lock);
+  }
+
+  if(threaded)
+  {
+    pthread_mutex_lock(&ring.lock);
+    ring.stop = 1;
+    pthread_cond_signal(&ring.notFull);
+    pthread_mutex_unlock(&ring.lock);
+    pthread_join(producer, 0);
+    /*a corrupt stream may still be reported after the last row (e.g. Adler-32)*/
+    if(!error) error = ring.error;
   }
-  ucvector_cleanup(&idat);
+
+  pthread_mutex_destroy(&ring.lock);
+  pthread_cond_destroy(&ring.notEmpty);
+  pthread_cond_destroy(&ring.notFull);
+  lodepng_free(ring.slots);
+  lodepng_free(rows);
+  return error;
+}
+
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*second half of decodeGeneric, from the IDAT data of decodeChunks*/
+static void decodeGenericIdat(unsigned char** out, unsigned w, unsigned h, LodePNGState* state,
+                              const IdatChunks* idat, size_t predict)
+{
+  size_t i;
+  ucvector scanlines;
+
+  ucvector_init(&scanlines);
+  inflateScanlines(&scanlines, idat, predict, state);
 
   if(!state->error)
   {
-    size_t outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
+    size_t outsize = lodepng_get_raw_size(w, h, &state->info_png.color);
     *out = (unsigned char*)lodepng_malloc(outsize);
     if(!*out) state->error = 83; /*alloc fail*/
     for(i = 0; i < outsize; i++) (*out)[i] = 0;
-    if(!state->error) state->error = postProcessScanlines(*out, scanlines.data, *w, *h, &state->info_png);
+    if(!state->error) state->error = postProcessScanlines(*out, scanlines.data, w, h, &state->info_png);
   }
   ucvector_cleanup(&scanlines);
 }
 
-unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
-                        LodePNGState* state,
-                        const unsigned char* in, size_t insize)
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
 {
+  IdatChunks idat; /*the idat chunks*/
+  size_t predict;
+
+  /*provide some proper output values if error will happen*/
   *out = 0;
-  decodeGeneric(out, w, h, state, in, insize);
-  if(state->error) return state->error;
+
+  IdatChunks_init(&idat);
+  predict = decodeChunks(&idat, w, h, state, in, insize);
+  if(!state->error) decodeGenericIdat(out, *w, *h, state, &idat, predict);
+  IdatChunks_cleanup(&idat);
+}
+
+/*convert the image of decodeGeneric to info_raw, as asked by the decoder settings*/
+static unsigned convertDecoded(unsigned char** out, unsigned w, unsigned h, LodePNGState* state)
+{
   if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
   {
     /*same color type, no copying or converting of data needed*/
@@ -4678,19 +6297,169 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
       return 56; /*unsupported color mode conversion*/
     }
 
-    outsize = lodepng_get_raw_size(*w, *h, &state->info_raw);
+    outsize = lodepng_get_raw_size(w, h, &state->info_raw);
     *out = (unsigned char*)lodepng_malloc(outsize);
     if(!(*out))
     {
       state->error = 83; /*alloc fail*/
     }
     else state->error = lodepng_convert(*out, data, &state->info_raw,
-                                        &state->info_png.color, *w, *h);
+                                        &state->info_png.color, w, h);
     lodepng_free(data);
   }
   return state->error;
 }
 
+#ifdef LODEPNG_COMPILE_THREADS
+
+/*output of decodeParallel, filled row by row*/
+typedef struct DecodedRows
+{
+  unsigned char* out;
+  size_t linebytes; /*bytes of an output row*/
+  const LodePNGColorMode* mode_out; /*null: the rows are copied as they are*/
+  unsigned error;
+} DecodedRows;
+
+static void storeDecodedRow(void* user, unsigned y, const unsigned char* row, unsigned w, const LodePNGColorMode* color)
+{
+  DecodedRows* rows = (DecodedRows*)user;
+  unsigned char* dest = rows->out + (size_t)y * rows->linebytes;
+  if(rows->error) return;
+  if(rows->mode_out) rows->error = lodepng_convert(dest, row, rows->mode_out, color, w, 1);
+  else memcpy(dest, row, rows->linebytes);
+}
+
+/*
+lodepng_decode with parallel_inflate: non-interlaced images whose output rows start at a byte are
+unfiltered & converted row by row while the inflate runs, the others take the sequential path
+*/
+static unsigned decodeParallel(unsigned char** out, unsigned* w, unsigned* h,
+                               LodePNGState* state,
+                               const unsigned char* in, size_t insize)
+{
+  IdatChunks idat; /*the idat chunks*/
+  size_t predict;
+  unsigned convert;
+  const LodePNGColorMode* mode_out;
+
+  IdatChunks_init(&idat);
+  predict = decodeChunks(&idat, w, h, state, in, insize);
+  convert = state->decoder.color_convert && !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color);
+  mode_out = convert ? &state->info_raw : &state->info_png.color;
+  if(!state->error && state->info_png.interlace_method == 0
+     && ((size_t)(*w) * lodepng_get_bpp(mode_out)) % 8 == 0)
+  {
+    DecodedRows rows;
+    /*same check as convertDecoded*/
+    if(convert && !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+       && !(state->info_raw.bitdepth == 8))
+    {
+      IdatChunks_cleanup(&idat);
+      return 56; /*unsupported color mode conversion*/
+    }
+    rows.linebytes = (size_t)(*w) * lodepng_get_bpp(mode_out) / 8;
+    rows.mode_out = convert ? mode_out : 0;
+    rows.error = 0;
+    rows.out = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(*w, *h, mode_out));
+    if(!rows.out) state->error = 83; /*alloc fail*/
+    if(!state->error)
+    {
+      state->error = unfilterRowsParallel(&idat, predict, *w, *h, &state->info_png.color,
+                                          &state->decoder.zlibsettings, storeDecodedRow, &rows);
+    }
+    if(!state->error) state->error = rows.error;
+    if(!state->error && !state->decoder.color_convert)
+    {
+      state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+    }
+    if(!state->error) *out = rows.out;
+    else lodepng_free(rows.out);
+  }
+  else if(!state->error)
+  {
+    decodeGenericIdat(out, *w, *h, state, &idat, predict);
+    if(!state->error) convertDecoded(out, *w, *h, state);
+  }
+  IdatChunks_cleanup(&idat);
+  return state->error;
+}
+
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
+                        LodePNGState* state,
+                        const unsigned char* in, size_t insize)
+{
+  *out = 0;
+#ifdef LODEPNG_COMPILE_THREADS
+  if(state->decoder.parallel_inflate) return decodeParallel(out, w, h, state, in, insize);
+#endif /*LODEPNG_COMPILE_THREADS*/
+  decodeGeneric(out, w, h, state, in, insize);
+  if(state->error) return state->error;
+  return convertDecoded(out, *w, *h, state);
+}
+
+unsigned lodepng_decode_rows(LodePNGState* state, const unsigned char* in, size_t insize,
+                             lodepng_row_callback callback, void* user, unsigned* w, unsigned* h)
+{
+  IdatChunks idat; /*the idat chunks*/
+  ucvector scanlines;
+  size_t predict;
+  IdatChunks_init(&idat);
+  ucvector_init(&scanlines);
+  predict = decodeChunks(&idat, w, h, state, in, insize);
+
+#ifdef LODEPNG_COMPILE_THREADS
+  if(!state->error && state->info_png.interlace_method == 0 && state->decoder.parallel_inflate)
+  {
+    state->error = unfilterRowsParallel(&idat, predict, *w, *h, &state->info_png.color,
+                                        &state->decoder.zlibsettings, callback, user);
+    IdatChunks_cleanup(&idat);
+    return state->error;
+  }
+#endif /*LODEPNG_COMPILE_THREADS*/
+  if(!state->error && state->info_png.interlace_method == 0)
+  {
+    state->error = unfilterRowsSequential(&idat, predict, *w, *h, &state->info_png.color,
+                                          &state->decoder.zlibsettings, callback, user);
+    IdatChunks_cleanup(&idat);
+    return state->error;
+  }
+  inflateScanlines(&scanlines, &idat, predict, state);
+  IdatChunks_cleanup(&idat);
+
+  if(!state->error)
+  {
+    /*Adam7: rows are only complete after the 7 passes, deinterlace the whole image and hand over RGBA8 rows*/
+    unsigned char* image = 0;
+    unsigned char* rgba = 0;
+    LodePNGColorMode mode_rgba;
+    unsigned y;
+    size_t i, outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
+
+    lodepng_color_mode_init(&mode_rgba);
+    image = (unsigned char*)lodepng_malloc(outsize);
+    rgba = (unsigned char*)lodepng_malloc((size_t)(*w) * (*h) * 4);
+    if(!image || !rgba) state->error = 83; /*alloc fail*/
+    if(!state->error)
+    {
+      for(i = 0; i < outsize; i++) image[i] = 0;
+      state->error = postProcessScanlines(image, scanlines.data, *w, *h, &state->info_png);
+    }
+    if(!state->error) state->error = lodepng_convert(rgba, image, &mode_rgba, &state->info_png.color, *w, *h);
+    if(!state->error)
+    {
+      for(y = 0; y < *h; ++y) callback(user, y, &rgba[(size_t)y * (*w) * 4], *w, &mode_rgba);
+    }
+    lodepng_free(image);
+    lodepng_free(rgba);
+    lodepng_color_mode_cleanup(&mode_rgba);
+  }
+  ucvector_cleanup(&scanlines);
+  return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -4718,12 +6487,12 @@ unsigned lodepng_decode24(unsigned char** out, unsigned* w, unsigned* h, const u
 unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename,
                              LodePNGColorType colortype, unsigned bitdepth)
 {
-  unsigned char* buffer;
+  const unsigned char* buffer;
   size_t buffersize;
   unsigned error;
-  error = lodepng_load_file(&buffer, &buffersize, filename);
+  error = lodepng_map_file(&buffer, &buffersize, filename);
   if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
-  lodepng_free(buffer);
+  lodepng_unmap_file(buffer, buffersize);
   return error;
 }
 
@@ -4741,6 +6510,7 @@ unsigned lodepng_decode24_file(unsigned char** out, unsigned* w, unsigned* h, co
 void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings)
 {
   settings->color_convert = 1;
+  settings->parallel_inflate = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->read_text_chunks = 1;
   settings->remember_unknown_chunks = 0;
@@ -5169,14 +6939,15 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
   if(bpp == 0) return 31; /*error: invalid color type*/
 
-  if(strategy == LFS_ZERO)
+  if(strategy >= LFS_ZERO && strategy <= LFS_FOUR)
   {
+    unsigned char type = (unsigned char)strategy;
     for(y = 0; y != h; ++y)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
-      out[outindex] = 0; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, 0);
+      out[outindex] = type; /*filter type byte*/
+      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
       prevline = &in[inindex];
     }
   }
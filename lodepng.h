@@ -74,6 +74,15 @@ source files with custom allocators.*/
 #ifndef LODEPNG_NO_COMPILE_ALLOCATORS
 #define LODEPNG_COMPILE_ALLOCATORS
 #endif
+/*vectorized scanline unfiltering (SSE2 on x86, NEON on ARM, picked at run time on 32-bit x86), same result
+as the byte loops which stay for the other targets & pixel sizes*/
+#ifndef LODEPNG_NO_COMPILE_SIMD
+#define LODEPNG_COMPILE_SIMD
+#endif
+/*second thread for LodePNGDecoderSettings.parallel_inflate, needs POSIX threads (link with -lpthread)*/
+#ifndef LODEPNG_NO_COMPILE_THREADS
+#define LODEPNG_COMPILE_THREADS
+#endif
 /*compile the C++ version (you can disable the C++ wrapper here even when compiling for C++)*/
 #ifdef __cplusplus
 #ifndef LODEPNG_NO_COMPILE_CPP
@@ -256,6 +265,13 @@ typedef struct LodePNGDecompressSettings LodePNGDecompressSettings;
 struct LodePNGDecompressSettings
 {
   unsigned ignore_adler32; /*if 1, continue and don't give an error message if the Adler32 checksum is corrupted*/
+  /*if 1, Huffman blocks are inflated with lookup tables and a word-sized bit buffer instead of the
+  bit-by-bit tree walk: same output, several times faster. The PNG decoder then also inflates the IDAT
+  chunks where they are in the PNG buffer, instead of concatenating them first. A corrupt stream fails
+  with both, but not always with the same error code: the table lookups decode a whole symbol (and its
+  extra bits) before checking the end of the input, so e.g. a truncated stream may give 10 where the tree
+  walk gives 11, or 51 instead of 18 (default: 0)*/
+  unsigned fast_inflate;
 
   /*use custom zlib decoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -269,6 +285,19 @@ struct LodePNGDecompressSettings
                              const LodePNGDecompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
+
+  /*if not null, the built in inflater calls it after every deflate block with the output of the block: the
+  next size bytes of the stream, at data (only valid during the call). A non-zero return value stops the
+  inflate with that error. Used by lodepng_decode_rows and LodePNGDecoderSettings.parallel_inflate
+  (default: null)*/
+  unsigned (*progress)(void* context, const unsigned char* data, size_t size);
+  void* progress_context; /*passed to progress*/
+  /*if 1, with fast_inflate & progress and no custom_inflate, the output is not kept: the inflater only holds
+  the 32 KB deflate window plus the piece it gives progress (about 256 KB at a time, large blocks are
+  handed over in several pieces), so its memory no longer grows with the output. The out buffer of
+  lodepng_inflate & lodepng_zlib_decompress then holds no useful data, the Adler-32 is still checked
+  (default: 0)*/
+  unsigned stream_output;
 };
 
 extern const LodePNGDecompressSettings lodepng_default_decompress_settings;
@@ -276,6 +305,19 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
+/*How the built in deflate looks for LZ77 matches*/
+typedef enum LodePNGMatchStrategy
+{
+  /*hash chains of up to windowsize candidates, with minmatch, nicematch and lazymatching*/
+  LMS_HASH_CHAIN,
+  /*greedy: one candidate per position, the last one with the same 4-byte hash, taken as soon as
+  it is found. Much faster than the hash chains, compresses less*/
+  LMS_GREEDY,
+  /*run-length only: matches at distance 1 (repeats of the previous byte), no hash table. The
+  fastest, good on flat areas, e.g. with the Sub filter (LFS_ONE)*/
+  LMS_RLE
+} LodePNGMatchStrategy;
+
 /*
 Settings for zlib compression. Tweaking these settings tweaks the balance
 between speed and compression ratio.
@@ -290,6 +332,8 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*LMS_GREEDY and LMS_RLE ignore nicematch & lazymatching. Default: LMS_HASH_CHAIN*/
+  LodePNGMatchStrategy match_strategy;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -524,6 +568,14 @@ typedef struct LodePNGDecoderSettings
 
   unsigned color_convert; /*whether to convert the PNG to the color type you want. Default: yes*/
 
+  /*if 1, a second thread inflates the IDAT data while the calling thread unfilters (and color converts) the
+  scanlines it hands over through a bounded ring, for lodepng_decode & lodepng_decode_rows of non-interlaced
+  images. Needs LODEPNG_COMPILE_THREADS, ignored otherwise. Same images; with a corrupt stream rows may reach
+  the lodepng_decode_rows callback before the error, which is the first one found: the scanlines are
+  unfiltered before the Adler-32 at the end of the stream is checked, so a corrupt byte may give 36 (bad
+  filter type) where the sequential decode gives 58 (bad Adler-32). Default: 0*/
+  unsigned parallel_inflate;
+
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   unsigned read_text_chunks; /*if false but remember_unknown_chunks is true, they're stored in the unknown chunks*/
   /*store all bytes from unknown chunks in the LodePNGInfo (off by default, useful for a png editor)*/
@@ -539,7 +591,12 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings);
 typedef enum LodePNGFilterStrategy
 {
   /*every filter at zero*/
-  LFS_ZERO,
+  LFS_ZERO = 0,
+  /*every filter at 1, 2, 3 or 4 (Sub, Up, Average, Paeth): one fixed filter, nothing to choose*/
+  LFS_ONE = 1,
+  LFS_TWO = 2,
+  LFS_THREE = 3,
+  LFS_FOUR = 4,
   /*Use filter that gives minimum sum, as described in the official PNG filter heuristic.*/
   LFS_MINSUM,
   /*Use the filter type that gives smallest Shannon entropy for this scanline. Depending
@@ -651,6 +708,26 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+Called by lodepng_decode_rows for every row of the image, top to bottom, as soon as it
+is reconstructed. row holds w pixels in the given color mode, starting at a byte
+boundary; it is only valid during the call.
+*/
+typedef void (*lodepng_row_callback)(void* user, unsigned y, const unsigned char* row,
+                                     unsigned w, const LodePNGColorMode* color);
+
+/*
+Same as lodepng_decode, but the image is never stored: the rows are unfiltered one by one
+and handed over to callback, in the color type of the PNG (state->info_raw and
+color_convert are ignored). With fast_inflate (and no custom zlib/inflate functions) the
+IDAT stream is inflated piece by piece (stream_output), only the 32 KB deflate window, a
+piece and two scanlines are held, so rows may reach callback before an error is found
+further in the stream. Otherwise the rows are unfiltered in place in the inflated data.
+Adam7 interlaced images are deinterlaced first and handed over as 8-bit RGBA rows.
+*/
+unsigned lodepng_decode_rows(LodePNGState* state, const unsigned char* in, size_t insize,
+                             lodepng_row_callback callback, void* user, unsigned* w, unsigned* h);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the header chunk of the PNG, such as width, height and color type. The
@@ -801,6 +878,20 @@ return value: error code (0 means ok)
 */
 unsigned lodepng_load_file(unsigned char** out, size_t* outsize, const char* filename);
 
+/*
+Map a file read-only into memory, without copying it (mmap on POSIX systems, lodepng_load_file
+elsewhere). The buffer must be released with lodepng_unmap_file, not freed. An empty file gives
+a null buffer of size 0.
+out: output parameter, contains pointer to the mapped buffer.
+outsize: output parameter, size of the buffer
+filename: the path to the file to map
+return value: error code (0 means ok)
+*/
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename);
+
+/*Release the buffer of lodepng_map_file, buffersize is the size it gave. Does nothing on a null buffer.*/
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize);
+
 /*
 Save a file from buffer to disk. Warning, if it exists, this function overwrites
 the file without warning!
@@ -6,13 +6,21 @@
  *       + Decode two 32-bit RGBA images                                (running on host-code)
  *       + Resize these images by 1/16 (from 2940x2016 to 735x504)
  *       + Transform these images to greyscale images
+ *         (--decode=grey, default: the three steps above fused into the
+ *          PNG decode, only the 735x504 grey images are ever in memory)
  *       + Implement ZNCC on these image with changeable window size, output of
  *         ZNCC is disparity map.
+ *         (--cost=census: census transform + Hamming distance instead)
+ *         (--sgm=<paths>: semi-global matching over the ZNCC cost volume)
  *       + Cross check two output disparity maps
  *       + Occlusion filling one output disparity map from cross check  (running on host-code)
  *       + Normalize the disparity map to 0..255                        (running on host-code)
  *         (case after downscaled, MAXDISP is 64)
  *       + Output the result image to "depthmap.png"                    (running on host-code)
+ *         (--encode=fast|rle: fixed filter & Huffman codes, one-probe or run-length matches)
+ *       + Optionally, the subpixel disparities to a PFM / 16-bit PNG   (--subpixel=<file>)
+ *       + Very large pairs: ZNCC & cross check in strips that fit a memory
+ *         budget (--memory-budget=<MB>), stitched before occlusion filling
  *
  *
  * NOTES :
@@ -41,19 +49,18 @@
 #include <limits.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include "lodepng.h"
+#include "zncc_cpu.h"
+#include "zncc_engine.h"
+#include "zncc_batch.h"
+#include "zncc_decode.h"
+#include "zncc_output.h"
 
-#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 
-#ifdef __APPLE__
-#include <OpenCL/opencl.h>
-#else
-#include <CL/cl.h>
-#endif
-
-
-const int DOWNSCALE         = 4;    // downscale 4x4 = 16 times
+float DOWNSCALE             = 4;    // downscale 4x4 = 16 times, any factor >= 1 with --downscale=<f>
 const uint32_t HALFWINSIZEX = 8;    // Window size on X-axis (width)
 const uint32_t HALFWINSIZEY = 15;   // Window size on Y-axis (height)
 const int THRESHOLD         = 2;    // Threshold for cross-checkings
@@ -61,64 +68,94 @@ const uint32_t WINSIZEAREA  = 527;  // (HALFWINSIZEX x 2 + 1) x (HALFWINSIZEX x
 
 int MAXDISP                 = 64;   // n-disp value 260 (downscaled), 64 give caculating efficient instead of 65
 int MINDISP                 = 0;
-
-typedef struct cl_image_desc {
-	cl_mem_object_type image_type;
-	size_t image_width;
-	size_t image_height;
-	size_t image_depth;
-	size_t image_array_size;
-	size_t image_row_pitch;
-	size_t image_slice_pitch;
-	cl_uint num_mip_levels;
-	cl_uint num_samples;
-	cl_mem buffer;
-} cl_image_desc;
-
-cl_image_desc imgDescriptor;        // Image descriptor contains type and dimensions of the image
-cl_image_format format = { CL_RGBA, CL_UNSIGNED_INT8 };
-
-
-char *read_kernel_file(const char *filename);
-cl_kernel build_kernel_from_file(cl_context ctx, char const *kernel, char const *kernel_name);
-void normalization(uint8_t* dispMap, uint32_t w, uint32_t h);
-uint8_t* occlusion_filling(const uint8_t* dispMap, uint32_t w, uint32_t h);
-
-
-int32_t main()
+const float DISP_DOWNSCALE  = 4;    // MINDISP & MAXDISP are given at this downscale, scaled for other ones
+
+uint32_t PYRAMID_LEVELS     = 1;    // coarse-to-fine levels, 1 = exhaustive search, selected with --pyramid=<levels>
+const int PYRAMID_BAND      = 2;    // +- disparities searched around the upsampled parent disparity
+
+int SGM_PATHS               = 0;    // semi-global matching paths (4 or 8), 0 = winner-takes-all, selected with --sgm=<paths>
+const int SGM_P1            = 8;    // SGM penalty of a +-1 disparity step, in 8-bit cost units ((1 - ZNCC)*127)
+const int SGM_P2            = 64;   // SGM penalty of a larger step
+
+zncc_mode_t ZNCC_MODE       = ZNCC_MODE_NAIVE;  // selected with --zncc=<mode>
+matching_cost_t COST        = COST_ZNCC;        // selected with --cost=zncc|census
+backend_t BACKEND           = BACKEND_AUTO;     // selected with --backend=<backend>
+occlusion_fill_t OCCLUSION_FILL = OCCLUSION_FILL_TRANSFORM;  // selected with --fill=<engine>
+postprocess_t POSTPROCESS   = POSTPROCESS_DEVICE; // selected with --postprocess=device|host
+resize_filter_t RESIZE_FILTER = RESIZE_POINT;   // selected with --resize=point|area|bilinear
+const char *KERNEL_CACHE    = "kernel_cache";   // program binary cache directory, --kernel-cache=<dir>|off
+const char *PROFILE_REPORT  = NULL;             // per-stage timing report (.json or .csv), --profile=<file>
+const char *SUBPIXEL_OUTPUT = NULL;             // refined disparities (.pfm, 16-bit .png otherwise), --subpixel=<file>
+const char *BATCH_INPUT     = NULL;             // manifest or directory of pairs, --batch=<manifest|dir>
+uint32_t BATCH_DECODERS     = 2;                // decoder threads of the batch mode, --decoders=<n>
+float MEMORY_BUDGET         = 0;                // MB of correlation buffers, strip by strip beyond, --memory-budget=<MB>
+int32_t DECODE_GREY         = 1;                // fused decode-to-grey (1) or full RGBA decode (0), --decode=grey|rgba
+                                                // (point sampling only, area & bilinear always decode RGBA)
+encode_profile_t ENCODE_PROFILE = ENCODE_DEFAULT; // depth map PNG encoder, --encode=default|fast|rle
+
+
+void parse_arguments(int argc, char **argv);
+void setup_params(zncc_params_t *params, zncc_profile_t *profile);
+int32_t run_batch(zncc_profile_t *profile);
+uint32_t decode_image(uint8_t **image, uint32_t *w, uint32_t *h, const char *filename);
+
+typedef struct {
+    const char *filename;
+    uint8_t *image;
+    uint32_t w, h;
+    uint32_t err;                       // lodepng error code, 0 is OK
+    uint64_t start;                     // zncc_profile_now() when the decode started
+} decode_job_t;
+
+void *decode_job(void *arg);
+
+
+int32_t main(int argc, char **argv)
 {
-    uint8_t *OrigImageL, *OrigImageR; // Left & Right image 2940x2016
-    uint8_t *dDisparity, *Disparity;
+    uint8_t *OrigImageL, *OrigImageR; // Left & Right image 2940x2016 (RGBA), or 735x504 (grey)
+    uint8_t *Disparity;
 
     uint32_t err;                       // Error code, 0 is OK
     uint32_t Width, Height;             // resize
     uint32_t wL, hL, wR, hR;            // original size of Left & Right image
 
     struct timespec totalStartTime, totalEndTime;
-
-    cl_context ctx;
-    cl_command_queue queue;
-    cl_int status;
-
-    const size_t localWorkSize[]    = {16, 16};       // Local work size
-	  //const size_t localWorkSize[]    = {2, 2};       // Local work size (Odroid)
-		const size_t globalWorkSize[]   = {504, 736};   // Global work size
-
-    const size_t localWorkSize1D[]  = {localWorkSize[0]*localWorkSize[1]};      // 1-dimentional local work size
-    const size_t globalWorkSize1D[] = {globalWorkSize[0]*globalWorkSize[1]};    // 1-dimentional global work size
-
-
-    // ******** Load the left image into memory & check loading error ********
-    err = lodepng_decode32_file(&OrigImageL, &wL, &hL, "im0.png");
-    if(err) {
-        printf("Error when loading the left image %u: %s\n", err, lodepng_error_text(err));
+    zncc_engine_t *engine;
+    zncc_params_t params;
+    zncc_profile_t *profile = NULL;     // per-stage timings, only with --profile
+    uint64_t stageStart;
+    decode_job_t jobL, jobR;            // the right image is decoded in decoderR meanwhile the left one
+    pthread_t decoderR;
+
+    parse_arguments(argc, argv);
+    if (PROFILE_REPORT)
+        profile = zncc_profile_create();
+    if (BATCH_INPUT)
+        return run_batch(profile);
+
+    // ******** Load the left & right images into memory concurrently & check loading errors ********
+    jobL.filename = "im0.png";
+    jobR.filename = "im1.png";
+    if (pthread_create(&decoderR, NULL, decode_job, &jobR)) {
+        fprintf(stderr, "Fail to start the decoder thread of the right image !\n");
+        abort();
+    }
+    decode_job(&jobL);
+    zncc_profile_host(profile, "decode L", jobL.start);
+    pthread_join(decoderR, NULL);
+    zncc_profile_host(profile, "decode R", jobR.start);
+    OrigImageL = jobL.image;
+    OrigImageR = jobR.image;
+    wL = jobL.w; hL = jobL.h;
+    wR = jobR.w; hR = jobR.h;
+    if(jobL.err) {
+        printf("Error when loading the left image %u: %s\n", jobL.err, lodepng_error_text(jobL.err));
         free(OrigImageL);
+        free(OrigImageR);
         return -1;
     }
-    // Load the right image into memory & check loading error
-    err = lodepng_decode32_file(&OrigImageR, &wR, &hR, "im1.png");
-    if(err) {
-        printf("Error when loading the right image %u: %s\n", err, lodepng_error_text(err));
+    if(jobR.err) {
+        printf("Error when loading the right image %u: %s\n", jobR.err, lodepng_error_text(jobR.err));
         free(OrigImageL);
         free(OrigImageR);
         return -1;
@@ -130,241 +167,51 @@ int32_t main()
         free(OrigImageR);
         return -1;
     }
-    Width       = wL/DOWNSCALE;
-    Height      = hL/DOWNSCALE;
 
     clock_gettime(CLOCK_MONOTONIC, &totalStartTime); // Starting time
-    printf("Running openCL implement of ZNCC on images. Please wait, this will take several minutes...\n");
-
-
-    // ******** Setup OpenCL environment to run the kernel ********
-    cl_platform_id platform = 0;
-    cl_device_id device = 0;
-    cl_context_properties props[3] = { CL_CONTEXT_PLATFORM, 0, 0 };
-
-    status = clGetPlatformIDs( 1, &platform, NULL );
-	printf("clGetPlatformIDs status == CL_SUCCESS - %d\n", status == CL_SUCCESS);
-    int gpu = 1; // O : CPU, 1 : GPU
-    status = clGetDeviceIDs(platform, gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-
-    props[1] = (cl_context_properties)platform;
-    // context
-    ctx = clCreateContext( props, 1, &device, NULL, NULL, &status );
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create context for OpenCL !\n");
-        abort();
-    }
-    // queue
-    queue = clCreateCommandQueue( ctx, device, 0, &status );
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create queue for OpenCL context !\n");
-        abort();
-    }
-
-
-    // ******** Create buffers memory objects ********
-    cl_mem clmemImageL = clCreateBuffer(ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create buffer for the left image !\n");
-        abort();
-    }
-
-    cl_mem clmemImageR = clCreateBuffer(ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create buffer for the right image !\n");
-        abort();
-    }
-
-    cl_mem clmemDispMap1 = clCreateBuffer(ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create buffer for the Disparity map L vs R !\n");
-        abort();
-    }
-
-    cl_mem clmemDispMap2 = clCreateBuffer(ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create buffer for the Disparity map R vs L !\n");
-        abort();
-    }
-
-    cl_mem clmemDispMapCrossCheck = clCreateBuffer(ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create buffer for the Disparity cross checking map !\n");
-        abort();
-    }
-
-    // ******** Read kernel file ********
-    char *resize_kernel_file       = read_kernel_file("resize.cl");
-    char *zncc_kernel_file         = read_kernel_file("zncc.cl");
-    char *cross_check_kernel_file  = read_kernel_file("cross_check.cl");
-
-    // ******* Init cl kernel from files *******
-    imgDescriptor.image_type = CL_MEM_OBJECT_IMAGE2D;
-    imgDescriptor.image_width = wL;
-    imgDescriptor.image_height = hL;
-    imgDescriptor.image_depth = 8;
-    imgDescriptor.image_row_pitch = wL * DOWNSCALE;
-
-    dDisparity = (uint8_t*) malloc(Width*Height);
-    Disparity  = (uint8_t*) malloc(Width*Height);
-
-
-    cl_kernel resize_kernel     = build_kernel_from_file(ctx, resize_kernel_file, "resize");
-    cl_kernel zncc_kernel       = build_kernel_from_file(ctx, zncc_kernel_file, "zncc");
-    cl_kernel cross_check_kernel= build_kernel_from_file(ctx, cross_check_kernel_file, "cross_check");
-
-    // ******** Create images memory objects ********
-    cl_mem clmemOrigImageL = clCreateImage2D(ctx, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, &format, imgDescriptor.image_width, imgDescriptor.image_height, imgDescriptor.image_row_pitch, OrigImageL, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create Image for the left image !\n");
-        abort();
-    }
-
-    cl_mem clmemOrigImageR = clCreateImage2D(ctx, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, &format, imgDescriptor.image_width, imgDescriptor.image_height, imgDescriptor.image_row_pitch, OrigImageR, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create Image for the right image !\n");
-        abort();
-    }
-
-    // ******** Call the kernels ********
-    // Resize and grayscale kernel
-    status = 0;
-    status  = clSetKernelArg(resize_kernel, 0, sizeof(clmemOrigImageL), &clmemOrigImageL);
-    status |= clSetKernelArg(resize_kernel, 1, sizeof(clmemOrigImageR), &clmemOrigImageR);
-    status |= clSetKernelArg(resize_kernel, 2, sizeof(clmemImageL), &clmemImageL);
-    status |= clSetKernelArg(resize_kernel, 3, sizeof(clmemImageR), &clmemImageR);
-    status |= clSetKernelArg(resize_kernel, 4, sizeof(Width), &Width);
-    status |= clSetKernelArg(resize_kernel, 5, sizeof(Height), &Height);
-
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to set kernel arguments for 'resize_kernel' !\n");
-        abort();
-    }
-
-    status = clEnqueueNDRangeKernel(queue, resize_kernel, 2, NULL, (const size_t*)&globalWorkSize, (const size_t*)&localWorkSize, 0, NULL, NULL);
-
-
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to execute 'resize_kernel' on the device !\n");
-        abort();
-    }
-
-    clFinish(queue);
-    status = clEnqueueReadBuffer(queue, clmemImageL, CL_TRUE,  0, Width*Height, Disparity, 0, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "'resize_kernel': Failed to send the data to host !\n");
-        abort();
-    }
-    status = clEnqueueReadBuffer(queue, clmemImageR, CL_TRUE,  0, Width*Height, Disparity, 0, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "'resize_kernel': Failed to send the data to host !\n");
-        abort();
-    }
 
-    // Disparity (L vs R) ZNCC kernel
-    status = 0;
-    status  = clSetKernelArg(zncc_kernel, 0, sizeof(clmemImageL), &clmemImageL);
-    status |= clSetKernelArg(zncc_kernel, 1, sizeof(clmemImageR), &clmemImageR);
-    status |= clSetKernelArg(zncc_kernel, 2, sizeof(clmemDispMap1), &clmemDispMap1);
-    status |= clSetKernelArg(zncc_kernel, 3, sizeof(Width), &Width);
-    status |= clSetKernelArg(zncc_kernel, 4, sizeof(Height), &Height);
-    status |= clSetKernelArg(zncc_kernel, 5, sizeof(HALFWINSIZEX), &HALFWINSIZEX);
-    status |= clSetKernelArg(zncc_kernel, 6, sizeof(HALFWINSIZEY), &HALFWINSIZEY);
-    status |= clSetKernelArg(zncc_kernel, 7, sizeof(WINSIZEAREA), &WINSIZEAREA);
-    status |= clSetKernelArg(zncc_kernel, 8, sizeof(MINDISP), &MINDISP);
-    status |= clSetKernelArg(zncc_kernel, 9, sizeof(MAXDISP), &MAXDISP);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to set kernel arguments for 'zncc_kernel', Dispmap1 !\n");
-        abort();
-    }
-
-    status = clEnqueueNDRangeKernel(queue, zncc_kernel, 2, NULL, (const size_t*)&globalWorkSize, (const size_t*)&localWorkSize, 0, NULL, NULL);
-
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to execute 'zncc_kernel' on the device, Dispmap1!\n");
-        abort();
-    }
-
-    // Disparity (R vs L) ZNCC kernel
-    MAXDISP *= -1;
-    status = 0;
-    status  = clSetKernelArg(zncc_kernel, 0, sizeof(clmemImageR), &clmemImageR);
-    status |= clSetKernelArg(zncc_kernel, 1, sizeof(clmemImageL), &clmemImageL);
-    status |= clSetKernelArg(zncc_kernel, 2, sizeof(clmemDispMap2), &clmemDispMap2);
-    status |= clSetKernelArg(zncc_kernel, 3, sizeof(Width), &Width);
-    status |= clSetKernelArg(zncc_kernel, 4, sizeof(Height), &Height);
-    status |= clSetKernelArg(zncc_kernel, 5, sizeof(HALFWINSIZEX), &HALFWINSIZEX);
-    status |= clSetKernelArg(zncc_kernel, 6, sizeof(HALFWINSIZEY), &HALFWINSIZEY);
-    status |= clSetKernelArg(zncc_kernel, 7, sizeof(WINSIZEAREA), &WINSIZEAREA);
-    status |= clSetKernelArg(zncc_kernel, 8, sizeof(MAXDISP), &MAXDISP);
-    status |= clSetKernelArg(zncc_kernel, 9, sizeof(MINDISP), &MINDISP);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to set kernel arguments for 'zncc_kernel' Dispmap2 !\n");
-        abort();
-    }
-
-    status = clEnqueueNDRangeKernel(queue, zncc_kernel, 2, NULL, (const size_t*)&globalWorkSize, (const size_t*)&localWorkSize, 0, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to execute 'zncc_kernel' on the device, Dispmap2 !\n");
-        abort();
-    }
-
-    // Cross checking kernel
-    status = 0;
-    status  = clSetKernelArg(cross_check_kernel, 0, sizeof(clmemDispMap1), &clmemDispMap1);
-    status |= clSetKernelArg(cross_check_kernel, 1, sizeof(clmemDispMap2), &clmemDispMap2);
-    status |= clSetKernelArg(cross_check_kernel, 2, sizeof(clmemDispMapCrossCheck), &clmemDispMapCrossCheck);
-    status |= clSetKernelArg(cross_check_kernel, 3, sizeof(THRESHOLD), &THRESHOLD);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to set kernel arguments for 'cross_check_kernel' !\n");
-        abort();
-    }
-
-    status = clEnqueueNDRangeKernel(queue, cross_check_kernel, 1, NULL, (const size_t*)&globalWorkSize1D, (const size_t*)&localWorkSize1D, 0, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Failed to execute 'cross_check_kernel' on the device !\n");
-        abort();
-    }
-
-    clFinish(queue);
-    status = clEnqueueReadBuffer(queue, clmemDispMapCrossCheck, CL_TRUE, 0, Width*Height, dDisparity, 0, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "'cross_check_kernel': Failed to send the data to host !\n");
-        abort();
+    // ******** Setup the engine: OpenCL device, or the native CPU backend when there is no device ********
+    setup_params(&params, profile);
+    stageStart = zncc_profile_now();
+    engine = zncc_engine_create(&params);
+    zncc_profile_host(profile, "setup", stageStart);
+    if (!engine) {
+        fprintf(stderr, "No OpenCL device available !\n");
+        free(OrigImageL);
+        free(OrigImageR);
+        return -1;
     }
 
-
-    // ******** run occlusion_filling & nomalize on host-code ********
-    Disparity = occlusion_filling(dDisparity, Width, Height);
-    normalization(Disparity, Width, Height);
+    // ******** Resize, ZNCC, cross check, occlusion filling & normalization ********
+    if (DECODE_GREY)
+        Disparity = zncc_engine_process_grey_pair(engine, OrigImageL, OrigImageR, wL, hL, &Width, &Height);
+    else
+        Disparity = zncc_engine_process_pair(engine, OrigImageL, OrigImageR, wL, hL, &Width, &Height);
 
     clock_gettime(CLOCK_MONOTONIC, &totalEndTime); // Ending time
-    printf("*** Total ZNCC OpenCL executed time: %f s. ***\n", (double)(totalEndTime.tv_sec - totalStartTime.tv_sec) + (double)(totalEndTime.tv_nsec - totalStartTime.tv_nsec)/1000000000);
+    printf("*** Total ZNCC %s executed time: %f s. ***\n", zncc_engine_backend_name(engine), (double)(totalEndTime.tv_sec - totalStartTime.tv_sec) + (double)(totalEndTime.tv_nsec - totalStartTime.tv_nsec)/1000000000);
 
 
     // ******** Save file to working directory (setup working directory may differ from IDEs) ********
-    err = lodepng_encode_file("depthmap.png", Disparity, Width, Height, LCT_GREY, 8);
+    stageStart = zncc_profile_now();
+    err = zncc_write_depthmap("depthmap.png", Disparity, Width, Height, ENCODE_PROFILE);
+    zncc_profile_host(profile, "encode", stageStart);
+    if (SUBPIXEL_OUTPUT && zncc_write_disparity(SUBPIXEL_OUTPUT, zncc_engine_subpixel_map(engine), Width, Height))
+        fprintf(stderr, "Fail to write the subpixel disparities '%s' !\n", SUBPIXEL_OUTPUT);
     free(OrigImageR);
     free(OrigImageL);
-    free(resize_kernel_file);
-    free(zncc_kernel_file);
-    free(cross_check_kernel_file);
-    free(dDisparity);
     free(Disparity);
+    zncc_engine_destroy(engine);
 
-    clReleaseKernel(resize_kernel);
-    clReleaseKernel(zncc_kernel);
-    clReleaseKernel(cross_check_kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(ctx);
-
-    clReleaseMemObject(clmemOrigImageL);
-    clReleaseMemObject(clmemOrigImageR);
-    clReleaseMemObject(clmemImageL);
-    clReleaseMemObject(clmemImageR);
-    clReleaseMemObject(clmemDispMap1);
-    clReleaseMemObject(clmemDispMap2);
-    clReleaseMemObject(clmemDispMapCrossCheck);
+    // ******** Per-stage timing report ********
+    if (profile) {
+        zncc_profile_print(profile);
+        if (zncc_profile_write(profile, PROFILE_REPORT))
+            fprintf(stderr, "Fail to write the timing report '%s' !\n", PROFILE_REPORT);
+        else
+            printf("Timing report written to '%s'\n", PROFILE_REPORT);
+        zncc_profile_destroy(profile);
+    }
 
     if(err){
         printf("Error when saving the final 'depthmap.png' %u: %s\n", err, lodepng_error_text(err));
@@ -374,139 +221,256 @@ int32_t main()
 }
 
 /******************************************************************************
- *  Function that use to read kernel file
+ *  Decode one image, fused with the greyscale & downscale with --decode=grey
  */
-char *read_kernel_file(const char *filename)
+uint32_t decode_image(uint8_t **image, uint32_t *w, uint32_t *h, const char *filename)
 {
-    FILE *f = fopen(filename, "r");
-    fseek(f, 0, SEEK_END);
-    size_t size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char *res = (char *) malloc(size+1);
-    if(!res) { // check error
-        perror("Fail to read file, can not allocation memory !");
-        abort();
-    }
-
-    // read file from stream
-    if(fread(res, 1, size, f) < size) { // check error
-        perror("Fail to read file, fread abort !");
-        abort();
-    }
-
-    fclose(f);
-    res[size] = '\0';
-    return res;
+    if (DECODE_GREY)
+        return zncc_decode_grey_file(image, w, h, filename, DOWNSCALE);
+    return zncc_decode_rgba_file(image, w, h, filename);
 }
 
 /******************************************************************************
- *  Function that use to build kernel from file
+ *  decode_image as a thread function, both images of a pair are decoded at once
  */
-cl_kernel build_kernel_from_file(cl_context ctx, char const *kernel, char const *kernel_name)
+void *decode_job(void *arg)
 {
-    cl_int status;
-
-    printf("Building kernel '%s'\n", kernel_name);
-    // get kernel size
-    size_t sizes[] = { strlen(kernel) };
+    decode_job_t *job = (decode_job_t*) arg;
+    job->start = zncc_profile_now();
+    job->err = decode_image(&job->image, &job->w, &job->h, job->filename);
+    return NULL;
+}
 
-    // create program
-    cl_program program = clCreateProgramWithSource(ctx, 1, &kernel, sizes, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create program, in kernel file: '%s' !\n", kernel_name);
-        abort();
-    }
+/******************************************************************************
+ *  Engine parameters from the globals above
+ */
+void setup_params(zncc_params_t *params, zncc_profile_t *profile)
+{
+    params->downscale     = DOWNSCALE;
+    params->resizeFilter  = RESIZE_FILTER;
+    params->halfwinsizex  = HALFWINSIZEX;
+    params->halfwinsizey  = HALFWINSIZEY;
+    params->winsizearea   = WINSIZEAREA;
+    params->mindisp       = (int32_t)(MINDISP*DISP_DOWNSCALE/DOWNSCALE);
+    params->maxdisp       = (int32_t)(MAXDISP*DISP_DOWNSCALE/DOWNSCALE);
+    params->threshold     = THRESHOLD;
+    params->occlusionFill = OCCLUSION_FILL;
+    params->postprocess   = POSTPROCESS;
+    params->subpixel      = SUBPIXEL_OUTPUT != NULL;
+    params->cost          = COST;
+    params->mode          = ZNCC_MODE;
+    params->sgmPaths      = SGM_PATHS;
+    params->sgmP1         = SGM_P1;
+    params->sgmP2         = SGM_P2;
+    params->backend       = BACKEND;
+    params->memoryBudget  = (uint64_t)(MEMORY_BUDGET*1048576);
+    params->pyramidLevels = PYRAMID_LEVELS;
+    params->pyramidBand   = PYRAMID_BAND;
+    params->kernelCacheDir = KERNEL_CACHE;
+    params->profile       = profile;
+}
 
-    // build program
-    status = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to build program, in kernel file: '%s' !\n", kernel_name);
-        abort();
+/******************************************************************************
+ *  Batch mode: every pair of BATCH_INPUT through one engine, decode, ZNCC and
+ *  encode of consecutive pairs overlap (zncc_batch.c)
+ */
+int32_t run_batch(zncc_profile_t *profile)
+{
+    zncc_params_t params;
+    zncc_engine_t *engine;
+    zncc_batch_stats_t stats;
+    int32_t err;
+
+    setup_params(&params, profile);
+    if (params.subpixel) {
+        printf("--subpixel is ignored in batch mode\n");
+        params.subpixel = 0;
+    }
+    engine = zncc_engine_create(&params);
+    if (!engine) {
+        fprintf(stderr, "No OpenCL device available !\n");
+        return -1;
     }
+    err = zncc_batch_run(engine, BATCH_INPUT, BATCH_DECODERS, DECODE_GREY ? DOWNSCALE : 0, ENCODE_PROFILE, &stats);
+    if (!err)
+        printf("*** Batch ZNCC %s: %u pairs in %f s, %.3f pairs/s, %u failed ***\n", zncc_engine_backend_name(engine),
+               stats.pairs, stats.seconds, stats.seconds > 0 ? stats.pairs/stats.seconds : 0.0, stats.failed);
+    zncc_engine_destroy(engine);
 
-    // create our kernel from program
-    cl_kernel res = clCreateKernel(program, kernel_name, &status);
-    if(status != CL_SUCCESS){
-        fprintf(stderr, "Fail to create kernel, in kernel file: '%s' !\n", kernel_name);
-        abort();
+    if (profile) {
+        zncc_profile_print(profile);
+        if (zncc_profile_write(profile, PROFILE_REPORT))
+            fprintf(stderr, "Fail to write the timing report '%s' !\n", PROFILE_REPORT);
+        zncc_profile_destroy(profile);
     }
-    clReleaseProgram(program);
-    printf("Succefully builed kernel '%s'\n", kernel_name);
-    return res;
+    return err || stats.failed ? -1 : 0;
 }
 
 /******************************************************************************
- *  Replace each pixel with zero value with the nearest non-zero pixel value
+ *  Parse the command line options
+ *      --zncc=naive|integral|precomputed|tiled|fused   ZNCC engine mode (default naive)
+ *      --cost=zncc|census                          matching cost, ZNCC score or census Hamming distance (default zncc)
+ *      --backend=auto|opencl|cpu|all               OpenCL or native CPU backend, or every device + CPU (default auto)
+ *      --sgm=4|8|off                               semi-global matching over the ZNCC cost volume (default off)
+ *      --pyramid=<levels>                          coarse-to-fine search over <levels> levels (default 1, off)
+ *      --kernel-cache=<dir>|off                    compiled OpenCL program cache (default kernel_cache)
+ *      --fill=transform|ring                       occlusion filling engine (default transform)
+ *      --postprocess=device|host                   OpenCL occlusion filling & normalization (default device)
+ *      --batch=<manifest|dir>                      every pair of a manifest / directory, pipelined
+ *      --decoders=<n>                              decoder threads of the batch mode (default 2)
+ *      --downscale=<f>                             working size 1/<f> of the input, any factor >= 1 (default 4)
+ *      --resize=point|area|bilinear                downscale filter (default point)
+ *      --decode=grey|rgba                          fused decode-to-grey, or full RGBA decode + resize (default grey)
+ *      --encode=default|fast|rle                   depth map PNG encoder, lodepng defaults or a fast profile (default default)
+ *      --memory-budget=<MB>                        correlation buffers in strips of at most <MB> (default 0, whole image)
+ *      --subpixel=<file>                           parabola refined disparities, PFM for *.pfm, 16-bit PNG (x64) otherwise
+ *      --profile=<file>                            per-stage timing report, CSV for *.csv, JSON otherwise
  */
-uint8_t* occlusion_filling(const uint8_t* dispMap, uint32_t w, uint32_t h) {
-    int32_t i, j, ii, jj, k;
-    bool flag; // flag for nearest non-zero pixel value
-
-    uint8_t* result = (uint8_t*) malloc(w*h);
-
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++) {
-            // If the value of the pixel is zero, perform the occlusion filling by nearest non-zero pixel value
-            result[i*w+j] = dispMap[i*w+j];
-            if(dispMap[i*w+j] == 0) {
-                // Search of non-zero pixel in the neighborhood i,j, neighborhoodsize++
-                flag = true;
-                k = 0;
-                while(flag) {
-                    k++;
-                    jj = -k;
-                    for (ii = -k; ii <= k && flag; ii++) {
-                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
-                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
-                            flag = false;
-                            break;
-                        }
-                    }
-                    jj = k;
-                    for (ii = -k; ii <= k && flag; ii++) {
-                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
-                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
-                            flag = false;
-                            break;
-                        }
-                    }
-                    ii = -k;
-                    for (jj = -k+1; jj <= k-1 && flag; jj++) {
-                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
-                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
-                            flag = false;
-                            break;
-                        }
-                    }
-                    ii = k;
-                    for (jj = -k+1; jj <= k && flag; jj++) {
-                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
-                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
-                            flag = false;
-                            break;
-                        }
-                    }
-                }
+void parse_arguments(int argc, char **argv)
+{
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--zncc=", 7) == 0) {
+            if (strcmp(argv[i]+7, "naive") == 0)
+                ZNCC_MODE = ZNCC_MODE_NAIVE;
+            else if (strcmp(argv[i]+7, "integral") == 0)
+                ZNCC_MODE = ZNCC_MODE_INTEGRAL;
+            else if (strcmp(argv[i]+7, "precomputed") == 0)
+                ZNCC_MODE = ZNCC_MODE_PRECOMPUTED;
+            else if (strcmp(argv[i]+7, "tiled") == 0)
+                ZNCC_MODE = ZNCC_MODE_TILED;
+            else if (strcmp(argv[i]+7, "fused") == 0)
+                ZNCC_MODE = ZNCC_MODE_FUSED;
+            else {
+                fprintf(stderr, "Unknown ZNCC mode '%s' !\n", argv[i]+7);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--cost=", 7) == 0) {
+            if (strcmp(argv[i]+7, "zncc") == 0)
+                COST = COST_ZNCC;
+            else if (strcmp(argv[i]+7, "census") == 0)
+                COST = COST_CENSUS;
+            else {
+                fprintf(stderr, "Unknown matching cost '%s' !\n", argv[i]+7);
+                exit(-1);
             }
+        } else if (strncmp(argv[i], "--sgm=", 6) == 0) {
+            if (strcmp(argv[i]+6, "off") == 0)
+                SGM_PATHS = 0;
+            else if (strcmp(argv[i]+6, "4") == 0 || strcmp(argv[i]+6, "8") == 0)
+                SGM_PATHS = atoi(argv[i]+6);
+            else {
+                fprintf(stderr, "SGM paths must be 4, 8 or off !\n");
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--pyramid=", 10) == 0) {
+            PYRAMID_LEVELS = (uint32_t) atoi(argv[i]+10);
+            if (PYRAMID_LEVELS < 1 || PYRAMID_LEVELS > ZNCC_PYRAMID_MAX_LEVELS) {
+                fprintf(stderr, "Pyramid levels must be in 1..%d !\n", ZNCC_PYRAMID_MAX_LEVELS);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--kernel-cache=", 15) == 0) {
+            KERNEL_CACHE = strcmp(argv[i]+15, "off") == 0 ? NULL : argv[i]+15;
+        } else if (strncmp(argv[i], "--fill=", 7) == 0) {
+            if (strcmp(argv[i]+7, "transform") == 0)
+                OCCLUSION_FILL = OCCLUSION_FILL_TRANSFORM;
+            else if (strcmp(argv[i]+7, "ring") == 0)
+                OCCLUSION_FILL = OCCLUSION_FILL_RING;
+            else {
+                fprintf(stderr, "Unknown occlusion filling engine '%s' !\n", argv[i]+7);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--postprocess=", 14) == 0) {
+            if (strcmp(argv[i]+14, "device") == 0)
+                POSTPROCESS = POSTPROCESS_DEVICE;
+            else if (strcmp(argv[i]+14, "host") == 0)
+                POSTPROCESS = POSTPROCESS_HOST;
+            else {
+                fprintf(stderr, "Unknown post-processing place '%s' !\n", argv[i]+14);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            BATCH_INPUT = argv[i]+8;
+        } else if (strncmp(argv[i], "--decoders=", 11) == 0) {
+            BATCH_DECODERS = (uint32_t) atoi(argv[i]+11);
+            if (BATCH_DECODERS < 1) {
+                fprintf(stderr, "At least one decoder thread is needed !\n");
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--downscale=", 12) == 0) {
+            DOWNSCALE = (float) atof(argv[i]+12);
+            if (!(DOWNSCALE >= 1)) {
+                fprintf(stderr, "The downscale factor must be at least 1 !\n");
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--resize=", 9) == 0) {
+            if (strcmp(argv[i]+9, "point") == 0)
+                RESIZE_FILTER = RESIZE_POINT;
+            else if (strcmp(argv[i]+9, "area") == 0)
+                RESIZE_FILTER = RESIZE_AREA;
+            else if (strcmp(argv[i]+9, "bilinear") == 0)
+                RESIZE_FILTER = RESIZE_BILINEAR;
+            else {
+                fprintf(stderr, "Unknown resize filter '%s' !\n", argv[i]+9);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--decode=", 9) == 0) {
+            if (strcmp(argv[i]+9, "grey") == 0)
+                DECODE_GREY = 1;
+            else if (strcmp(argv[i]+9, "rgba") == 0)
+                DECODE_GREY = 0;
+            else {
+                fprintf(stderr, "Unknown decode mode '%s' !\n", argv[i]+9);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--encode=", 9) == 0) {
+            if (strcmp(argv[i]+9, "default") == 0)
+                ENCODE_PROFILE = ENCODE_DEFAULT;
+            else if (strcmp(argv[i]+9, "fast") == 0)
+                ENCODE_PROFILE = ENCODE_FAST;
+            else if (strcmp(argv[i]+9, "rle") == 0)
+                ENCODE_PROFILE = ENCODE_RLE;
+            else {
+                fprintf(stderr, "Unknown encoder profile '%s' !\n", argv[i]+9);
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--memory-budget=", 16) == 0) {
+            MEMORY_BUDGET = (float) atof(argv[i]+16);
+            if (!(MEMORY_BUDGET >= 0)) {
+                fprintf(stderr, "The memory budget can not be negative !\n");
+                exit(-1);
+            }
+        } else if (strncmp(argv[i], "--subpixel=", 11) == 0) {
+            SUBPIXEL_OUTPUT = argv[i]+11;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            PROFILE_REPORT = argv[i]+10;
+        } else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            if (strcmp(argv[i]+10, "auto") == 0)
+                BACKEND = BACKEND_AUTO;
+            else if (strcmp(argv[i]+10, "opencl") == 0)
+                BACKEND = BACKEND_OPENCL;
+            else if (strcmp(argv[i]+10, "cpu") == 0)
+                BACKEND = BACKEND_CPU;
+            else if (strcmp(argv[i]+10, "all") == 0)
+                BACKEND = BACKEND_ALL;
+            else {
+                fprintf(stderr, "Unknown backend '%s' !\n", argv[i]+10);
+                exit(-1);
+            }
+        } else {
+            fprintf(stderr, "Unknown option '%s' !\n", argv[i]);
+            fprintf(stderr, "Usage: %s [--zncc=naive|integral|precomputed|tiled|fused] [--cost=zncc|census] [--sgm=4|8|off] [--backend=auto|opencl|cpu|all] [--pyramid=<levels>] [--kernel-cache=<dir>|off] [--fill=transform|ring] [--postprocess=device|host] [--batch=<manifest|dir>] [--decoders=<n>] [--downscale=<f>] [--resize=point|area|bilinear] [--decode=grey|rgba] [--encode=default|fast|rle] [--memory-budget=<MB>] [--subpixel=<file>] [--profile=<file>]\n", argv[0]);
+            exit(-1);
         }
     }
-    return result;
-}
-
-/******************************************************************************
- *  Normalize the final disparity map
- */
-void normalization(uint8_t* dispMap, uint32_t w, uint32_t h) {
-    uint8_t maxValue = 0, minValue = UCHAR_MAX;
-    uint32_t i;
-    for (i = 0; i < w*h; i++) {
-        if(dispMap[i]>maxValue) {maxValue=dispMap[i];}
-        if(dispMap[i]<minValue) {minValue=dispMap[i];}
+    if (RESIZE_FILTER != RESIZE_POINT)
+        DECODE_GREY = 0;
+    if (COST == COST_CENSUS && PYRAMID_LEVELS > 1) {
+        fprintf(stderr, "--pyramid only refines ZNCC disparities, not with --cost=census !\n");
+        exit(-1);
     }
-    // Nomarlize to grey scale 0..255(UCHAR_MAX)
-    maxValue -= minValue;
-    for (i = 0; i < w*h; i++) {
-        dispMap[i] = (UCHAR_MAX*(dispMap[i] - minValue)/maxValue);
+    if (SGM_PATHS && (COST != COST_ZNCC || PYRAMID_LEVELS > 1 || BACKEND == BACKEND_ALL)) {
+        fprintf(stderr, "--sgm aggregates the whole ZNCC cost volume on one backend, not with --cost=census, --pyramid nor --backend=all !\n");
+        exit(-1);
     }
 }
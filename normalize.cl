@@ -0,0 +1,71 @@
+// Device version of normalization (zncc_cpu.c): two-stage min/max reduction, then the 0..255 stretch.
+//   minmax_partial      : every work-group reduces a grid-stride slice of the map into minMax[2*group], [2*group+1]
+//   minmax_final        : a single work-group reduces the partial results into result[0] (min), result[1] (max)
+//   normalize_disparity : one work-item per pixel, same integer formula as the host lookup table
+// Local sizes must be powers of two.
+
+__kernel void minmax_partial(__global uchar *dispMap, __global uchar *minMax, __local uchar *scratchMin, __local uchar *scratchMax, uint n) {
+
+    const uint lid  = get_local_id(0);
+    const uint lsz  = get_local_size(0);
+    uint k, s;
+    uchar lo = 255, hi = 0;
+
+    for (k = get_global_id(0); k < n; k += get_global_size(0)) {
+        lo = min(lo, dispMap[k]);
+        hi = max(hi, dispMap[k]);
+    }
+    scratchMin[lid] = lo;
+    scratchMax[lid] = hi;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (s = lsz/2; s > 0; s >>= 1) {
+        if (lid < s) {
+            scratchMin[lid] = min(scratchMin[lid], scratchMin[lid + s]);
+            scratchMax[lid] = max(scratchMax[lid], scratchMax[lid + s]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        minMax[2*get_group_id(0)]     = scratchMin[0];
+        minMax[2*get_group_id(0) + 1] = scratchMax[0];
+    }
+}
+
+__kernel void minmax_final(__global uchar *minMax, __global uchar *result, __local uchar *scratchMin, __local uchar *scratchMax, uint groups) {
+
+    const uint lid  = get_local_id(0);
+    const uint lsz  = get_local_size(0);
+    uint k, s;
+    uchar lo = 255, hi = 0;
+
+    for (k = lid; k < groups; k += lsz) {
+        lo = min(lo, minMax[2*k]);
+        hi = max(hi, minMax[2*k + 1]);
+    }
+    scratchMin[lid] = lo;
+    scratchMax[lid] = hi;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (s = lsz/2; s > 0; s >>= 1) {
+        if (lid < s) {
+            scratchMin[lid] = min(scratchMin[lid], scratchMin[lid + s]);
+            scratchMax[lid] = max(scratchMax[lid], scratchMax[lid + s]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        result[0] = scratchMin[0];
+        result[1] = scratchMax[0];
+    }
+}
+
+__kernel void normalize_disparity(__global uchar *dispMap, __global uchar *minMax, uint n) {
+
+    const uint k = get_global_id(0);
+    const int minValue = minMax[0];
+    const int range    = minMax[1] - minValue;
+    if (k >= n)
+        return;
+
+    // Nomarlize to grey scale 0..255
+    dispMap[k] = (dispMap[k] < minValue || range == 0) ? 0 : 255*(dispMap[k] - minValue)/range;
+}
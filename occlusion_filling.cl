@@ -0,0 +1,87 @@
+// Device version of occlusion_filling (zncc_cpu.c), same map as the ring search of occlusion_filling_ring:
+//   fill_row_tables : one work-item per row, distance to the nearest non-zero pixel of the row and
+//                     first non-zero column at or after each column
+//   fill_col_tables : one work-item per column, first non-zero row at or below each row
+//   fill_occlusions : one work-item per pixel, chessboard distance k to the nearest non-zero pixel from
+//                     the row distances, then the first non-zero pixel of ring k in the ring search order
+//                     (left column, right column, top row, bottom row)
+
+__kernel void fill_row_tables(__global uchar *dispMap, __global int *rowDist, __global int *nextRight, int w, int h) {
+
+    const int i = get_global_id(0);
+    const int far = w + h + 1;          // farther than any pixel of the map
+    int j, prev, next;
+    if (i >= h)
+        return;
+
+    prev = -far;
+    for (j = 0; j < w; j++) {
+        if (dispMap[i*w+j] != 0)
+            prev = j;
+        rowDist[i*w+j] = min(j - prev, far);
+    }
+    next = w;
+    for (j = w - 1; j >= 0; j--) {
+        if (dispMap[i*w+j] != 0)
+            next = j;
+        nextRight[i*w+j] = next;
+        if (next < w)
+            rowDist[i*w+j] = min(rowDist[i*w+j], next - j);
+    }
+}
+
+__kernel void fill_col_tables(__global uchar *dispMap, __global int *nextDown, int w, int h) {
+
+    const int j = get_global_id(0);
+    int i, next;
+    if (j >= w)
+        return;
+
+    next = h;
+    for (i = h - 1; i >= 0; i--) {
+        if (dispMap[i*w+j] != 0)
+            next = i;
+        nextDown[i*w+j] = next;
+    }
+}
+
+__kernel void fill_occlusions(__global uchar *dispMap, __global int *rowDist, __global int *nextDown, __global int *nextRight, __global uchar *result, int w, int h) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    int k, r, c, lo, hi;
+    if (i >= h || j >= w)
+        return;
+
+    result[i*w+j] = dispMap[i*w+j];
+    // Chessboard distance: min over the rows i+-r of max(r, row distance), rows past k can not do better
+    k = rowDist[i*w+j];
+    for (r = 1; r < k; r++) {
+        if (i - r >= 0)
+            k = min(k, max(r, rowDist[(i-r)*w+j]));
+        if (i + r < h)
+            k = min(k, max(r, rowDist[(i+r)*w+j]));
+    }
+    if (k == 0 || k > w + h)            // non-zero pixel, or nothing to fill with
+        return;
+
+    // Left column, then right column, rows i-k..i+k
+    lo = max(i - k, 0);
+    hi = min(i + k, h - 1);
+    if (j - k >= 0 && (r = nextDown[lo*w + j-k]) <= hi) {
+        result[i*w+j] = dispMap[r*w + j-k];
+        return;
+    }
+    if (j + k < w && (r = nextDown[lo*w + j+k]) <= hi) {
+        result[i*w+j] = dispMap[r*w + j+k];
+        return;
+    }
+    // Top row, columns j-k+1..j+k-1, then bottom row, columns j-k+1..j+k
+    lo = max(j - k + 1, 0);
+    if (i - k >= 0 && (c = nextRight[(i-k)*w + lo]) <= min(j + k - 1, w - 1)) {
+        result[i*w+j] = dispMap[(i-k)*w + c];
+        return;
+    }
+    if (i + k < h && (c = nextRight[(i+k)*w + lo]) <= min(j + k, w - 1))
+        result[i*w+j] = dispMap[(i+k)*w + c];
+}
@@ -1,15 +1,137 @@
+// Resize & greyscale of the original RGBA images to the scale_w x scale_h working size, 1/scale on both axes
+// (any scale >= 1, not only integers). Every work-item writes RESIZE_PIXELS consecutive pixels of one row,
+// global size {scale_h, scale_w/RESIZE_PIXELS rounded up}:
+//   resize          : point sampling, pixel (scale*j - 1, scale*i - 1) (column / row 0 at 0)
+//   resize_area     : box average of the scale x scale source area, partial pixels weighted by their overlap
+//   resize_bilinear : separable bilinear interpolation at the centre of the output pixel
+// Same arithmetic as resize_rows & co. (zncc_cpu.c), no fused multiply-add, so both backends agree bit for bit.
+// Only the stores are vectorized (one vstore4 per work-item). The reads stay one read_imageui per RGBA texel:
+// the sources are image2d_t, fetched texel by texel through the texture cache, and the texels of consecutive
+// output pixels are scale (not an integer in general) apart, so there is no contiguous run to load at once.
+
+#pragma OPENCL FP_CONTRACT OFF
+
+#define RESIZE_PIXELS 4     // output pixels per work-item, must match zncc_engine.c
+
 __constant sampler_t tmp = CLK_NORMALIZED_COORDS_FALSE| CLK_ADDRESS_CLAMP_TO_EDGE| CLK_FILTER_NEAREST;
 
-__kernel void resize(__read_only image2d_t origImgL, __read_only image2d_t origImgR, __global uchar *resImgL, __global  uchar *resImgR, int scale_w, int scale_h) {
-	const int i = get_global_id(0);
-	const int j = get_global_id(1);
-	
+// Grayscaling, single precision constants
+inline float grey(uint4 pixel) {
+    return 0.2126f*pixel.x + 0.7152f*pixel.y + 0.0722f*pixel.z;
+}
+
+inline float grey_at(__read_only image2d_t img, int x, int y) {
+    int2 idx;
+    idx.x = x;
+    idx.y = y;
+    return grey(read_imageui(img, tmp, idx));
+}
+
+// One vstore4 when the RESIZE_PIXELS pixels fit in the row, pixel per pixel at its end
+inline void store_pixels(__global uchar *row, int j0, int w, const uchar *pixels) {
+    int k;
+    if (j0 + RESIZE_PIXELS <= w) {
+        vstore4(vload4(0, pixels), 0, row + j0);
+        return;
+    }
+    for (k = 0; j0 + k < w; k++)
+        row[j0 + k] = pixels[k];
+}
+
+__kernel void resize(__read_only image2d_t origImgL, __read_only image2d_t origImgR, __global uchar *resImgL, __global  uchar *resImgR, int scale_w, int scale_h, float scale) {
+	const int i  = get_global_id(0);
+	const int j0 = get_global_id(1)*RESIZE_PIXELS;
+    uchar outL[RESIZE_PIXELS], outR[RESIZE_PIXELS];
+    uint4 pixelLeftImage, pixelRightImage;
+    int2 redIdx;
+    int k, j;
+    if (i >= scale_h || j0 >= scale_w)
+        return;
+
     // Red index[i][j]
-    int2 redIdx = { (4*j - 1*(j > 0)), (4*i - 1*(i > 0)) };
-    // Grayscaling
-    uint4 pixelLeftImage  = read_imageui(origImgL, tmp, redIdx);
-    uint4 pixelRightImage = read_imageui(origImgR, tmp, redIdx);
-    
-    resImgL[i*scale_w+j] = 0.2126*pixelLeftImage.x  + 0.7152*pixelLeftImage.y  + 0.0722*pixelLeftImage.z;
-    resImgR[i*scale_w+j] = 0.2126*pixelRightImage.x + 0.7152*pixelRightImage.y + 0.0722*pixelRightImage.z;
+    redIdx.y = (int)(scale*i) - 1*(i > 0);
+    for (k = 0; k < RESIZE_PIXELS; k++) {
+        j = min(j0 + k, scale_w - 1);
+        redIdx.x = (int)(scale*j) - 1*(j > 0);
+        pixelLeftImage  = read_imageui(origImgL, tmp, redIdx);
+        pixelRightImage = read_imageui(origImgR, tmp, redIdx);
+        outL[k] = grey(pixelLeftImage);
+        outR[k] = grey(pixelRightImage);
+    }
+    store_pixels(resImgL + i*scale_w, j0, scale_w, outL);
+    store_pixels(resImgR + i*scale_w, j0, scale_w, outR);
+}
+
+__kernel void resize_area(__read_only image2d_t origImgL, __read_only image2d_t origImgR, __global uchar *resImgL, __global  uchar *resImgR, int scale_w, int scale_h, float scale) {
+	const int i  = get_global_id(0);
+	const int j0 = get_global_id(1)*RESIZE_PIXELS;
+    const int origW = get_image_width(origImgL);
+    const int origH = get_image_height(origImgL);
+    uchar outL[RESIZE_PIXELS], outR[RESIZE_PIXELS];
+    float y0f, y1f, x0f, x1f, wy, wx, rowL, rowR, sumL, sumR;
+    int ya, yb, xa, xb, x, y, k, j;
+    if (i >= scale_h || j0 >= scale_w)
+        return;
+
+    // Source rows [y0f, y1f), the first & last ones only partly covered
+    y0f = scale*i;
+    y1f = scale*(i + 1);
+    ya  = (int)y0f;
+    yb  = min((int)ceil(y1f) - 1, origH - 1);
+    for (k = 0; k < RESIZE_PIXELS; k++) {
+        j   = min(j0 + k, scale_w - 1);
+        x0f = scale*j;
+        x1f = scale*(j + 1);
+        xa  = (int)x0f;
+        xb  = min((int)ceil(x1f) - 1, origW - 1);
+        sumL = sumR = 0.0f;
+        for (y = ya; y <= yb; y++) {
+            wy = min(y + 1.0f, y1f) - max((float)y, y0f);
+            rowL = rowR = 0.0f;
+            for (x = xa; x <= xb; x++) {
+                wx = min(x + 1.0f, x1f) - max((float)x, x0f);
+                rowL += wx*grey_at(origImgL, x, y);
+                rowR += wx*grey_at(origImgR, x, y);
+            }
+            sumL += wy*rowL;
+            sumR += wy*rowR;
+        }
+        outL[k] = sumL/(scale*scale) + 0.5f;
+        outR[k] = sumR/(scale*scale) + 0.5f;
+    }
+    store_pixels(resImgL + i*scale_w, j0, scale_w, outL);
+    store_pixels(resImgR + i*scale_w, j0, scale_w, outR);
+}
+
+__kernel void resize_bilinear(__read_only image2d_t origImgL, __read_only image2d_t origImgR, __global uchar *resImgL, __global  uchar *resImgR, int scale_w, int scale_h, float scale) {
+	const int i  = get_global_id(0);
+	const int j0 = get_global_id(1)*RESIZE_PIXELS;
+    const int origW = get_image_width(origImgL);
+    const int origH = get_image_height(origImgL);
+    uchar outL[RESIZE_PIXELS], outR[RESIZE_PIXELS];
+    float sy, sx, fy, fx, topL, topR, bottomL, bottomR;
+    int y0, y1, x0, x1, k, j;
+    if (i >= scale_h || j0 >= scale_w)
+        return;
+
+    // Centre of the output pixel in the source image, clamped to the centres of the edge pixels
+    sy = clamp((i + 0.5f)*scale - 0.5f, 0.0f, (float)(origH - 1));
+    y0 = (int)sy;
+    y1 = min(y0 + 1, origH - 1);
+    fy = sy - y0;
+    for (k = 0; k < RESIZE_PIXELS; k++) {
+        j  = min(j0 + k, scale_w - 1);
+        sx = clamp((j + 0.5f)*scale - 0.5f, 0.0f, (float)(origW - 1));
+        x0 = (int)sx;
+        x1 = min(x0 + 1, origW - 1);
+        fx = sx - x0;
+        topL    = (1.0f - fx)*grey_at(origImgL, x0, y0) + fx*grey_at(origImgL, x1, y0);
+        topR    = (1.0f - fx)*grey_at(origImgR, x0, y0) + fx*grey_at(origImgR, x1, y0);
+        bottomL = (1.0f - fx)*grey_at(origImgL, x0, y1) + fx*grey_at(origImgL, x1, y1);
+        bottomR = (1.0f - fx)*grey_at(origImgR, x0, y1) + fx*grey_at(origImgR, x1, y1);
+        outL[k] = (1.0f - fy)*topL + fy*bottomL + 0.5f;
+        outR[k] = (1.0f - fy)*topR + fy*bottomR + 0.5f;
+    }
+    store_pixels(resImgL + i*scale_w, j0, scale_w, outL);
+    store_pixels(resImgR + i*scale_w, j0, scale_w, outR);
 }
@@ -0,0 +1,144 @@
+// Semi-global matching on top of the ZNCC scores (--sgm=<paths>):
+//   zncc_cost_volume : the zncc.cl score of every (pixel, d), stored as an 8-bit cost (1 - score)*SGM_COST_SCALE,
+//                      SGM_COST_MAX when the score is NaN (flat window); disparities of a pixel are contiguous
+//   sgm_aggregate    : one path direction (dx, dy), one work-group per scanline of that direction. The group walks
+//                      its scanline one pixel at a time (wavefront), its work-items share the disparities:
+//                      L(p,d) = C(p,d) + min(L(p-r,d), L(p-r,d+-1) + P1, min_k L(p-r,k) + P2) - min_k L(p-r,k)
+//                      L is added to the 16-bit sums of the previous directions (first = 1 overwrites them)
+//   sgm_select       : lowest sum of every pixel, the first one on a tie
+// Same arithmetic as cpu_sgm_* (zncc_cpu.c), no fused multiply-add, so both backends agree bit for bit.
+
+#pragma OPENCL FP_CONTRACT OFF
+
+#define SGM_COST_SCALE  127.0f  // costs 0..254 for scores 1..-1, must match zncc_cpu.c
+#define SGM_COST_MAX    255
+#define SGM_LOCAL_SIZE  64      // work-items per scanline, a power of two, must match zncc_engine.c
+#define SGM_MAX_NDISP   512     // disparities per pixel, must match zncc_engine.c
+
+__kernel void zncc_cost_volume(__global uchar *leftImg, __global uchar *rightImg, __global uchar *cost, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    const int ndisp = maxd - mind + 1;
+    // Rows of the window inside the image, the same for every disparity
+    const int r0 = max(-halfwinsizey, -i);
+    const int r1 = min(halfwinsizey, h - i);
+    int ii, jj, d, c0, c1;
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation, currZNCC;
+    if (i >= h || j >= w)
+        return;
+
+    for (d = mind; d <= maxd; d++) {
+        // Columns of the window inside both images
+        c0 = max(-j, d - j);
+        c1 = min(w - j, w - j + d);
+        avgLeft = avgRight = 0;
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (c0 <= jj && jj < c1) {
+                    avgLeft  += leftImg [(i+ii)*w + (j+jj)];
+                    avgRight += rightImg[(i+ii)*w + (j+jj-d)];
+                }
+            }
+        }
+        avgLeft  /= winsizearea;
+        avgRight /= winsizearea;
+        leftStdDeviation = rightStdDeviation = currZNCC = 0;
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (c0 <= jj && jj < c1) {
+                    leftWinValue       = leftImg[(i+ii)*w + (j+jj)] - avgLeft;
+                    rightWinValue      = rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
+                    currZNCC          += leftWinValue*rightWinValue;
+                    leftStdDeviation  += leftWinValue*leftWinValue;
+                    rightStdDeviation += rightWinValue*rightWinValue;
+                }
+            }
+        }
+        currZNCC /= native_sqrt(leftStdDeviation)*native_sqrt(rightStdDeviation);
+        if (currZNCC != currZNCC)
+            cost[(i*w + j)*ndisp + (d - mind)] = SGM_COST_MAX;
+        else
+            cost[(i*w + j)*ndisp + (d - mind)] = (uchar)((1.0f - clamp(currZNCC, -1.0f, 1.0f))*SGM_COST_SCALE + 0.5f);
+    }
+}
+
+// prev: ndisp + 2 entries of local memory (the previous pixel, a sentinel on both sides), mins: SGM_LOCAL_SIZE entries
+__kernel void sgm_aggregate(__global uchar *cost, __global ushort *sum, int w, int h, int ndisp, int dx, int dy, int P1, int P2, int first,
+                            __local ushort *prev, __local ushort *mins) {
+
+    const int line = get_group_id(0);
+    const int t = get_local_id(0);
+    // Scanlines start on the image border the direction comes from: a row of starts when dy != 0, a column when dx != 0
+    const int rowStarts = dy ? w : 0;
+    const int colStarts = dx ? (dy ? h - 1 : h) : 0;
+    ushort cur[SGM_MAX_NDISP/SGM_LOCAL_SIZE];
+    ushort l, m, prevMin, localMin;
+    int i, j, d, k, s, idx;
+    if (line >= rowStarts + colStarts)
+        return;
+
+    if (line < rowStarts) {
+        i = dy > 0 ? 0 : h - 1;
+        j = line;
+    } else {
+        // The corner is already a row start
+        i = line - rowStarts + (dy > 0);
+        j = dx > 0 ? 0 : w - 1;
+    }
+
+    // L of the pixel before the first one: 0, so that the first L is its cost
+    for (d = t; d < ndisp; d += SGM_LOCAL_SIZE)
+        prev[d+1] = 0;
+    if (t == 0)
+        prev[0] = prev[ndisp+1] = 0x3fff;
+    prevMin = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    while (0 <= i && i < h && 0 <= j && j < w) {
+        idx = (i*w + j)*ndisp;
+        localMin = 0x7fff;
+        for (k = 0, d = t; d < ndisp; d += SGM_LOCAL_SIZE, k++) {
+            m = min(prev[d+1], (ushort)min(prev[d] + P1, prev[d+2] + P1));
+            m = min(m, (ushort)(prevMin + P2));
+            l = cost[idx + d] + m - prevMin;
+            cur[k] = l;
+            localMin = min(localMin, l);
+            sum[idx + d] = first ? l : (ushort)(sum[idx + d] + l);
+        }
+        mins[t] = localMin;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (k = 0, d = t; d < ndisp; d += SGM_LOCAL_SIZE, k++)
+            prev[d+1] = cur[k];
+        for (s = SGM_LOCAL_SIZE/2; s > 0; s >>= 1) {
+            if (t < s)
+                mins[t] = min(mins[t], mins[t+s]);
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        prevMin = mins[0];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        i += dy;
+        j += dx;
+    }
+}
+
+__kernel void sgm_select(__global ushort *sum, __global uchar *dispMap, int w, int h, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    const int ndisp = maxd - mind + 1;
+    int d, best_d;
+    uint best;
+    if (i >= h || j >= w)
+        return;
+
+    best_d = maxd;
+    best = 0x10000;
+    for (d = mind; d <= maxd; d++) {
+        if (sum[(i*w + j)*ndisp + (d - mind)] < best) {
+            best = sum[(i*w + j)*ndisp + (d - mind)];
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
@@ -0,0 +1,66 @@
+// Subpixel refinement of the cross checked disparity map: the ZNCC scores at d-1, d and d+1 (same window
+// & formula as zncc.cl) are fitted with a parabola, whose peak offset from d is written to delta, in
+// -0.5..0.5. Pixels that failed the cross check (0), whose neighbours fall out of mind..maxd or whose
+// scores are not a peak get 0. One work-item per pixel, the bounds are checked.
+
+inline float zncc_score(__global uchar *leftImg, __global uchar *rightImg, int i, int j, int d, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea) {
+
+    // Rows & columns of the window inside both images
+    const int r0 = max(-halfwinsizey, -i);
+    const int r1 = min(halfwinsizey, h - i);
+    const int c0 = max(-j, d - j);
+    const int c1 = min(w - j, w - j + d);
+    int ii, jj;
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation, currZNCC;
+
+    // Calculating the window average
+    avgLeft = avgRight = 0;
+    for (ii = r0; ii < r1; ii++) {
+        for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+            if (c0 <= jj && jj < c1) {
+                avgLeft  += leftImg [(i+ii)*w + (j+jj)];
+                avgRight += rightImg[(i+ii)*w + (j+jj-d)];
+            }
+        }
+    }
+    avgLeft  /= winsizearea;
+    avgRight /= winsizearea;
+    leftStdDeviation = rightStdDeviation = currZNCC = 0;
+
+    // Calculate using the ZNCC formula
+    for (ii = r0; ii < r1; ii++) {
+        for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+            if (c0 <= jj && jj < c1) {
+                leftWinValue       = leftImg[(i+ii)*w + (j+jj)] - avgLeft;
+                rightWinValue      = rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
+                currZNCC          += leftWinValue*rightWinValue;
+                leftStdDeviation  += leftWinValue*leftWinValue;
+                rightStdDeviation += rightWinValue*rightWinValue;
+            }
+        }
+    }
+    return currZNCC/(native_sqrt(leftStdDeviation)*native_sqrt(rightStdDeviation));
+}
+
+__kernel void zncc_subpixel(__global uchar *leftImg, __global uchar *rightImg, __global uchar *dispMap, __global float *delta, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    int d;
+    float prev, curr, next, curvature;
+    if (i >= h || j >= w)
+        return;
+
+    d = dispMap[i*w+j];
+    delta[i*w+j] = 0;
+    if (d == 0 || d - 1 < mind || d + 1 > maxd)
+        return;
+
+    prev = zncc_score(leftImg, rightImg, i, j, d - 1, w, h, halfwinsizex, halfwinsizey, winsizearea);
+    curr = zncc_score(leftImg, rightImg, i, j, d,     w, h, halfwinsizex, halfwinsizey, winsizearea);
+    next = zncc_score(leftImg, rightImg, i, j, d + 1, w, h, halfwinsizex, halfwinsizey, winsizearea);
+    // Peak of the parabola through the three scores, only when d is a maximum (a NaN score fails the tests)
+    curvature = prev - 2*curr + next;
+    if (curvature < 0 && curr >= prev && curr >= next)
+        delta[i*w+j] = clamp((prev - next)/(2*curvature), -0.5f, 0.5f);
+}
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * FILENAME :        thread_pool.c
+ *
+ * DESCRIPTION :
+ *       pthread implementation of thread_pool.h
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+struct thread_pool {
+    pthread_t *threads;
+    uint32_t nthreads;          // workers, the calling thread comes on top of them
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // a new job was posted or the pool is shutting down
+    pthread_cond_t done;        // the last worker left the current job
+    uint32_t generation;        // bumped for every job
+    uint32_t busy;              // workers still on the current job
+    bool quit;
+
+    thread_pool_fn fn;          // current job
+    void *arg;
+    uint32_t n, band;
+    uint32_t next;              // first row of the next band, claimed atomically
+};
+
+static void run_bands(thread_pool_t *pool)
+{
+    uint32_t begin, end;
+    for (;;) {
+        begin = __sync_fetch_and_add(&pool->next, pool->band);
+        if (begin >= pool->n)
+            break;
+        end = begin + pool->band < pool->n ? begin + pool->band : pool->n;
+        pool->fn(pool->arg, begin, end);
+    }
+}
+
+static void *worker(void *p)
+{
+    thread_pool_t *pool = (thread_pool_t*) p;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_bands(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/******************************************************************************
+ *  Create a pool of nthreads threads (workers + the calling thread)
+ */
+thread_pool_t *thread_pool_create(uint32_t nthreads)
+{
+    uint32_t i;
+    thread_pool_t *pool = (thread_pool_t*) calloc(1, sizeof(thread_pool_t));
+    if (!pool) {
+        perror("Fail to create thread pool, can not allocation memory !");
+        abort();
+    }
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+    }
+    pool->nthreads = nthreads - 1;
+    pool->threads  = (pthread_t*) malloc((pool->nthreads + 1)*sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < pool->nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+            fprintf(stderr, "Fail to create thread %u of the pool !\n", i);
+            abort();
+        }
+    }
+    return pool;
+}
+
+/******************************************************************************
+ *  Run fn over [0, n) in bands of 'band' rows, returns when all bands are done
+ */
+void thread_pool_run(thread_pool_t *pool, thread_pool_fn fn, void *arg, uint32_t n, uint32_t band)
+{
+    if (!pool || pool->nthreads == 0) {
+        if (n > 0)
+            fn(arg, 0, n);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn   = fn;
+    pool->arg  = arg;
+    pool->n    = n;
+    pool->band = band > 0 ? band : 1;
+    pool->next = 0;
+    pool->busy = pool->nthreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_bands(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+uint32_t thread_pool_size(const thread_pool_t *pool)
+{
+    return pool ? pool->nthreads + 1 : 1;
+}
+
+void thread_pool_destroy(thread_pool_t *pool)
+{
+    uint32_t i;
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
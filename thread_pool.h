@@ -0,0 +1,30 @@
+/******************************************************************************
+ * FILENAME :        thread_pool.h
+ *
+ * DESCRIPTION :
+ *       Small pthread pool used by the native CPU backend. A job is a range
+ *       [0, n) split in bands of rows, the bands are handed out to the workers
+ *       (and to the calling thread) until the range is exhausted.
+ *
+ * NOTES :
+ *       + One job at a time per pool, thread_pool_run() blocks until every band is done.
+ *       + A NULL pool runs the whole range on the calling thread.
+ *
+ ******************************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+
+typedef struct thread_pool thread_pool_t;
+
+// Process rows [begin, end) of the job
+typedef void (*thread_pool_fn)(void *arg, uint32_t begin, uint32_t end);
+
+thread_pool_t *thread_pool_create(uint32_t nthreads);    // 0 : one thread per online CPU
+void thread_pool_run(thread_pool_t *pool, thread_pool_fn fn, void *arg, uint32_t n, uint32_t band);
+uint32_t thread_pool_size(const thread_pool_t *pool);    // number of threads taking part in a job
+void thread_pool_destroy(thread_pool_t *pool);
+
+#endif
@@ -1,35 +1,56 @@
+// Built with -D ZNCC_SPECIALIZED -D ZNCC_HALFWINSIZEX=.. -D ZNCC_HALFWINSIZEY=.. -D ZNCC_WINSIZEAREA=.. -D ZNCC_NDISP=..
+// the window and the number of disparities are compile-time constants and the matching arguments are ignored,
+// so the window loops can be unrolled. mind stays a runtime argument, the R vs L pass shares the same program.
+#ifdef ZNCC_SPECIALIZED
+#define HALFWINSIZEX ZNCC_HALFWINSIZEX
+#define HALFWINSIZEY ZNCC_HALFWINSIZEY
+#define WINSIZEAREA  ZNCC_WINSIZEAREA
+#define NDISP        ZNCC_NDISP
+#else
+#define HALFWINSIZEX halfwinsizex
+#define HALFWINSIZEY halfwinsizey
+#define WINSIZEAREA  winsizearea
+#define NDISP        (maxd - mind + 1)
+#endif
+
 __kernel void zncc(__global uchar *leftImg, __global  uchar *rightImg, __global uchar *dispMap, int w, int h,  int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd) {
-    
+
     const int i = get_global_id(0);
     const int j = get_global_id(1);
-    
-    int ii, jj, d, best_d; //declare idx, d is disparity value
+    // Rows of the window inside the image, the same for every disparity
+    const int r0 = max(-HALFWINSIZEY, -i);
+    const int r1 = min(HALFWINSIZEY, h - i);
+
+    int ii, jj, d, best_d, c0, c1; //declare idx, d is disparity value
     float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation;
     float currZNCC, bestZNCC; // current and best ZNCC value
-    
+
     // Searching for d with best ZNCC score for the each pixels
     best_d = maxd;
     bestZNCC = -1;
-    for (d = mind; d <= maxd; d++) {
+    for (d = mind; d < mind + NDISP; d++) {
+        // Columns of the window inside both images
+        c0 = max(-j, d - j);
+        c1 = min(w - j, w - j + d);
         // Calculating the window average
         avgLeft = avgRight = 0;
-        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
-            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
-                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -HALFWINSIZEX; jj < HALFWINSIZEX; jj++) {
+                if (c0 <= jj && jj < c1) {
                     // Sum all pixels in window size
                     avgLeft  += leftImg [(i+ii)*w + (j+jj)];
                     avgRight += rightImg[(i+ii)*w + (j+jj-d)];
                 }
             }
         }
-        avgLeft  /= winsizearea;
-        avgRight /= winsizearea;
+        avgLeft  /= WINSIZEAREA;
+        avgRight /= WINSIZEAREA;
         leftStdDeviation = rightStdDeviation = currZNCC = 0;
-        
+
         // Calculate using the ZNCC formula
-        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
-            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
-                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -HALFWINSIZEX; jj < HALFWINSIZEX; jj++) {
+                if (c0 <= jj && jj < c1) {
                     leftWinValue       = leftImg[(i+ii)*w + (j+jj)] - avgLeft;
                     rightWinValue      = rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
                     currZNCC          += leftWinValue*rightWinValue;
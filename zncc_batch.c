@@ -0,0 +1,356 @@
+/******************************************************************************
+ * FILENAME :        zncc_batch.c
+ *
+ * DESCRIPTION :
+ *       Pipelined batch executor behind zncc_batch.h
+ *       + job list  : read once from the manifest or the directory
+ *       + decoders  : claim the next job, decode both images (RGBA, or fused
+ *                     decode-to-grey when greyScale is set), push to 'decoded'
+ *       + engine    : the calling thread pops 'decoded', pushes the depth map
+ *                     to 'encode' (the OpenCL queue & engine buffers are only
+ *                     ever used from this thread)
+ *       + encoder   : pops 'encode', writes the PNG, frees the pair
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lodepng.h"
+#include "zncc_decode.h"
+#include "zncc_batch.h"
+
+typedef struct {
+    char *left, *right, *output;
+} batch_job_t;
+
+typedef struct {
+    const batch_job_t *job;
+    uint8_t *imageL, *imageR;           // decoded RGBA images, or grey working-size images
+    uint32_t w, h;
+    uint8_t *depthMap;                  // engine result
+    uint32_t width, height;
+} batch_pair_t;
+
+/******************************************************************************
+ *  Bounded blocking queue of pairs, closed by the producer side once it is done
+ */
+typedef struct {
+    batch_pair_t **items;
+    uint32_t capacity, head, count;
+    uint32_t producers;                 // the queue is closed when the last producer leaves
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty, notFull;
+} pair_queue_t;
+
+static void queue_init(pair_queue_t *q, uint32_t capacity, uint32_t producers)
+{
+    q->items = (batch_pair_t**) calloc(capacity, sizeof(batch_pair_t*));
+    if (!q->items) {
+        perror("Fail to create the batch queue, can not allocation memory !");
+        abort();
+    }
+    q->capacity  = capacity;
+    q->head      = q->count = 0;
+    q->producers = producers;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notEmpty, NULL);
+    pthread_cond_init(&q->notFull, NULL);
+}
+
+static void queue_destroy(pair_queue_t *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notEmpty);
+    pthread_cond_destroy(&q->notFull);
+    free(q->items);
+}
+
+static void queue_push(pair_queue_t *q, batch_pair_t *pair)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity)
+        pthread_cond_wait(&q->notFull, &q->lock);
+    q->items[(q->head + q->count++) % q->capacity] = pair;
+    pthread_cond_signal(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// NULL once the queue is empty and every producer left
+static batch_pair_t *queue_pop(pair_queue_t *q)
+{
+    batch_pair_t *pair = NULL;
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && q->producers > 0)
+        pthread_cond_wait(&q->notEmpty, &q->lock);
+    if (q->count) {
+        pair = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->notFull);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pair;
+}
+
+static void queue_leave(pair_queue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    if (--q->producers == 0)
+        pthread_cond_broadcast(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+typedef struct {
+    const batch_job_t *jobs;
+    uint32_t njobs;
+    uint32_t next;                      // next job to decode, claimed atomically
+    uint32_t failed;                    // updated atomically
+    uint32_t written;
+    float greyScale;                    // downscale of the fused decode-to-grey, 0 = RGBA decode
+    encode_profile_t encodeProfile;     // PNG encoder profile of the depth maps
+    pair_queue_t decoded, encode;
+} batch_t;
+
+static void free_pair(batch_pair_t *pair)
+{
+    free(pair->imageL);
+    free(pair->imageR);
+    free(pair->depthMap);
+    free(pair);
+}
+
+static uint32_t decode(const batch_t *b, uint8_t **image, uint32_t *w, uint32_t *h, const char *filename)
+{
+    if (b->greyScale)
+        return zncc_decode_grey_file(image, w, h, filename, b->greyScale);
+    return zncc_decode_rgba_file(image, w, h, filename);
+}
+
+static void *decoder(void *arg)
+{
+    batch_t *b = (batch_t*) arg;
+    uint32_t index, err, wR, hR;
+    batch_pair_t *pair;
+
+    while ((index = __sync_fetch_and_add(&b->next, 1)) < b->njobs) {
+        pair = (batch_pair_t*) calloc(1, sizeof(batch_pair_t));
+        if (!pair) {
+            perror("Fail to decode a pair, can not allocation memory !");
+            abort();
+        }
+        pair->job = &b->jobs[index];
+        err = decode(b, &pair->imageL, &pair->w, &pair->h, pair->job->left);
+        if (err) {
+            printf("Error when loading '%s' %u: %s\n", pair->job->left, err, lodepng_error_text(err));
+        } else {
+            err = decode(b, &pair->imageR, &wR, &hR, pair->job->right);
+            if (err)
+                printf("Error when loading '%s' %u: %s\n", pair->job->right, err, lodepng_error_text(err));
+            else if (wR != pair->w || hR != pair->h) {
+                printf("Error, the size of '%s' and '%s' not match.\n", pair->job->left, pair->job->right);
+                err = 1;
+            }
+        }
+        if (err) {
+            __sync_fetch_and_add(&b->failed, 1);
+            free_pair(pair);
+            continue;
+        }
+        queue_push(&b->decoded, pair);
+    }
+    queue_leave(&b->decoded);
+    return NULL;
+}
+
+static void *encoder(void *arg)
+{
+    batch_t *b = (batch_t*) arg;
+    batch_pair_t *pair;
+    uint32_t err;
+
+    while ((pair = queue_pop(&b->encode)) != NULL) {
+        err = zncc_write_depthmap(pair->job->output, pair->depthMap, pair->width, pair->height, b->encodeProfile);
+        if (err) {
+            printf("Error when saving '%s' %u: %s\n", pair->job->output, err, lodepng_error_text(err));
+            __sync_fetch_and_add(&b->failed, 1);
+        } else {
+            b->written++;
+        }
+        free_pair(pair);
+    }
+    return NULL;
+}
+
+/******************************************************************************
+ *  Job list from a manifest or a directory of pair directories
+ */
+static void add_job(batch_job_t **jobs, uint32_t *njobs, uint32_t *capacity, const char *left, const char *right, const char *output)
+{
+    batch_job_t *job;
+    if (*njobs == *capacity) {
+        *capacity = *capacity ? 2*(*capacity) : 64;
+        *jobs = (batch_job_t*) realloc(*jobs, *capacity*sizeof(batch_job_t));
+        if (!*jobs) {
+            perror("Fail to read the batch, can not allocation memory !");
+            abort();
+        }
+    }
+    job = &(*jobs)[(*njobs)++];
+    job->left   = strdup(left);
+    job->right  = strdup(right);
+    job->output = strdup(output);
+}
+
+static int32_t read_manifest(const char *path, batch_job_t **jobs, uint32_t *njobs, uint32_t *capacity)
+{
+    char line[3*1024], left[1024], right[1024], output[1024];
+    uint32_t lineNo = 0;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 1;
+    while (fgets(line, sizeof(line), f)) {
+        lineNo++;
+        if (sscanf(line, " %1023s", left) != 1 || left[0] == '#')
+            continue;
+        if (sscanf(line, " %1023s %1023s %1023s", left, right, output) != 3) {
+            fprintf(stderr, "%s:%u: expected 'left right output', line skipped\n", path, lineNo);
+            continue;
+        }
+        add_job(jobs, njobs, capacity, left, right, output);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int32_t read_directory(const char *path, batch_job_t **jobs, uint32_t *njobs, uint32_t *capacity)
+{
+    char left[1024], right[1024], output[1024];
+    char **names = NULL;
+    uint32_t count = 0, size = 0, i;
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 1;
+
+    // Sorted, so that the batch order does not depend on the file system
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (count == size) {
+            size  = size ? 2*size : 64;
+            names = (char**) realloc(names, size*sizeof(char*));
+            if (!names) {
+                perror("Fail to read the batch, can not allocation memory !");
+                abort();
+            }
+        }
+        names[count++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    if (count)
+        qsort(names, count, sizeof(char*), compare_names);
+
+    for (i = 0; i < count; i++) {
+        snprintf(left,   sizeof(left),   "%s/%s/im0.png", path, names[i]);
+        snprintf(right,  sizeof(right),  "%s/%s/im1.png", path, names[i]);
+        snprintf(output, sizeof(output), "%s/%s/depthmap.png", path, names[i]);
+        if (stat(left, &st) == 0 && stat(right, &st) == 0)
+            add_job(jobs, njobs, capacity, left, right, output);
+        free(names[i]);
+    }
+    free(names);
+    return 0;
+}
+
+/******************************************************************************
+ *  Run the whole batch, the engine on the calling thread
+ */
+int32_t zncc_batch_run(zncc_engine_t *engine, const char *input, uint32_t decoders, float greyScale,
+                       encode_profile_t encodeProfile, zncc_batch_stats_t *stats)
+{
+    batch_job_t *jobs = NULL;
+    uint32_t njobs = 0, capacity = 0, i;
+    pthread_t *decoderThreads, encoderThread;
+    batch_pair_t *pair;
+    struct timespec startTime, endTime;
+    struct stat st;
+    batch_t b;
+    int32_t err;
+
+    if (stat(input, &st) == 0 && S_ISDIR(st.st_mode))
+        err = read_directory(input, &jobs, &njobs, &capacity);
+    else
+        err = read_manifest(input, &jobs, &njobs, &capacity);
+    if (err || njobs == 0) {
+        fprintf(stderr, "No stereo pair to process in '%s' !\n", input);
+        free(jobs);
+        return 1;
+    }
+    if (decoders == 0)
+        decoders = 1;
+
+    memset(&b, 0, sizeof(b));
+    b.jobs  = jobs;
+    b.njobs = njobs;
+    b.greyScale = greyScale;
+    b.encodeProfile = encodeProfile;
+    queue_init(&b.decoded, decoders + 1, decoders);     // one decoded pair ahead of every decoder
+    queue_init(&b.encode, 2, 1);
+    decoderThreads = (pthread_t*) malloc(decoders*sizeof(pthread_t));
+    if (!decoderThreads) {
+        perror("Fail to start the batch, can not allocation memory !");
+        abort();
+    }
+
+    printf("Batch of %u pairs, %u decoder threads\n", njobs, decoders);
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (i = 0; i < decoders; i++)
+        pthread_create(&decoderThreads[i], NULL, decoder, &b);
+    pthread_create(&encoderThread, NULL, encoder, &b);
+
+    // ******** Engine stage ********
+    while ((pair = queue_pop(&b.decoded)) != NULL) {
+        if (greyScale)
+            pair->depthMap = zncc_engine_process_grey_pair(engine, pair->imageL, pair->imageR, pair->w, pair->h, &pair->width, &pair->height);
+        else
+            pair->depthMap = zncc_engine_process_pair(engine, pair->imageL, pair->imageR, pair->w, pair->h, &pair->width, &pair->height);
+        // The input images are not needed any more, release them before the pair waits for the encoder
+        free(pair->imageL);
+        free(pair->imageR);
+        pair->imageL = pair->imageR = NULL;
+        queue_push(&b.encode, pair);
+    }
+    queue_leave(&b.encode);
+
+    for (i = 0; i < decoders; i++)
+        pthread_join(decoderThreads[i], NULL);
+    pthread_join(encoderThread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    stats->pairs   = b.written;
+    stats->failed  = b.failed;
+    stats->seconds = (double)(endTime.tv_sec - startTime.tv_sec) + (double)(endTime.tv_nsec - startTime.tv_nsec)/1000000000;
+
+    queue_destroy(&b.decoded);
+    queue_destroy(&b.encode);
+    free(decoderThreads);
+    for (i = 0; i < njobs; i++) {
+        free(jobs[i].left);
+        free(jobs[i].right);
+        free(jobs[i].output);
+    }
+    free(jobs);
+    return 0;
+}
@@ -0,0 +1,42 @@
+/******************************************************************************
+ * FILENAME :        zncc_batch.h
+ *
+ * DESCRIPTION :
+ *       Batch of stereo pairs through one engine, pipelined over three stages:
+ *       + decoder threads : lodepng_decode32_file (or zncc_decode_grey_file) of
+ *                           both images of pair N+1..
+ *       + calling thread  : zncc_engine_process_pair (_grey_pair) of pair N
+ *       + encoder thread  : zncc_write_depthmap of pair N-1..
+ *       The stages hand pairs over through bounded queues, so at most a few
+ *       decoded pairs are in memory whatever the batch size.
+ *
+ * NOTES :
+ *       + Input is a manifest, one "left right output" triple per line (blank
+ *         lines and lines starting with '#' are skipped, paths can not hold
+ *         spaces), or a directory whose sub-directories hold im0.png & im1.png,
+ *         written to depthmap.png next to them.
+ *       + A pair that fails to decode, has images of different sizes or fails
+ *         to encode is reported and counted, the batch goes on.
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_BATCH_H
+#define ZNCC_BATCH_H
+
+#include <stdint.h>
+#include "zncc_engine.h"
+#include "zncc_output.h"
+
+typedef struct {
+    uint32_t pairs;                 // depth maps written
+    uint32_t failed;                // pairs that could not be decoded or encoded
+    double seconds;                 // wall-clock time from the first decode to the last encode
+} zncc_batch_stats_t;
+
+// 0 on success, 1 when the input can not be read or holds no pair.
+// greyScale: downscale of the engine to decode straight to grey images, 0 to decode RGBA images
+// encodeProfile: PNG encoder profile of the depth maps
+int32_t zncc_batch_run(zncc_engine_t *engine, const char *input, uint32_t decoders, float greyScale,
+                       encode_profile_t encodeProfile, zncc_batch_stats_t *stats);
+
+#endif
@@ -0,0 +1,1179 @@
+/******************************************************************************
+ * FILENAME :        zncc_cpu.c
+ *
+ * DESCRIPTION :
+ *       Native CPU backend of the ZNCC pipeline, see zncc_cpu.h
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <math.h>
+#include "zncc_cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define ZNCC_ROW_BAND   4       // rows per band handed to the thread pool
+#define ZNCC_MAX_LANES  8       // widest vector, sets the right padding of the float planes
+
+static inline int32_t imin(int32_t a, int32_t b) { return a < b ? a : b; }
+static inline int32_t imax(int32_t a, int32_t b) { return a > b ? a : b; }
+
+
+/******************************************************************************
+ *  Resize & greyscale, same sampling & arithmetic as the kernels of resize.cl
+ */
+typedef struct {
+    const uint8_t *origImgL, *origImgR;
+    uint8_t *resImgL, *resImgR;
+    uint32_t origW, origH, w;
+    float scale;
+} resize_rows_t;
+
+// Grayscaling, single precision constants
+static inline float grey(const uint8_t *pixel)
+{
+    return 0.2126f*pixel[0] + 0.7152f*pixel[1] + 0.0722f*pixel[2];
+}
+
+static void resize_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const resize_rows_t *a = (const resize_rows_t*) arg;
+    uint32_t i, j, x, y;
+
+    for (i = begin; i < end; i++) {
+        for (j = 0; j < a->w; j++) {
+            // Red index[i][j], clamped to edge like the sampler of resize.cl
+            x = (uint32_t)(a->scale*j) - 1*(j > 0);
+            y = (uint32_t)(a->scale*i) - 1*(i > 0);
+            if (x >= a->origW) x = a->origW - 1;
+            if (y >= a->origH) y = a->origH - 1;
+            a->resImgL[i*a->w+j] = (uint8_t) grey(a->origImgL + 4*(y*a->origW + x));
+            a->resImgR[i*a->w+j] = (uint8_t) grey(a->origImgR + 4*(y*a->origW + x));
+        }
+    }
+}
+
+static void resize_area_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const resize_rows_t *a = (const resize_rows_t*) arg;
+    const float scale = a->scale;
+    float y0f, y1f, x0f, x1f, wy, wx, rowL, rowR, sumL, sumR;
+    int32_t ya, yb, xa, xb, x, y, i, j;
+    const uint8_t *pixelL, *pixelR;
+
+    for (i = begin; i < (int32_t)end; i++) {
+        // Source rows [y0f, y1f), the first & last ones only partly covered
+        y0f = scale*i;
+        y1f = scale*(i + 1);
+        ya  = (int32_t)y0f;
+        yb  = imin((int32_t)ceilf(y1f) - 1, a->origH - 1);
+        for (j = 0; j < (int32_t)a->w; j++) {
+            x0f = scale*j;
+            x1f = scale*(j + 1);
+            xa  = (int32_t)x0f;
+            xb  = imin((int32_t)ceilf(x1f) - 1, a->origW - 1);
+            sumL = sumR = 0.0f;
+            for (y = ya; y <= yb; y++) {
+                wy = fminf(y + 1.0f, y1f) - fmaxf((float)y, y0f);
+                rowL = rowR = 0.0f;
+                for (x = xa; x <= xb; x++) {
+                    wx = fminf(x + 1.0f, x1f) - fmaxf((float)x, x0f);
+                    pixelL = a->origImgL + 4*((size_t)y*a->origW + x);
+                    pixelR = a->origImgR + 4*((size_t)y*a->origW + x);
+                    rowL += wx*grey(pixelL);
+                    rowR += wx*grey(pixelR);
+                }
+                sumL += wy*rowL;
+                sumR += wy*rowR;
+            }
+            a->resImgL[i*a->w+j] = (uint8_t)(sumL/(scale*scale) + 0.5f);
+            a->resImgR[i*a->w+j] = (uint8_t)(sumR/(scale*scale) + 0.5f);
+        }
+    }
+}
+
+static void resize_bilinear_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const resize_rows_t *a = (const resize_rows_t*) arg;
+    const float scale = a->scale;
+    float sy, sx, fy, fx, topL, topR, bottomL, bottomR;
+    int32_t y0, y1, x0, x1, i, j;
+    const uint8_t *row0L, *row1L, *row0R, *row1R;
+
+    for (i = begin; i < (int32_t)end; i++) {
+        // Centre of the output pixel in the source image, clamped to the centres of the edge pixels
+        sy = fminf(fmaxf((i + 0.5f)*scale - 0.5f, 0.0f), (float)(a->origH - 1));
+        y0 = (int32_t)sy;
+        y1 = imin(y0 + 1, a->origH - 1);
+        fy = sy - y0;
+        row0L = a->origImgL + 4*(size_t)y0*a->origW;
+        row1L = a->origImgL + 4*(size_t)y1*a->origW;
+        row0R = a->origImgR + 4*(size_t)y0*a->origW;
+        row1R = a->origImgR + 4*(size_t)y1*a->origW;
+        for (j = 0; j < (int32_t)a->w; j++) {
+            sx = fminf(fmaxf((j + 0.5f)*scale - 0.5f, 0.0f), (float)(a->origW - 1));
+            x0 = (int32_t)sx;
+            x1 = imin(x0 + 1, a->origW - 1);
+            fx = sx - x0;
+            topL    = (1.0f - fx)*grey(row0L + 4*x0) + fx*grey(row0L + 4*x1);
+            topR    = (1.0f - fx)*grey(row0R + 4*x0) + fx*grey(row0R + 4*x1);
+            bottomL = (1.0f - fx)*grey(row1L + 4*x0) + fx*grey(row1L + 4*x1);
+            bottomR = (1.0f - fx)*grey(row1R + 4*x0) + fx*grey(row1R + 4*x1);
+            a->resImgL[i*a->w+j] = (uint8_t)((1.0f - fy)*topL + fy*bottomL + 0.5f);
+            a->resImgR[i*a->w+j] = (uint8_t)((1.0f - fy)*topR + fy*bottomR + 0.5f);
+        }
+    }
+}
+
+void cpu_resize(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale)
+{
+    resize_rows_t a = { origImgL, origImgR, resImgL, resImgR, origW, origH, w, scale };
+    thread_pool_run(pool, resize_rows, &a, h, 16);
+}
+
+void cpu_resize_area(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                     uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale)
+{
+    resize_rows_t a = { origImgL, origImgR, resImgL, resImgR, origW, origH, w, scale };
+    thread_pool_run(pool, resize_area_rows, &a, h, 4);
+}
+
+void cpu_resize_bilinear(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                         uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale)
+{
+    resize_rows_t a = { origImgL, origImgR, resImgL, resImgR, origW, origH, w, scale };
+    thread_pool_run(pool, resize_bilinear_rows, &a, h, 16);
+}
+
+
+/******************************************************************************
+ *  ZNCC, one row kernel per instruction set generated from zncc_cpu_lanes.h
+ */
+typedef struct {
+    const float *leftImg, *rightImg;    // padded float planes, column 0 of a row at offset 'pad'
+    uint8_t *dispMap;
+    int32_t w, h, pitch, pad;
+    int32_t halfwinsizex, halfwinsizey, mind, maxd;
+    float winsizearea;
+    const uint8_t *guide;               // parent level disparity map (pyramid), NULL for a full range search
+    int32_t guideW, guideH, band, sign;
+    uint8_t *cost;                      // SGM cost volume, ndisp costs per pixel, NULL = disparity map only
+    int32_t ndisp;
+} zncc_rows_t;
+
+#define SGM_COST_SCALE  127.0f  // costs 0..254 for scores 1..-1, must match sgm.cl
+#define SGM_COST_MAX    255
+
+// 8-bit matching cost of a ZNCC score, same as zncc_cost_volume
+static inline uint8_t sgm_cost(float score)
+{
+    if (score != score)
+        return SGM_COST_MAX;
+    score = score < -1.0f ? -1.0f : (score > 1.0f ? 1.0f : score);
+    return (uint8_t)((1.0f - score)*SGM_COST_SCALE + 0.5f);
+}
+
+// Scalar, also the reference for the vector versions
+#define ZNCC_ROWS           zncc_rows_scalar
+#define ZNCC_TARGET
+#define LANES               1
+#define VEC                 float
+#define VMASK               int
+#define V_LOAD(p)           (*(p))
+#define V_STORE(p, v)       (*(p) = (v))
+#define V_SET1(x)           (x)
+#define V_OFFSETS           0.0f
+#define V_ADD(a, b)         ((a) + (b))
+#define V_SUB(a, b)         ((a) - (b))
+#define V_MUL(a, b)         ((a) * (b))
+#define V_DIV(a, b)         ((a) / (b))
+#define V_SQRT(a)           sqrtf(a)
+#define V_GE(a, b)          ((a) >= (b))
+#define V_LT(a, b)          ((a) < (b))
+#define V_GT(a, b)          ((a) > (b))
+#define V_AND_MASK(a, b)    ((a) && (b))
+#define V_ZERO_UNLESS(v, m) ((m) ? (v) : 0.0f)
+#define V_SELECT(m, a, b)   ((m) ? (a) : (b))
+#include "zncc_cpu_lanes.h"
+
+#if defined(__SSE2__)
+#define ZNCC_ROWS           zncc_rows_sse2
+#define ZNCC_TARGET
+#define LANES               4
+#define VEC                 __m128
+#define VMASK               __m128
+#define V_LOAD(p)           _mm_loadu_ps(p)
+#define V_STORE(p, v)       _mm_storeu_ps(p, v)
+#define V_SET1(x)           _mm_set1_ps(x)
+#define V_OFFSETS           _mm_setr_ps(0, 1, 2, 3)
+#define V_ADD(a, b)         _mm_add_ps(a, b)
+#define V_SUB(a, b)         _mm_sub_ps(a, b)
+#define V_MUL(a, b)         _mm_mul_ps(a, b)
+#define V_DIV(a, b)         _mm_div_ps(a, b)
+#define V_SQRT(a)           _mm_sqrt_ps(a)
+#define V_GE(a, b)          _mm_cmpge_ps(a, b)
+#define V_LT(a, b)          _mm_cmplt_ps(a, b)
+#define V_GT(a, b)          _mm_cmpgt_ps(a, b)
+#define V_AND_MASK(a, b)    _mm_and_ps(a, b)
+#define V_ZERO_UNLESS(v, m) _mm_and_ps(v, m)
+#define V_SELECT(m, a, b)   _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#include "zncc_cpu_lanes.h"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ZNCC_ROWS           zncc_rows_avx2
+#define ZNCC_TARGET         __attribute__((target("avx2")))
+#define LANES               8
+#define VEC                 __m256
+#define VMASK               __m256
+#define V_LOAD(p)           _mm256_loadu_ps(p)
+#define V_STORE(p, v)       _mm256_storeu_ps(p, v)
+#define V_SET1(x)           _mm256_set1_ps(x)
+#define V_OFFSETS           _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+#define V_ADD(a, b)         _mm256_add_ps(a, b)
+#define V_SUB(a, b)         _mm256_sub_ps(a, b)
+#define V_MUL(a, b)         _mm256_mul_ps(a, b)
+#define V_DIV(a, b)         _mm256_div_ps(a, b)
+#define V_SQRT(a)           _mm256_sqrt_ps(a)
+#define V_GE(a, b)          _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define V_LT(a, b)          _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define V_GT(a, b)          _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define V_AND_MASK(a, b)    _mm256_and_ps(a, b)
+#define V_ZERO_UNLESS(v, m) _mm256_and_ps(v, m)
+#define V_SELECT(m, a, b)   _mm256_blendv_ps(b, a, m)
+#include "zncc_cpu_lanes.h"
+#endif
+
+#if defined(__aarch64__)
+static const float neon_offsets[4] = { 0, 1, 2, 3 };
+#define ZNCC_ROWS           zncc_rows_neon
+#define ZNCC_TARGET
+#define LANES               4
+#define VEC                 float32x4_t
+#define VMASK               uint32x4_t
+#define V_LOAD(p)           vld1q_f32(p)
+#define V_STORE(p, v)       vst1q_f32(p, v)
+#define V_SET1(x)           vdupq_n_f32(x)
+#define V_OFFSETS           vld1q_f32(neon_offsets)
+#define V_ADD(a, b)         vaddq_f32(a, b)
+#define V_SUB(a, b)         vsubq_f32(a, b)
+#define V_MUL(a, b)         vmulq_f32(a, b)
+#define V_DIV(a, b)         vdivq_f32(a, b)
+#define V_SQRT(a)           vsqrtq_f32(a)
+#define V_GE(a, b)          vcgeq_f32(a, b)
+#define V_LT(a, b)          vcltq_f32(a, b)
+#define V_GT(a, b)          vcgtq_f32(a, b)
+#define V_AND_MASK(a, b)    vandq_u32(a, b)
+#define V_ZERO_UNLESS(v, m) vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), m))
+#define V_SELECT(m, a, b)   vbslq_f32(m, a, b)
+#include "zncc_cpu_lanes.h"
+#endif
+
+static thread_pool_fn zncc_rows_select(const char **name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return zncc_rows_avx2;
+    }
+#endif
+#if defined(__SSE2__)
+    *name = "sse2";
+    return zncc_rows_sse2;
+#elif defined(__aarch64__)
+    *name = "neon";
+    return zncc_rows_neon;
+#else
+    *name = "scalar";
+    return zncc_rows_scalar;
+#endif
+}
+
+const char *cpu_simd_name(void)
+{
+    const char *name;
+    if (getenv("ZNCC_CPU_SCALAR"))
+        return "scalar";
+    zncc_rows_select(&name);
+    return name;
+}
+
+// Zero padded float copy of a grey image, 'pad' columns on both sides of every row
+static float *padded_plane(const uint8_t *img, uint32_t w, uint32_t h, int32_t pad)
+{
+    uint32_t i, j;
+    const int32_t pitch = w + 2*pad;
+    float *res = (float*) calloc((size_t)pitch*h + ZNCC_MAX_LANES, sizeof(float));
+    if (!res) {
+        perror("Fail to create the padded image, can not allocation memory !");
+        abort();
+    }
+    for (i = 0; i < h; i++)
+        for (j = 0; j < w; j++)
+            res[i*pitch + pad + j] = img[i*w + j];
+    return res;
+}
+
+static void zncc_pass(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap, uint8_t *cost, uint32_t w, uint32_t h,
+                      int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd,
+                      const uint8_t *guide, uint32_t guideW, uint32_t guideH, int32_t band)
+{
+    const char *name;
+    thread_pool_fn rows = getenv("ZNCC_CPU_SCALAR") ? zncc_rows_scalar : zncc_rows_select(&name);
+    const int32_t range = abs(mind) > abs(maxd) ? abs(mind) : abs(maxd);
+    zncc_rows_t a;
+
+    // Every lane of every load stays inside its padded row, masked lanes read zeros
+    a.pad          = halfwinsizex + range + ZNCC_MAX_LANES;
+    a.pitch        = w + 2*a.pad;
+    a.leftImg      = padded_plane(leftImg,  w, h, a.pad);
+    a.rightImg     = padded_plane(rightImg, w, h, a.pad);
+    a.dispMap      = dispMap;
+    a.w            = w;
+    a.h            = h;
+    a.halfwinsizex = halfwinsizex;
+    a.halfwinsizey = halfwinsizey;
+    a.mind         = mind;
+    a.maxd         = maxd;
+    a.winsizearea  = (float)winsizearea;
+    a.guide        = guide;
+    a.guideW       = guideW;
+    a.guideH       = guideH;
+    a.band         = band;
+    a.sign         = mind < 0 ? -1 : 1;
+    a.cost         = cost;
+    a.ndisp        = maxd - mind + 1;
+
+    thread_pool_run(pool, rows, &a, h, ZNCC_ROW_BAND);
+
+    free((void*)a.leftImg);
+    free((void*)a.rightImg);
+}
+
+void cpu_zncc_guided(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap, uint32_t w, uint32_t h,
+                     int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd,
+                     const uint8_t *guide, uint32_t guideW, uint32_t guideH, int32_t band)
+{
+    zncc_pass(pool, leftImg, rightImg, dispMap, NULL, w, h, halfwinsizex, halfwinsizey, winsizearea, mind, maxd, guide, guideW, guideH, band);
+}
+
+void cpu_zncc(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap, uint32_t w, uint32_t h,
+              int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd)
+{
+    cpu_zncc_guided(pool, leftImg, rightImg, dispMap, w, h, halfwinsizex, halfwinsizey, winsizearea, mind, maxd, NULL, 0, 0, 0);
+}
+
+void cpu_zncc_cost_volume(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *cost, uint32_t w, uint32_t h,
+                          int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd)
+{
+    zncc_pass(pool, leftImg, rightImg, NULL, cost, w, h, halfwinsizex, halfwinsizey, winsizearea, mind, maxd, NULL, 0, 0, 0);
+}
+
+
+/******************************************************************************
+ *  Coarse-to-fine ZNCC, same levels as zncc_pyramid.cl
+ */
+typedef struct {
+    const uint8_t *src;
+    uint8_t *dst;
+    uint32_t w;
+} downsample_rows_t;
+
+static void downsample_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const downsample_rows_t *a = (const downsample_rows_t*) arg;
+    const uint32_t w = a->w, dw = a->w/2;
+    uint32_t i, j;
+    for (i = begin; i < end; i++)
+        for (j = 0; j < dw; j++)
+            a->dst[i*dw + j] = (a->src[(2*i)*w + 2*j] + a->src[(2*i)*w + 2*j+1] + a->src[(2*i+1)*w + 2*j] + a->src[(2*i+1)*w + 2*j+1] + 2)/4;
+}
+
+void cpu_zncc_pyramid(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap1, uint8_t *dispMap2, uint32_t w, uint32_t h,
+                      int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t maxd, uint32_t levels, int32_t band)
+{
+    const uint8_t *imgL[ZNCC_PYRAMID_MAX_LEVELS], *imgR[ZNCC_PYRAMID_MAX_LEVELS];
+    uint8_t *disp1[ZNCC_PYRAMID_MAX_LEVELS], *disp2[ZNCC_PYRAMID_MAX_LEVELS];
+    uint32_t lw[ZNCC_PYRAMID_MAX_LEVELS], lh[ZNCC_PYRAMID_MAX_LEVELS];
+    int32_t l, ld;
+    downsample_rows_t ds;
+
+    levels = zncc_pyramid_levels(levels, w, h, halfwinsizex, halfwinsizey);
+    imgL[0]  = leftImg;
+    imgR[0]  = rightImg;
+    disp1[0] = dispMap1;
+    disp2[0] = dispMap2;
+    lw[0]    = w;
+    lh[0]    = h;
+    for (l = 1; l < (int32_t)levels; l++) {
+        lw[l]    = lw[l-1]/2;
+        lh[l]    = lh[l-1]/2;
+        imgL[l]  = (uint8_t*) malloc(lw[l]*lh[l]);
+        imgR[l]  = (uint8_t*) malloc(lw[l]*lh[l]);
+        disp1[l] = (uint8_t*) malloc(lw[l]*lh[l]);
+        disp2[l] = (uint8_t*) malloc(lw[l]*lh[l]);
+        if (!imgL[l] || !imgR[l] || !disp1[l] || !disp2[l]) {
+            perror("Fail to build the pyramid, can not allocation memory !");
+            abort();
+        }
+        ds = (downsample_rows_t){ imgL[l-1], (uint8_t*)imgL[l], lw[l-1] };
+        thread_pool_run(pool, downsample_rows, &ds, lh[l], 16);
+        ds = (downsample_rows_t){ imgR[l-1], (uint8_t*)imgR[l], lw[l-1] };
+        thread_pool_run(pool, downsample_rows, &ds, lh[l], 16);
+    }
+
+    // Full range on the coarsest level, then refine around the upsampled parent disparity
+    l  = levels - 1;
+    ld = (maxd + (1 << l) - 1) >> l;
+    cpu_zncc(pool, imgL[l], imgR[l], disp1[l], lw[l], lh[l], halfwinsizex, halfwinsizey, winsizearea, 0, ld);
+    cpu_zncc(pool, imgR[l], imgL[l], disp2[l], lw[l], lh[l], halfwinsizex, halfwinsizey, winsizearea, -ld, 0);
+    for (l = levels - 2; l >= 0; l--) {
+        ld = (maxd + (1 << l) - 1) >> l;
+        cpu_zncc_guided(pool, imgL[l], imgR[l], disp1[l], lw[l], lh[l], halfwinsizex, halfwinsizey, winsizearea, 0, ld, disp1[l+1], lw[l+1], lh[l+1], band);
+        cpu_zncc_guided(pool, imgR[l], imgL[l], disp2[l], lw[l], lh[l], halfwinsizex, halfwinsizey, winsizearea, -ld, 0, disp2[l+1], lw[l+1], lh[l+1], band);
+    }
+
+    for (l = 1; l < (int32_t)levels; l++) {
+        free((void*)imgL[l]);
+        free((void*)imgR[l]);
+        free(disp1[l]);
+        free(disp2[l]);
+    }
+}
+
+uint32_t zncc_pyramid_levels(uint32_t levels, uint32_t w, uint32_t h, int32_t halfwinsizex, int32_t halfwinsizey)
+{
+    uint32_t l = 1;
+    if (levels > ZNCC_PYRAMID_MAX_LEVELS)
+        levels = ZNCC_PYRAMID_MAX_LEVELS;
+    // Stop before the coarsest level gets smaller than one window
+    while (l < levels && (w >> l) > (uint32_t)2*halfwinsizex && (h >> l) > (uint32_t)2*halfwinsizey)
+        l++;
+    return l;
+}
+
+
+/******************************************************************************
+ *  Census matching cost, same as census.cl. The window sums of every disparity
+ *  are kept as column sums over the window rows, slid down one row at a time,
+ *  and read from prefix sums along the row: O(ndisp) per pixel instead of
+ *  O(ndisp x window). Integer sums, so the maps match the kernels bit for bit.
+ */
+#define CENSUS_ROW_BAND     16  // rows per band, the column sums are rebuilt at the top of every band
+
+typedef struct {
+    const uint8_t *img;
+    uint64_t *census;
+    int32_t w, h;
+} census_rows_t;
+
+static void census_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const census_rows_t *a = (const census_rows_t*) arg;
+    int32_t i, j, ii, jj, y, x;
+    uint64_t bits;
+    uint8_t centre;
+    for (i = begin; i < (int32_t)end; i++) {
+        for (j = 0; j < a->w; j++) {
+            centre = a->img[i*a->w + j];
+            bits = 0;
+            for (ii = -CENSUS_HALFWINSIZEY; ii <= CENSUS_HALFWINSIZEY; ii++) {
+                for (jj = -CENSUS_HALFWINSIZEX; jj <= CENSUS_HALFWINSIZEX; jj++) {
+                    if (ii == 0 && jj == 0)
+                        continue;
+                    y = i + ii;
+                    x = j + jj;
+                    bits <<= 1;
+                    if (0 <= y && y < a->h && 0 <= x && x < a->w)
+                        bits |= a->img[y*a->w + x] < centre;
+                }
+            }
+            a->census[i*a->w + j] = bits;
+        }
+    }
+}
+
+void cpu_census(thread_pool_t *pool, const uint8_t *img, uint64_t *census, uint32_t w, uint32_t h)
+{
+    census_rows_t a = { img, census, (int32_t)w, (int32_t)h };
+    thread_pool_run(pool, census_rows, &a, h, CENSUS_ROW_BAND);
+}
+
+typedef struct {
+    const uint64_t *censusL, *censusR;
+    uint8_t *dispMap;
+    int32_t w, h, halfwinsizex, halfwinsizey, mind, maxd;
+} census_match_rows_t;
+
+// Adds (add = 1) or removes the distances of row r to the column sums of every disparity
+static inline __attribute__((always_inline)) void census_column_sums(const census_match_rows_t *a, uint32_t *colCost, int32_t r, int32_t add)
+{
+    const uint64_t *rowL = a->censusL + (size_t)r*a->w, *rowR = a->censusR + (size_t)r*a->w;
+    int32_t d, x, x1;
+    uint32_t *col;
+    for (d = a->mind; d <= a->maxd; d++) {
+        col = colCost + (size_t)(d - a->mind)*a->w;
+        x1  = imin(a->w, a->w + d);
+        if (add)
+            for (x = imax(0, d); x < x1; x++)
+                col[x] += (uint32_t)__builtin_popcountll(rowL[x] ^ rowR[x - d]);
+        else
+            for (x = imax(0, d); x < x1; x++)
+                col[x] -= (uint32_t)__builtin_popcountll(rowL[x] ^ rowR[x - d]);
+    }
+}
+
+static inline __attribute__((always_inline)) void census_match_body(const census_match_rows_t *a, uint32_t begin, uint32_t end)
+{
+    const int32_t w = a->w, h = a->h, ndisp = a->maxd - a->mind + 1;
+    uint32_t *colCost   = (uint32_t*) calloc((size_t)ndisp*w, sizeof(uint32_t));
+    uint32_t *prefix    = (uint32_t*) malloc((w + 1)*sizeof(uint32_t));
+    uint32_t *bestCost  = (uint32_t*) malloc(w*sizeof(uint32_t));
+    uint32_t *bestCount = (uint32_t*) malloc(w*sizeof(uint32_t));
+    int32_t *bestD      = (int32_t*) malloc(w*sizeof(int32_t));
+    int32_t i, j, d, r, x, lo, hi, prevLo, prevHi, xa, xb;
+    uint32_t cost, count;
+    const uint32_t *col;
+
+    if (!colCost || !prefix || !bestCost || !bestCount || !bestD) {
+        perror("Fail to allocate the census window sums, can not allocation memory !");
+        abort();
+    }
+    // Window rows [lo, hi) of the row, the column sums start empty at the top of the band
+    prevLo = prevHi = imax(0, (int32_t)begin - a->halfwinsizey);
+    for (i = begin; i < (int32_t)end; i++) {
+        lo = imax(0, i - a->halfwinsizey);
+        hi = imin(h, i + a->halfwinsizey);
+        for (r = prevHi; r < hi; r++)
+            census_column_sums(a, colCost, r, 1);
+        for (r = prevLo; r < lo; r++)
+            census_column_sums(a, colCost, r, 0);
+        prevLo = lo;
+        prevHi = hi;
+
+        for (j = 0; j < w; j++) {
+            bestCost[j]  = 1;
+            bestCount[j] = 0;
+            bestD[j]     = a->maxd;
+        }
+        for (d = a->mind; d <= a->maxd; d++) {
+            col = colCost + (size_t)(d - a->mind)*w;
+            prefix[0] = 0;
+            for (x = 0; x < w; x++)
+                prefix[x+1] = prefix[x] + col[x];
+            for (j = 0; j < w; j++) {
+                // Columns of the window inside both images
+                xa = imax(j - a->halfwinsizex, imax(0, d));
+                xb = imin(j + a->halfwinsizex, imin(w, w + d));
+                if (xa >= xb)
+                    continue;
+                cost  = prefix[xb] - prefix[xa];
+                count = (uint32_t)((hi - lo)*(xb - xa));
+                if (cost*bestCount[j] < bestCost[j]*count) {
+                    bestCost[j]  = cost;
+                    bestCount[j] = count;
+                    bestD[j]     = d;
+                }
+            }
+        }
+        for (j = 0; j < w; j++)
+            a->dispMap[i*w + j] = (uint8_t)abs(bestD[j]);
+    }
+    free(colCost);
+    free(prefix);
+    free(bestCost);
+    free(bestCount);
+    free(bestD);
+}
+
+static void census_match_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    census_match_body((const census_match_rows_t*) arg, begin, end);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Same with the popcnt instruction instead of the generic bit count
+__attribute__((target("popcnt"))) static void census_match_rows_popcnt(void *arg, uint32_t begin, uint32_t end)
+{
+    census_match_body((const census_match_rows_t*) arg, begin, end);
+}
+#endif
+
+void cpu_census_match(thread_pool_t *pool, const uint64_t *censusL, const uint64_t *censusR, uint8_t *dispMap, uint32_t w, uint32_t h,
+                      int32_t halfwinsizex, int32_t halfwinsizey, int32_t mind, int32_t maxd)
+{
+    census_match_rows_t a = { censusL, censusR, dispMap, (int32_t)w, (int32_t)h, halfwinsizex, halfwinsizey, mind, maxd };
+    thread_pool_fn rows = census_match_rows;
+#if defined(__x86_64__) || defined(__i386__)
+    if (!getenv("ZNCC_CPU_SCALAR") && __builtin_cpu_supports("popcnt"))
+        rows = census_match_rows_popcnt;
+#endif
+    thread_pool_run(pool, rows, &a, h, CENSUS_ROW_BAND);
+}
+
+
+/******************************************************************************
+ *  Semi-global matching, same as sgm.cl. Every direction is split over its
+ *  scanlines (they visit disjoint pixels), a scanline walks its pixels with the
+ *  L values of the previous one in a padded row, the disparities of a pixel are
+ *  contiguous in the cost volume so one step is a few 16-bit vector operations.
+ *  All L values stay below 0x7fff, signed 16-bit minimums are exact.
+ */
+#define SGM_ROW_BAND    16      // scanlines per band
+#define SGM_SENTINEL    0x3fff  // L of the disparities around the range
+
+typedef struct {
+    const uint8_t *cost;
+    uint16_t *sum;
+    int32_t w, h, ndisp, dx, dy, P1, P2, first;
+} sgm_lines_t;
+
+// L of one pixel from the previous one (prev[-1] & prev[ndisp] are sentinels) from disparity d on, returns their minimum
+static inline __attribute__((always_inline)) uint16_t sgm_step_scalar(const sgm_lines_t *a, const uint8_t *cost, const uint16_t *prev, uint16_t *cur,
+                                                                      uint16_t *sum, int32_t d, uint16_t prevMin, uint16_t curMin)
+{
+    uint16_t m, t, l;
+    for (; d < a->ndisp; d++) {
+        m = prev[d];
+        t = (uint16_t)(prev[d-1] + a->P1);
+        m = t < m ? t : m;
+        t = (uint16_t)(prev[d+1] + a->P1);
+        m = t < m ? t : m;
+        t = (uint16_t)(prevMin + a->P2);
+        m = t < m ? t : m;
+        l = (uint16_t)(cost[d] + m - prevMin);
+        cur[d] = l;
+        sum[d] = a->first ? l : (uint16_t)(sum[d] + l);
+        curMin = l < curMin ? l : curMin;
+    }
+    return curMin;
+}
+
+static uint16_t sgm_step_generic(const sgm_lines_t *a, const uint8_t *cost, const uint16_t *prev, uint16_t *cur, uint16_t *sum, uint16_t prevMin)
+{
+    return sgm_step_scalar(a, cost, prev, cur, sum, 0, prevMin, 0x7fff);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint16_t sgm_step_sse2(const sgm_lines_t *a, const uint8_t *cost, const uint16_t *prev, uint16_t *cur, uint16_t *sum, uint16_t prevMin)
+{
+    const __m128i p1 = _mm_set1_epi16(a->P1), jump = _mm_set1_epi16(prevMin + a->P2), pm = _mm_set1_epi16(prevMin), zero = _mm_setzero_si128();
+    __m128i m, l, mins = _mm_set1_epi16(0x7fff);
+    uint16_t lanes[8], curMin = 0x7fff;
+    int32_t d, k;
+    for (d = 0; d + 8 <= a->ndisp; d += 8) {
+        m = _mm_loadu_si128((const __m128i*)(prev + d));
+        m = _mm_min_epi16(m, _mm_add_epi16(_mm_loadu_si128((const __m128i*)(prev + d - 1)), p1));
+        m = _mm_min_epi16(m, _mm_add_epi16(_mm_loadu_si128((const __m128i*)(prev + d + 1)), p1));
+        m = _mm_min_epi16(m, jump);
+        l = _mm_add_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cost + d)), zero), _mm_sub_epi16(m, pm));
+        _mm_storeu_si128((__m128i*)(cur + d), l);
+        _mm_storeu_si128((__m128i*)(sum + d), a->first ? l : _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sum + d)), l));
+        mins = _mm_min_epi16(mins, l);
+    }
+    _mm_storeu_si128((__m128i*)lanes, mins);
+    for (k = 0; k < 8; k++)
+        curMin = lanes[k] < curMin ? lanes[k] : curMin;
+    return sgm_step_scalar(a, cost, prev, cur, sum, d, prevMin, curMin);
+}
+
+__attribute__((target("avx2"))) static uint16_t sgm_step_avx2(const sgm_lines_t *a, const uint8_t *cost, const uint16_t *prev, uint16_t *cur,
+                                                             uint16_t *sum, uint16_t prevMin)
+{
+    const __m256i p1 = _mm256_set1_epi16(a->P1), jump = _mm256_set1_epi16(prevMin + a->P2), pm = _mm256_set1_epi16(prevMin);
+    __m256i m, l, mins = _mm256_set1_epi16(0x7fff);
+    uint16_t lanes[16], curMin = 0x7fff;
+    int32_t d, k;
+    for (d = 0; d + 16 <= a->ndisp; d += 16) {
+        m = _mm256_loadu_si256((const __m256i*)(prev + d));
+        m = _mm256_min_epi16(m, _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(prev + d - 1)), p1));
+        m = _mm256_min_epi16(m, _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(prev + d + 1)), p1));
+        m = _mm256_min_epi16(m, jump);
+        l = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(cost + d))), _mm256_sub_epi16(m, pm));
+        _mm256_storeu_si256((__m256i*)(cur + d), l);
+        _mm256_storeu_si256((__m256i*)(sum + d), a->first ? l : _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(sum + d)), l));
+        mins = _mm256_min_epi16(mins, l);
+    }
+    _mm256_storeu_si256((__m256i*)lanes, mins);
+    for (k = 0; k < 16; k++)
+        curMin = lanes[k] < curMin ? lanes[k] : curMin;
+    return sgm_step_scalar(a, cost, prev, cur, sum, d, prevMin, curMin);
+}
+#endif
+
+typedef uint16_t (*sgm_step_fn)(const sgm_lines_t *a, const uint8_t *cost, const uint16_t *prev, uint16_t *cur, uint16_t *sum, uint16_t prevMin);
+
+static sgm_step_fn sgm_step_select(void)
+{
+    if (getenv("ZNCC_CPU_SCALAR"))
+        return sgm_step_generic;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return sgm_step_avx2;
+    return sgm_step_sse2;
+#else
+    return sgm_step_generic;
+#endif
+}
+
+static void sgm_lines(void *arg, uint32_t begin, uint32_t end)
+{
+    const sgm_lines_t *a = (const sgm_lines_t*) arg;
+    const sgm_step_fn step = sgm_step_select();
+    // Scanlines start on the image border the direction comes from: a row of starts when dy != 0, a column when dx != 0
+    const int32_t rowStarts = a->dy ? a->w : 0;
+    uint16_t *rows = (uint16_t*) malloc(2*(a->ndisp + 2)*sizeof(uint16_t));
+    uint16_t *prev, *cur, *swap, prevMin;
+    int32_t line, i, j, d;
+    size_t idx;
+
+    if (!rows) {
+        perror("Fail to allocate the SGM scanline, can not allocation memory !");
+        abort();
+    }
+    for (line = begin; line < (int32_t)end; line++) {
+        if (line < rowStarts) {
+            i = a->dy > 0 ? 0 : a->h - 1;
+            j = line;
+        } else {
+            // The corner is already a row start
+            i = line - rowStarts + (a->dy > 0);
+            j = a->dx > 0 ? 0 : a->w - 1;
+        }
+        // L of the pixel before the first one: 0, so that the first L is its cost
+        prev = rows + 1;
+        cur  = rows + a->ndisp + 3;
+        for (d = 0; d < a->ndisp; d++)
+            prev[d] = 0;
+        prev[-1] = prev[a->ndisp] = cur[-1] = cur[a->ndisp] = SGM_SENTINEL;
+        prevMin = 0;
+        while (0 <= i && i < a->h && 0 <= j && j < a->w) {
+            idx     = ((size_t)i*a->w + j)*a->ndisp;
+            prevMin = step(a, a->cost + idx, prev, cur, a->sum + idx, prevMin);
+            swap = prev;
+            prev = cur;
+            cur  = swap;
+            i += a->dy;
+            j += a->dx;
+        }
+    }
+    free(rows);
+}
+
+void cpu_sgm_aggregate(thread_pool_t *pool, const uint8_t *cost, uint16_t *sum, uint32_t w, uint32_t h, int32_t mind, int32_t maxd,
+                       int32_t paths, int32_t P1, int32_t P2)
+{
+    // Left to right, right to left, top to bottom, bottom to top, then the diagonals
+    static const int32_t directions[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1} };
+    sgm_lines_t a = { cost, sum, (int32_t)w, (int32_t)h, maxd - mind + 1, 0, 0, P1, P2, 1 };
+    int32_t r;
+
+    for (r = 0; r < paths; r++) {
+        a.dx    = directions[r][0];
+        a.dy    = directions[r][1];
+        a.first = r == 0;
+        thread_pool_run(pool, sgm_lines, &a, (a.dy ? w : 0) + (a.dx ? (a.dy ? h - 1 : h) : 0), SGM_ROW_BAND);
+    }
+}
+
+typedef struct {
+    const uint16_t *sum;
+    uint8_t *dispMap;
+    int32_t w, mind, maxd;
+} sgm_select_rows_t;
+
+static void sgm_select_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const sgm_select_rows_t *a = (const sgm_select_rows_t*) arg;
+    const int32_t ndisp = a->maxd - a->mind + 1;
+    const uint16_t *sums;
+    uint32_t i, best;
+    int32_t j, d, best_d;
+    for (i = begin; i < end; i++) {
+        for (j = 0; j < a->w; j++) {
+            sums   = a->sum + ((size_t)i*a->w + j)*ndisp;
+            best_d = a->maxd;
+            best   = 0x10000;
+            for (d = 0; d < ndisp; d++) {
+                if (sums[d] < best) {
+                    best   = sums[d];
+                    best_d = a->mind + d;
+                }
+            }
+            a->dispMap[i*a->w + j] = (uint8_t)abs(best_d);
+        }
+    }
+}
+
+void cpu_sgm_select(thread_pool_t *pool, const uint16_t *sum, uint8_t *dispMap, uint32_t w, uint32_t h, int32_t mind, int32_t maxd)
+{
+    sgm_select_rows_t a = { sum, dispMap, (int32_t)w, mind, maxd };
+    thread_pool_run(pool, sgm_select_rows, &a, h, 16);
+}
+
+
+/******************************************************************************
+ *  Cross checking, same as cross_check.cl over the flattened maps
+ */
+typedef struct {
+    const uint8_t *dispMap1, *dispMap2;
+    uint8_t *res;
+    uint32_t w, threshold;
+} cross_check_rows_t;
+
+static void cross_check_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const cross_check_rows_t *a = (const cross_check_rows_t*) arg;
+    int32_t i;
+    // Checking abs(diff(dispMap1 & dispMap2)) at each pixels
+    // Dispose all the diff exceed threshold values at each pixels
+    for (i = begin*a->w; i < (int32_t)(end*a->w); i++) {
+        if (i - a->dispMap1[i] < 0 || (uint32_t)abs((int32_t)a->dispMap1[i] - a->dispMap2[i - a->dispMap1[i]]) > a->threshold)
+            a->res[i] = 0;
+        else
+            a->res[i] = a->dispMap1[i];
+    }
+}
+
+void cpu_cross_check(thread_pool_t *pool, const uint8_t *dispMap1, const uint8_t *dispMap2, uint8_t *res, uint32_t w, uint32_t h, uint32_t threshold)
+{
+    cross_check_rows_t a = { dispMap1, dispMap2, res, w, threshold };
+    thread_pool_run(pool, cross_check_rows, &a, h, 32);
+}
+
+
+/******************************************************************************
+ *  Subpixel refinement, same as subpixel.cl: parabola through the ZNCC scores
+ *  at d-1, d, d+1 of every cross checked pixel
+ */
+typedef struct {
+    const uint8_t *leftImg, *rightImg, *dispMap;
+    float *delta;
+    int32_t w, h, halfwinsizex, halfwinsizey, winsizearea, mind, maxd;
+} subpixel_rows_t;
+
+static float zncc_score(const subpixel_rows_t *a, int32_t i, int32_t j, int32_t d)
+{
+    const int32_t w = a->w;
+    // Rows & columns of the window inside both images
+    const int32_t r0 = imax(-a->halfwinsizey, -i);
+    const int32_t r1 = imin(a->halfwinsizey, a->h - i);
+    const int32_t c0 = imax(-j, d - j);
+    const int32_t c1 = imin(w - j, w - j + d);
+    int32_t ii, jj;
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation, currZNCC;
+
+    avgLeft = avgRight = 0;
+    for (ii = r0; ii < r1; ii++) {
+        for (jj = -a->halfwinsizex; jj < a->halfwinsizex; jj++) {
+            if (c0 <= jj && jj < c1) {
+                avgLeft  += a->leftImg [(i+ii)*w + (j+jj)];
+                avgRight += a->rightImg[(i+ii)*w + (j+jj-d)];
+            }
+        }
+    }
+    avgLeft  /= a->winsizearea;
+    avgRight /= a->winsizearea;
+    leftStdDeviation = rightStdDeviation = currZNCC = 0;
+
+    for (ii = r0; ii < r1; ii++) {
+        for (jj = -a->halfwinsizex; jj < a->halfwinsizex; jj++) {
+            if (c0 <= jj && jj < c1) {
+                leftWinValue       = a->leftImg[(i+ii)*w + (j+jj)] - avgLeft;
+                rightWinValue      = a->rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
+                currZNCC          += leftWinValue*rightWinValue;
+                leftStdDeviation  += leftWinValue*leftWinValue;
+                rightStdDeviation += rightWinValue*rightWinValue;
+            }
+        }
+    }
+    return currZNCC/(sqrtf(leftStdDeviation)*sqrtf(rightStdDeviation));
+}
+
+static void subpixel_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const subpixel_rows_t *a = (const subpixel_rows_t*) arg;
+    int32_t i, j, d;
+    float prev, curr, next, curvature;
+
+    for (i = begin; i < (int32_t)end; i++) {
+        for (j = 0; j < a->w; j++) {
+            d = a->dispMap[i*a->w+j];
+            a->delta[i*a->w+j] = 0;
+            if (d == 0 || d - 1 < a->mind || d + 1 > a->maxd)
+                continue;
+            prev = zncc_score(a, i, j, d - 1);
+            curr = zncc_score(a, i, j, d);
+            next = zncc_score(a, i, j, d + 1);
+            // Peak of the parabola through the three scores, only when d is a maximum (a NaN score fails the tests)
+            curvature = prev - 2*curr + next;
+            if (curvature < 0 && curr >= prev && curr >= next)
+                a->delta[i*a->w+j] = fminf(fmaxf((prev - next)/(2*curvature), -0.5f), 0.5f);
+        }
+    }
+}
+
+void cpu_subpixel(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, const uint8_t *dispMap, float *delta, uint32_t w, uint32_t h,
+                  int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd)
+{
+    subpixel_rows_t a = { leftImg, rightImg, dispMap, delta, w, h, halfwinsizex, halfwinsizey, winsizearea, mind, maxd };
+    thread_pool_run(pool, subpixel_rows, &a, h, ZNCC_ROW_BAND);
+}
+
+
+/******************************************************************************
+ *  Replace each pixel with zero value with the nearest non-zero pixel value,
+ *  searched on square rings of growing size k around it: O(k^2) per pixel
+ */
+typedef struct {
+    const uint8_t *dispMap;
+    uint8_t *result;
+    uint32_t w, h;
+} occlusion_rows_t;
+
+static void occlusion_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const occlusion_rows_t *a = (const occlusion_rows_t*) arg;
+    const uint8_t *dispMap = a->dispMap;
+    uint8_t *result = a->result;
+    const int32_t w = a->w, h = a->h;
+    int32_t i, j, ii, jj, k;
+    bool flag; // flag for nearest non-zero pixel value
+
+    for (i = begin; i < (int32_t)end; i++) {
+        for (j = 0; j < w; j++) {
+            // If the value of the pixel is zero, perform the occlusion filling by nearest non-zero pixel value
+            result[i*w+j] = dispMap[i*w+j];
+            if(dispMap[i*w+j] == 0) {
+                // Search of non-zero pixel in the neighborhood i,j, neighborhoodsize++
+                flag = true;
+                k = 0;
+                while(flag) {
+                    k++;
+                    jj = -k;
+                    for (ii = -k; ii <= k && flag; ii++) {
+                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
+                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
+                            flag = false;
+                            break;
+                        }
+                    }
+                    jj = k;
+                    for (ii = -k; ii <= k && flag; ii++) {
+                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
+                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
+                            flag = false;
+                            break;
+                        }
+                    }
+                    ii = -k;
+                    for (jj = -k+1; jj <= k-1 && flag; jj++) {
+                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
+                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
+                            flag = false;
+                            break;
+                        }
+                    }
+                    ii = k;
+                    for (jj = -k+1; jj <= k && flag; jj++) {
+                        if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && dispMap[(i+ii)*w+(j+jj)]!=0) {
+                            result[i*w+j] = dispMap[(i+ii)*w+(j+jj)];
+                            flag = false;
+                            break;
+                        }
+                    }
+                    // The whole map is zero, nothing to fill with
+                    if (k > w && k > h)
+                        flag = false;
+                }
+            }
+        }
+    }
+}
+
+uint8_t* occlusion_filling_ring(thread_pool_t *pool, const uint8_t* dispMap, uint32_t w, uint32_t h)
+{
+    occlusion_rows_t a = { dispMap, (uint8_t*) malloc(w*h), w, h };
+    if (!a.result) {
+        perror("Fail to fill occlusions, can not allocation memory !");
+        abort();
+    }
+    thread_pool_run(pool, occlusion_rows, &a, h, 8);
+    return a.result;
+}
+
+
+/******************************************************************************
+ *  Same result as occlusion_filling_ring in O(w*h):
+ *  + the ring where the search stops is the chessboard distance k of the pixel to
+ *    the nearest non-zero pixel, given exactly by a two-pass distance transform
+ *  + on that ring the search takes the first non-zero pixel of the left column,
+ *    the right column, the top row then the bottom row, each scanned from its
+ *    lowest index: nextDown / nextRight (first non-zero pixel at or after a given
+ *    row of a column / column of a row) find it without scanning
+ */
+
+typedef struct {
+    const uint8_t *dispMap;
+    uint8_t *result;
+    const int32_t *dist, *nextDown, *nextRight;
+    uint32_t w, h;
+} fill_rows_t;
+
+static void next_right_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const fill_rows_t *a = (const fill_rows_t*) arg;
+    int32_t *nextRight = (int32_t*) a->nextRight;
+    const int32_t w = a->w;
+    int32_t i, j, next;
+    for (i = begin; i < (int32_t)end; i++) {
+        next = w;
+        for (j = w - 1; j >= 0; j--) {
+            if (a->dispMap[i*w+j] != 0)
+                next = j;
+            nextRight[i*w+j] = next;
+        }
+    }
+}
+
+static void fill_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    const fill_rows_t *a = (const fill_rows_t*) arg;
+    const uint8_t *dispMap = a->dispMap;
+    const int32_t w = a->w, h = a->h;
+    int32_t i, j, k, lo, hi, r, c;
+
+    for (i = begin; i < (int32_t)end; i++) {
+        for (j = 0; j < w; j++) {
+            a->result[i*w+j] = dispMap[i*w+j];
+            k = a->dist[i*w+j];
+            if (k == 0 || k > w + h)        // non-zero pixel, or nothing to fill with
+                continue;
+            lo = imax(i - k, 0);
+            hi = imin(i + k, h - 1);
+            // Left column, then right column, rows i-k..i+k
+            if (j - k >= 0 && (r = a->nextDown[lo*w + j-k]) <= hi) {
+                a->result[i*w+j] = dispMap[r*w + j-k];
+                continue;
+            }
+            if (j + k < w && (r = a->nextDown[lo*w + j+k]) <= hi) {
+                a->result[i*w+j] = dispMap[r*w + j+k];
+                continue;
+            }
+            // Top row, columns j-k+1..j+k-1, then bottom row, columns j-k+1..j+k
+            lo = imax(j - k + 1, 0);
+            if (i - k >= 0 && (c = a->nextRight[(i-k)*w + lo]) <= imin(j + k - 1, w - 1)) {
+                a->result[i*w+j] = dispMap[(i-k)*w + c];
+                continue;
+            }
+            if (i + k < h && (c = a->nextRight[(i+k)*w + lo]) <= imin(j + k, w - 1))
+                a->result[i*w+j] = dispMap[(i+k)*w + c];
+        }
+    }
+}
+
+uint8_t* occlusion_filling(thread_pool_t *pool, const uint8_t* dispMap, uint32_t w, uint32_t h)
+{
+    const int32_t far = w + h + 1;      // farther than any pixel of the map
+    int32_t i, j, d;
+    int32_t *dist      = (int32_t*) malloc(w*h*sizeof(int32_t));
+    int32_t *nextDown  = (int32_t*) malloc(w*h*sizeof(int32_t));
+    int32_t *nextRight = (int32_t*) malloc(w*h*sizeof(int32_t));
+    fill_rows_t a = { dispMap, (uint8_t*) malloc(w*h), dist, nextDown, nextRight, w, h };
+    if (!dist || !nextDown || !nextRight || !a.result) {
+        perror("Fail to fill occlusions, can not allocation memory !");
+        abort();
+    }
+
+    // ******** Chessboard distance transform, forward then backward pass ********
+    for (i = 0; i < (int32_t)h; i++) {
+        for (j = 0; j < (int32_t)w; j++) {
+            d = dispMap[i*w+j] != 0 ? 0 : far;
+            if (d && j > 0)
+                d = imin(d, dist[i*w+j-1] + 1);
+            if (d && i > 0) {
+                d = imin(d, dist[(i-1)*w+j] + 1);
+                if (j > 0)
+                    d = imin(d, dist[(i-1)*w+j-1] + 1);
+                if (j < (int32_t)w - 1)
+                    d = imin(d, dist[(i-1)*w+j+1] + 1);
+            }
+            dist[i*w+j] = d;
+        }
+    }
+    for (i = h - 1; i >= 0; i--) {
+        for (j = w - 1; j >= 0; j--) {
+            d = dist[i*w+j];
+            if (d && j < (int32_t)w - 1)
+                d = imin(d, dist[i*w+j+1] + 1);
+            if (d && i < (int32_t)h - 1) {
+                d = imin(d, dist[(i+1)*w+j] + 1);
+                if (j > 0)
+                    d = imin(d, dist[(i+1)*w+j-1] + 1);
+                if (j < (int32_t)w - 1)
+                    d = imin(d, dist[(i+1)*w+j+1] + 1);
+            }
+            dist[i*w+j] = d;
+        }
+    }
+
+    // ******** First non-zero pixel at or below each row of a column, at or after each column of a row ********
+    for (j = 0; j < (int32_t)w; j++)
+        nextDown[(h-1)*w+j] = dispMap[(h-1)*w+j] != 0 ? (int32_t)h - 1 : (int32_t)h;
+    for (i = h - 2; i >= 0; i--)
+        for (j = 0; j < (int32_t)w; j++)
+            nextDown[i*w+j] = dispMap[i*w+j] != 0 ? i : nextDown[(i+1)*w+j];
+    thread_pool_run(pool, next_right_rows, &a, h, 32);
+
+    thread_pool_run(pool, fill_rows, &a, h, 32);
+    free(dist);
+    free(nextDown);
+    free(nextRight);
+    return a.result;
+}
+
+
+/******************************************************************************
+ *  Normalize the final disparity map, through a 256 entries lookup table
+ */
+typedef struct {
+    uint8_t *dispMap;
+    uint8_t lut[UCHAR_MAX+1];
+    uint32_t w;
+} normalization_rows_t;
+
+static void normalization_rows(void *arg, uint32_t begin, uint32_t end)
+{
+    normalization_rows_t *a = (normalization_rows_t*) arg;
+    uint32_t i;
+    for (i = begin*a->w; i < end*a->w; i++)
+        a->dispMap[i] = a->lut[a->dispMap[i]];
+}
+
+void normalization(thread_pool_t *pool, uint8_t* dispMap, uint32_t w, uint32_t h)
+{
+    uint8_t maxValue = 0, minValue = UCHAR_MAX;
+    uint32_t i;
+    normalization_rows_t a;
+
+    for (i = 0; i < w*h; i++) {
+        if(dispMap[i]>maxValue) {maxValue=dispMap[i];}
+        if(dispMap[i]<minValue) {minValue=dispMap[i];}
+    }
+    // Nomarlize to grey scale 0..255(UCHAR_MAX)
+    maxValue -= minValue;
+    for (i = 0; i <= UCHAR_MAX; i++)
+        a.lut[i] = (i < minValue || maxValue == 0) ? 0 : (UCHAR_MAX*(i - minValue)/maxValue);
+    a.dispMap = dispMap;
+    a.w = w;
+    thread_pool_run(pool, normalization_rows, &a, h, 64);
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ * FILENAME :        zncc_cpu.h
+ *
+ * DESCRIPTION :
+ *       Native CPU backend of the ZNCC pipeline, used when no OpenCL device is
+ *       available (or forced with --backend=cpu).
+ *       + cpu_resize       : resize.cl      (1/DOWNSCALE point sampling + greyscale,
+ *                                            _area & _bilinear for the other filters)
+ *       + cpu_zncc         : zncc.cl        (SSE2/AVX2/NEON, one lane per pixel)
+ *       + cpu_zncc_pyramid : zncc_pyramid.cl (coarse-to-fine search, cpu_zncc_guided per level)
+ *       + cpu_zncc_cost_volume : sgm.cl     (zncc_cost_volume, cpu_zncc storing every score as an 8-bit cost)
+ *       + cpu_sgm_aggregate: sgm.cl         (sgm_aggregate, 4 or 8 paths, SSE2/AVX2 over the disparities)
+ *       + cpu_sgm_select   : sgm.cl         (sgm_select)
+ *       + cpu_census       : census.cl      (census_transform, 62-bit bitstrings)
+ *       + cpu_census_match : census.cl      (census_match, sliding window sums, popcnt)
+ *       + cpu_cross_check  : cross_check.cl
+ *       + cpu_subpixel     : subpixel.cl    (parabola fit of the scores at d-1, d, d+1)
+ *       + occlusion_filling & normalization, host stages shared with the OpenCL backend
+ *         (occlusion_filling_ring is the original nearest non-zero ring search)
+ *       Every stage is split over row bands on a thread_pool_t, the disparity maps
+ *       are bit-identical to the scalar evaluation of the OpenCL kernels with IEEE
+ *       sqrtf; on a device, native_sqrt & native_rsqrt only match them within their
+ *       precision.
+ *
+ * NOTES :
+ *       + Build with -ffp-contract=off so that no multiply-add gets fused.
+ *       + cpu_zncc picks AVX2 at runtime when available, SSE2 / NEON otherwise,
+ *         ZNCC_CPU_SCALAR=1 in the environment forces the scalar reference.
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_CPU_H
+#define ZNCC_CPU_H
+
+#include <stdint.h>
+#include "thread_pool.h"
+
+#define ZNCC_PYRAMID_MAX_LEVELS 6   // pyramid levels including the working resolution
+#define CENSUS_HALFWINSIZEX     4   // census neighbourhood, must match census.cl
+#define CENSUS_HALFWINSIZEY     3
+
+void cpu_resize(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale);
+void cpu_resize_area(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                     uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale);
+void cpu_resize_bilinear(thread_pool_t *pool, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t origW, uint32_t origH,
+                         uint8_t *resImgL, uint8_t *resImgR, uint32_t w, uint32_t h, float scale);
+void cpu_zncc(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap, uint32_t w, uint32_t h,
+              int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd);
+void cpu_zncc_guided(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap, uint32_t w, uint32_t h,
+                     int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd,
+                     const uint8_t *guide, uint32_t guideW, uint32_t guideH, int32_t band);
+void cpu_zncc_pyramid(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *dispMap1, uint8_t *dispMap2, uint32_t w, uint32_t h,
+                      int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t maxd, uint32_t levels, int32_t band);
+uint32_t zncc_pyramid_levels(uint32_t levels, uint32_t w, uint32_t h, int32_t halfwinsizex, int32_t halfwinsizey);
+void cpu_zncc_cost_volume(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, uint8_t *cost, uint32_t w, uint32_t h,
+                          int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd);
+void cpu_sgm_aggregate(thread_pool_t *pool, const uint8_t *cost, uint16_t *sum, uint32_t w, uint32_t h, int32_t mind, int32_t maxd,
+                       int32_t paths, int32_t P1, int32_t P2);
+void cpu_sgm_select(thread_pool_t *pool, const uint16_t *sum, uint8_t *dispMap, uint32_t w, uint32_t h, int32_t mind, int32_t maxd);
+void cpu_census(thread_pool_t *pool, const uint8_t *img, uint64_t *census, uint32_t w, uint32_t h);
+void cpu_census_match(thread_pool_t *pool, const uint64_t *censusL, const uint64_t *censusR, uint8_t *dispMap, uint32_t w, uint32_t h,
+                      int32_t halfwinsizex, int32_t halfwinsizey, int32_t mind, int32_t maxd);
+void cpu_cross_check(thread_pool_t *pool, const uint8_t *dispMap1, const uint8_t *dispMap2, uint8_t *res, uint32_t w, uint32_t h, uint32_t threshold);
+void cpu_subpixel(thread_pool_t *pool, const uint8_t *leftImg, const uint8_t *rightImg, const uint8_t *dispMap, float *delta, uint32_t w, uint32_t h,
+                  int32_t halfwinsizex, int32_t halfwinsizey, int32_t winsizearea, int32_t mind, int32_t maxd);
+
+uint8_t* occlusion_filling(thread_pool_t *pool, const uint8_t* dispMap, uint32_t w, uint32_t h);        // distance transform, O(w*h)
+uint8_t* occlusion_filling_ring(thread_pool_t *pool, const uint8_t* dispMap, uint32_t w, uint32_t h);   // ring search, same result
+void normalization(thread_pool_t *pool, uint8_t* dispMap, uint32_t w, uint32_t h);
+
+const char *cpu_simd_name(void);    // instruction set picked for cpu_zncc on this machine
+
+#endif
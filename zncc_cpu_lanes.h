@@ -0,0 +1,138 @@
+/******************************************************************************
+ * FILENAME :        zncc_cpu_lanes.h
+ *
+ * DESCRIPTION :
+ *       Row kernel of cpu_zncc, included by zncc_cpu.c once per instruction set.
+ *       Every lane evaluates zncc.cl for its own pixel with exactly the same
+ *       sequence of float operations, out-of-window lanes add +0 through a mask,
+ *       so all instruction sets give the same disparity map as the scalar one.
+ *       With a guide map (pyramid refinement) every lane has its own disparity
+ *       range, the block visits the union of them and a lane only takes the
+ *       disparities of its own range. With a cost volume (SGM) every score is
+ *       also stored there as an 8-bit cost, the disparity map is optional.
+ *
+ *       Expects :
+ *         ZNCC_ROWS, ZNCC_TARGET      name and attribute of the generated function
+ *         LANES, VEC, VMASK           pixels per vector, vector and mask types
+ *         V_LOAD, V_STORE, V_SET1, V_OFFSETS ({0, 1, .., LANES-1})
+ *         V_ADD, V_SUB, V_MUL, V_DIV, V_SQRT, V_GE, V_LT, V_GT
+ *         V_AND_MASK, V_ZERO_UNLESS(v, m), V_SELECT(m, a, b)
+ *       and undefines all of them at the end.
+ *
+ ******************************************************************************/
+
+ZNCC_TARGET static void ZNCC_ROWS(void *arg, uint32_t begin, uint32_t end)
+{
+    const zncc_rows_t *a = (const zncc_rows_t*) arg;
+    const int32_t w = a->w, h = a->h, hx = a->halfwinsizex, hy = a->halfwinsizey;
+    const VEC zero = V_SET1(0.0f);
+    const VEC area = V_SET1(a->winsizearea);
+
+    VMASK masks[2*hx];      // columns of the window that exist in both images, per jj
+    float bestD[LANES], rangeLo[LANES], rangeHi[LANES], score[LANES];
+    int32_t i, j, ii, jj, d, k, r0, r1, lo, hi, dmin, dmax, centre;
+    const float *rowL, *rowR;
+    VEC avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation;
+    VEC currZNCC, bestZNCC, best_d, col, dv;
+    VMASK better;
+
+    for (i = (int32_t)begin; i < (int32_t)end; i++) {
+        // Rows of the window inside the image, identical for all lanes
+        r0 = -hy > -i    ? -hy : -i;
+        r1 =  hy < h - i ?  hy : h - i;
+
+        for (j = 0; j < w; j += LANES) {
+            // Disparity range of every lane
+            dmin = a->maxd;
+            dmax = a->mind;
+            for (k = 0; k < LANES; k++) {
+                lo = a->mind;
+                hi = a->maxd;
+                if (a->guide) {
+                    centre = a->sign*2*a->guide[(i/2 < a->guideH ? i/2 : a->guideH-1)*a->guideW + ((j+k)/2 < a->guideW ? (j+k)/2 : a->guideW-1)];
+                    lo = centre - a->band > lo ? centre - a->band : lo;
+                    hi = centre + a->band < hi ? centre + a->band : hi;
+                }
+                rangeLo[k] = (float)lo;
+                rangeHi[k] = (float)hi;
+                dmin = lo < dmin ? lo : dmin;
+                dmax = hi > dmax ? hi : dmax;
+            }
+
+            // Searching for d with best ZNCC score for the each pixels
+            best_d   = V_LOAD(rangeHi);
+            bestZNCC = V_SET1(-1.0f);
+            for (d = dmin; d <= dmax; d++) {
+                lo = d > 0 ? d : 0;
+                hi = d < 0 ? w + d : w;
+                for (jj = -hx; jj < hx; jj++) {
+                    col = V_ADD(V_SET1((float)(j + jj)), V_OFFSETS);
+                    masks[jj+hx] = V_AND_MASK(V_GE(col, V_SET1((float)lo)), V_LT(col, V_SET1((float)hi)));
+                }
+
+                // Calculating the window average
+                avgLeft = avgRight = zero;
+                for (ii = r0; ii < r1; ii++) {
+                    rowL = a->leftImg  + (i+ii)*a->pitch + a->pad + j;
+                    rowR = a->rightImg + (i+ii)*a->pitch + a->pad + j - d;
+                    for (jj = -hx; jj < hx; jj++) {
+                        avgLeft  = V_ADD(avgLeft,  V_ZERO_UNLESS(V_LOAD(rowL + jj), masks[jj+hx]));
+                        avgRight = V_ADD(avgRight, V_ZERO_UNLESS(V_LOAD(rowR + jj), masks[jj+hx]));
+                    }
+                }
+                avgLeft  = V_DIV(avgLeft,  area);
+                avgRight = V_DIV(avgRight, area);
+                leftStdDeviation = rightStdDeviation = currZNCC = zero;
+
+                // Calculate using the ZNCC formula
+                for (ii = r0; ii < r1; ii++) {
+                    rowL = a->leftImg  + (i+ii)*a->pitch + a->pad + j;
+                    rowR = a->rightImg + (i+ii)*a->pitch + a->pad + j - d;
+                    for (jj = -hx; jj < hx; jj++) {
+                        leftWinValue      = V_ZERO_UNLESS(V_SUB(V_LOAD(rowL + jj), avgLeft),  masks[jj+hx]);
+                        rightWinValue     = V_ZERO_UNLESS(V_SUB(V_LOAD(rowR + jj), avgRight), masks[jj+hx]);
+                        currZNCC          = V_ADD(currZNCC,          V_MUL(leftWinValue,  rightWinValue));
+                        leftStdDeviation  = V_ADD(leftStdDeviation,  V_MUL(leftWinValue,  leftWinValue));
+                        rightStdDeviation = V_ADD(rightStdDeviation, V_MUL(rightWinValue, rightWinValue));
+                    }
+                }
+                // Calculate current ZNCC value
+                currZNCC = V_DIV(currZNCC, V_MUL(V_SQRT(leftStdDeviation), V_SQRT(rightStdDeviation)));
+                if (a->cost) {
+                    V_STORE(score, currZNCC);
+                    for (k = 0; k < LANES && j+k < w; k++)
+                        a->cost[((size_t)i*w + j+k)*a->ndisp + (d - a->mind)] = sgm_cost(score[k]);
+                }
+                // Winner-takes-it-all-approach, get d with the best ZNCC value
+                dv       = V_SET1((float)d);
+                better   = V_AND_MASK(V_GT(currZNCC, bestZNCC), V_AND_MASK(V_GE(dv, V_LOAD(rangeLo)), V_GE(V_LOAD(rangeHi), dv)));
+                bestZNCC = V_SELECT(better, currZNCC, bestZNCC);
+                best_d   = V_SELECT(better, dv, best_d);
+            }
+            V_STORE(bestD, best_d);
+            for (k = 0; k < LANES && j+k < w && a->dispMap; k++)
+                a->dispMap[i*w + j+k] = (uint8_t)abs((int32_t)bestD[k]);
+        }
+    }
+}
+
+#undef ZNCC_ROWS
+#undef ZNCC_TARGET
+#undef LANES
+#undef VEC
+#undef VMASK
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_OFFSETS
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_GE
+#undef V_LT
+#undef V_GT
+#undef V_AND_MASK
+#undef V_ZERO_UNLESS
+#undef V_SELECT
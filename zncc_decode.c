@@ -0,0 +1,127 @@
+/******************************************************************************
+ * FILENAME :        zncc_decode.c
+ *
+ * DESCRIPTION :
+ *       Fused PNG decode, greyscale & downscale, see zncc_decode.h
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "lodepng.h"
+#include "zncc_decode.h"
+
+typedef struct {
+    uint8_t *grey;                      // (w/scale) x (h/scale) result
+    uint8_t *rgba;                      // one original row converted to RGBA8
+    uint32_t origW, origH, w, h;
+    float scale;
+    uint32_t next;                      // next row of the result to fill
+    uint32_t error;
+} grey_rows_t;
+
+/******************************************************************************
+ *  Row callback, same sampling & greyscale as resize_rows (zncc_cpu.c)
+ */
+static void grey_row(void *user, unsigned y, const unsigned char *row, unsigned w, const LodePNGColorMode *color)
+{
+    grey_rows_t *a = (grey_rows_t*) user;
+    LodePNGColorMode modeRGBA;
+    uint32_t i, j, x, srcY, converted = 0;
+    const uint8_t *pixel;
+
+    // Several result rows may read the same original row (clamped to the last one)
+    for (i = a->next; i < a->h && !a->error; i++) {
+        srcY = (uint32_t)(a->scale*i) - 1*(i > 0);
+        if (srcY >= a->origH) srcY = a->origH - 1;
+        if (srcY != y)
+            break;
+        if (!converted) {
+            lodepng_color_mode_init(&modeRGBA);     // 8-bit RGBA
+            a->error = lodepng_convert(a->rgba, row, &modeRGBA, color, w, 1);
+            lodepng_color_mode_cleanup(&modeRGBA);
+            converted = 1;
+        }
+        for (j = 0; j < a->w; j++) {
+            x = (uint32_t)(a->scale*j) - 1*(j > 0);
+            if (x >= a->origW) x = a->origW - 1;
+            pixel = a->rgba + 4*x;
+            // Grayscaling, single precision constants
+            a->grey[i*a->w+j] = (uint8_t)(0.2126f*pixel[0] + 0.7152f*pixel[1] + 0.0722f*pixel[2]);
+        }
+    }
+    a->next = i;
+}
+
+uint32_t zncc_decode_grey_file(uint8_t **grey, uint32_t *origW, uint32_t *origH, const char *filename, float scale)
+{
+    const unsigned char *png = NULL;
+    size_t pngsize = 0;
+    unsigned w = 0, h = 0;
+    uint32_t err;
+    LodePNGState state;
+    grey_rows_t a;
+
+    *grey = NULL;
+    err = lodepng_map_file(&png, &pngsize, filename);   // read in place, no copy of the file
+    if (err)
+        return err;
+
+    lodepng_state_init(&state);
+    state.decoder.zlibsettings.fast_inflate = 1;
+    state.decoder.parallel_inflate = 1;   // inflate in a second thread, the rows come out as they are unfiltered
+    err = lodepng_inspect(&w, &h, &state, png, pngsize);
+    if (!err) {
+        a.origW = w;
+        a.origH = h;
+        a.w     = (uint32_t)(w/scale);
+        a.h     = (uint32_t)(h/scale);
+        a.scale = scale;
+        a.next  = 0;
+        a.error = 0;
+        a.grey  = (uint8_t*) malloc((size_t)a.w*a.h + 1);
+        a.rgba  = (uint8_t*) malloc((size_t)w*4);
+        if (!a.grey || !a.rgba) {
+            perror("Fail to decode the image, can not allocation memory !");
+            abort();
+        }
+        err = lodepng_decode_rows(&state, png, pngsize, grey_row, &a, &w, &h);
+        if (!err)
+            err = a.error;
+        free(a.rgba);
+        if (err)
+            free(a.grey);
+        else
+            *grey = a.grey;
+    }
+    lodepng_state_cleanup(&state);
+    lodepng_unmap_file(png, pngsize);
+
+    *origW = w;
+    *origH = h;
+    return err;
+}
+
+uint32_t zncc_decode_rgba_file(uint8_t **image, uint32_t *w, uint32_t *h, const char *filename)
+{
+    const unsigned char *png = NULL;
+    size_t pngsize = 0;
+    unsigned width = 0, height = 0;
+    uint32_t err;
+    LodePNGState state;
+
+    *image = NULL;
+    err = lodepng_map_file(&png, &pngsize, filename);   // read in place, no copy of the file
+    if (!err) {
+        lodepng_state_init(&state);     // 8-bit RGBA output
+        state.decoder.zlibsettings.fast_inflate = 1;
+        state.decoder.parallel_inflate = 1;
+        err = lodepng_decode(image, &width, &height, &state, png, pngsize);
+        lodepng_state_cleanup(&state);
+    }
+    lodepng_unmap_file(png, pngsize);
+
+    *w = width;
+    *h = height;
+    return err;
+}
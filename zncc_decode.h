@@ -0,0 +1,39 @@
+/******************************************************************************
+ * FILENAME :        zncc_decode.h
+ *
+ * DESCRIPTION :
+ *       Fused PNG decode, greyscale & downscale. The rows come out of
+ *       lodepng_decode_rows one by one as they are unfiltered, only the rows
+ *       the 1/scale point sampling of resize.cl reads are converted, so the
+ *       (w/scale) x (h/scale) grey plane is the only image ever allocated.
+ *       + zncc_decode_grey_file : same plane as lodepng_decode32_file followed
+ *                                 by cpu_resize (bit-identical), point sampling
+ *                                 only (RESIZE_POINT)
+ *       + zncc_decode_rgba_file : lodepng_decode32_file with the table-driven
+ *                                 inflate (fast_inflate), same image
+ *
+ * NOTES :
+ *       + The IDAT stream is inflated piece by piece (stream_output): only the
+ *         32 KB deflate window, a ~256 KB piece & the scanline ring are held
+ *         besides the grey plane, neither the inflated scanlines nor the full
+ *         size RGBA image & its upload exist.
+ *       + Both decodes set parallel_inflate: lodepng inflates in a second
+ *         thread while the calling one unfilters & converts the rows.
+ *       + The PNG is mapped (lodepng_map_file) and its IDAT chunks are
+ *         inflated where they are, neither the file nor its concatenated
+ *         IDAT stream is copied.
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_DECODE_H
+#define ZNCC_DECODE_H
+
+#include <stdint.h>
+
+// lodepng error code (0 on success), *origW x *origH is the size of the PNG, *grey to be freed by the caller
+uint32_t zncc_decode_grey_file(uint8_t **grey, uint32_t *origW, uint32_t *origH, const char *filename, float scale);
+
+// lodepng error code (0 on success), *image is the w x h 8-bit RGBA image, to be freed by the caller
+uint32_t zncc_decode_rgba_file(uint8_t **image, uint32_t *w, uint32_t *h, const char *filename);
+
+#endif
@@ -0,0 +1,2191 @@
+/******************************************************************************
+ * FILENAME :        zncc_engine.c
+ *
+ * DESCRIPTION :
+ *       Persistent stereo engine behind zncc_engine.h. The OpenCL context, queue
+ *       and kernels are set up once in zncc_engine_create, the device & host
+ *       buffers once per input size, so a run of pairs only pays for the
+ *       uploads, the kernels and the final readback.
+ *
+ * NOTES :
+ *       + The original images are uploaded into engine-owned images with
+ *         clEnqueueWriteImage instead of wrapping the caller's memory
+ *         (CL_MEM_USE_HOST_PTR), so that they survive across pairs.
+ *       + BACKEND_ALL makes one engine per OpenCL device of every platform plus
+ *         the native CPU backend (workers). Every pair is split into row bands
+ *         sized after the measured rows/s of each worker, the bands run in
+ *         their own threads with the same context rows as the strips below.
+ *       + With params.memoryBudget the correlation buffers only hold a strip of
+ *         the working-size map: the strips go through the backend one after the
+ *         other with halfwinsizey context rows on both sides (the disparity
+ *         search is along the rows, strips keep the whole width), their cross
+ *         checked rows are stitched and occlusion filling & normalization run on
+ *         the host over the whole map.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "thread_pool.h"
+#include "zncc_cpu.h"
+#include "zncc_engine.h"
+#include "kernel_cache.h"
+
+
+#define MAX_WORKERS 16                  // BACKEND_ALL: OpenCL devices + the CPU backend
+
+struct zncc_engine {
+    zncc_params_t params;
+    thread_pool_t *pool;                // host stages & CPU backend
+    int32_t useOpenCL;
+    zncc_engine_t *workers[MAX_WORKERS];    // BACKEND_ALL: one engine per device, they share the rows of every pair
+    uint32_t workerCount;
+    double rowsPerSecond[MAX_WORKERS];  // measured throughput of every worker at the current size, 0 = not measured
+    char name[128];                     // device name, or backend name of the CPU backend
+    int32_t devicePostprocess;          // occlusion filling & normalization kernels, final map read back once
+
+    uint32_t origW, origH;              // input size the buffers are allocated for, 0 = none yet
+    uint32_t Width, Height;             // working (downscaled) size of the buffers, one strip with a memory budget
+    uint32_t mapHeight;                 // working height of the whole map
+    uint32_t stripRows, stripHalo;      // map rows per strip & context rows around them, stripRows = mapHeight: no strips
+    uint32_t stripAlign;                // strip windows start on multiples of it
+    uint32_t bufferRows;                // working rows the buffers hold (Height when they were allocated)
+    uint8_t *dDisparity;                // cross checked disparity map
+    float *delta, *subpixel;            // subpixel offsets of dDisparity, refined map of the last pair
+    uint8_t *map;                       // cross checked strips stitched, strips only
+    float *mapDelta;                    // subpixel offsets of map
+    uint8_t *filled;                    // occlusion filled map read back before the device normalization
+
+    uint8_t *imageL, *imageR;           // CPU backend working images & disparity maps
+    uint8_t *dispMap1, *dispMap2;
+    uint64_t *censusL, *censusR;        // CPU backend census bitstrings
+    uint8_t *cost;                      // CPU backend SGM cost volume & aggregated costs
+    uint16_t *aggregate;
+
+#ifndef ZNCC_NO_OPENCL
+    cl_context ctx;
+    cl_device_id device;
+    cl_command_queue queue;
+    kernel_cache_t cache;               // compiled program binaries on disk
+
+    cl_kernel resize_kernel, zncc_kernel, cross_check_kernel;
+    cl_kernel integral_rows_kernel, integral_cols_kernel, zncc_integral_kernel;
+    cl_kernel window_stats_kernel, zncc_precomputed_kernel;
+    cl_kernel zncc_tiled_kernel;
+    cl_kernel zncc_fused_kernel, zncc_reverse_best_kernel;
+    cl_kernel downsample_kernel, zncc_guided_kernel;
+    cl_kernel fill_row_tables_kernel, fill_col_tables_kernel, fill_occlusions_kernel;
+    cl_kernel minmax_partial_kernel, minmax_final_kernel, normalize_kernel;
+    cl_kernel subpixel_kernel;
+    cl_kernel census_transform_kernel, census_match_kernel;
+    cl_kernel zncc_cost_volume_kernel, sgm_aggregate_kernel, sgm_select_kernel;
+
+    cl_mem clmemOrigImageL, clmemOrigImageR;
+    cl_mem clmemImageL, clmemImageR, clmemDispMap1, clmemDispMap2, clmemDispMapCrossCheck;
+    cl_mem clmemIntegral;
+    cl_mem clmemMeanL, clmemInvSigmaL, clmemMeanR, clmemInvSigmaR;
+    cl_mem clmemCostVolume;
+    cl_mem clmemRowDist, clmemNextDown, clmemNextRight, clmemDepthMap;   // device occlusion filling
+    cl_mem clmemMinMaxPartial, clmemMinMax;                              // device normalization
+    cl_mem clmemDelta;                                                   // subpixel offsets
+    cl_mem clmemCensusL, clmemCensusR;                                   // census bitstrings
+    cl_mem clmemCost, clmemAggregate;                                    // SGM cost volume & aggregated costs
+
+    uint32_t pyramidLevels;             // levels that fit the current size, level 0 is the working resolution
+    uint32_t pyramidBuffers;            // levels allocated, at least pyramidLevels
+    uint32_t pyrW[ZNCC_PYRAMID_MAX_LEVELS], pyrH[ZNCC_PYRAMID_MAX_LEVELS];
+    cl_mem clmemPyrL[ZNCC_PYRAMID_MAX_LEVELS], clmemPyrR[ZNCC_PYRAMID_MAX_LEVELS];
+    cl_mem clmemPyrDisp1[ZNCC_PYRAMID_MAX_LEVELS], clmemPyrDisp2[ZNCC_PYRAMID_MAX_LEVELS];
+#endif
+};
+
+static void cpu_alloc_buffers(zncc_engine_t *e);
+static void cpu_release_buffers(zncc_engine_t *e);
+static void resize_buffers(zncc_engine_t *e, uint32_t w, uint32_t h);
+static uint8_t *process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint32_t w, uint32_t h,
+                             uint32_t *width, uint32_t *height);
+static const uint8_t *correlate(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, const float **delta);
+static void process_strips(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey);
+static void host_resize(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, uint8_t *resL, uint8_t *resR);
+static uint8_t *host_postprocess(zncc_engine_t *e, const uint8_t *crossChecked, const float *delta);
+static void cpu_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey);
+static uint32_t sgm_ndisp(const zncc_params_t *p);
+static void strip_context(zncc_engine_t *e);
+static void plan_strips(zncc_engine_t *e);
+static void split_strips(zncc_engine_t *e, uint32_t rows);
+static void set_window(zncc_engine_t *e, uint32_t rows);
+static void group_create(zncc_engine_t *e);
+static uint8_t *group_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint32_t w, uint32_t h);
+static void subpixel_combine(zncc_engine_t *e, const uint8_t *filled, const float *delta);
+
+#ifndef ZNCC_NO_OPENCL
+cl_image_format format = { CL_RGBA, CL_UNSIGNED_INT8 };
+
+#define REDUCTION_GROUPS     64         // min/max reduction of normalize.cl: work-groups of the first stage
+#define REDUCTION_LOCAL_SIZE 64         // work-items per group, a power of two
+#define RESIZE_PIXELS        4          // output pixels per work-item of resize.cl, same value there
+#define SGM_LOCAL_SIZE       64         // work-items per scanline of sgm_aggregate, same value in sgm.cl
+#define SGM_MAX_NDISP        512        // disparities per pixel sgm_aggregate holds, same value in sgm.cl
+
+// Kernel files, each one read & built once when the selected mode needs it
+enum { KERNEL_RESIZE, KERNEL_ZNCC, KERNEL_CROSS_CHECK, KERNEL_MODE, KERNEL_PYRAMID, KERNEL_OCCLUSION, KERNEL_NORMALIZE,
+       KERNEL_SUBPIXEL, KERNEL_CENSUS, KERNEL_SGM, KERNEL_FILES };
+
+char *read_kernel_file(const char *filename);
+static cl_program build_program(zncc_engine_t *e, const char *source, const char *filename, const char *options);
+static cl_kernel create_kernel(cl_program program, const char *kernel_name);
+static const char *specialize_options(char *options, size_t size, const zncc_params_t *p);
+
+static int32_t opencl_create(zncc_engine_t *e, cl_platform_id platform, cl_device_id device);
+static void opencl_alloc_buffers(zncc_engine_t *e);
+static void opencl_release_buffers(zncc_engine_t *e);
+static void opencl_alloc_orig_images(zncc_engine_t *e);
+static void opencl_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint8_t *depthMap);
+static void opencl_postprocess(zncc_engine_t *e);
+static void opencl_pyramid(zncc_engine_t *e);
+static void opencl_pyramid_sizes(zncc_engine_t *e);
+static void opencl_sgm(zncc_engine_t *e);
+static void opencl_destroy(zncc_engine_t *e);
+#endif
+
+
+/******************************************************************************
+ *  Pick the backend and set it up. With BACKEND_AUTO the OpenCL device is tried
+ *  first, the native CPU backend is used when there is none. BACKEND_ALL sets up
+ *  every device and the CPU backend as workers of the returned engine.
+ */
+zncc_engine_t *zncc_engine_create(const zncc_params_t *params)
+{
+    zncc_engine_t *e = (zncc_engine_t*) calloc(1, sizeof(zncc_engine_t));
+    if (!e) {
+        perror("Fail to create the ZNCC engine, can not allocation memory !");
+        abort();
+    }
+    e->params = *params;
+    // The census passes (and SGM) replace the ZNCC ones, whatever the mode, over the whole range
+    if (e->params.cost == COST_CENSUS || e->params.sgmPaths) {
+        e->params.mode = ZNCC_MODE_NAIVE;
+        e->params.pyramidLevels = 1;
+    }
+
+    if (e->params.backend == BACKEND_ALL) {
+        group_create(e);
+        return e;
+    }
+#ifndef ZNCC_NO_OPENCL
+    if (e->params.backend != BACKEND_CPU)
+        e->useOpenCL = !opencl_create(e, NULL, NULL);
+#endif
+
+    if (!e->useOpenCL && e->params.backend == BACKEND_OPENCL) {
+        free(e);
+        return NULL;
+    }
+
+    e->pool = thread_pool_create(0);
+    if (!e->useOpenCL) {
+        snprintf(e->name, sizeof(e->name), "CPU (%s, %u threads)", cpu_simd_name(), thread_pool_size(e->pool));
+        if (e->params.backend == BACKEND_AUTO)
+            printf("No OpenCL device available, falling back to the native CPU backend\n");
+        printf("Running native CPU implement of ZNCC on images (%s, %u threads). Please wait...\n", cpu_simd_name(), thread_pool_size(e->pool));
+    }
+    return e;
+}
+
+/******************************************************************************
+ *  Depth map of one pair: resize, ZNCC (L vs R & R vs L) and cross check on the
+ *  engine backend, then occlusion filling & normalization on the device
+ *  (devicePostprocess) or on the host.
+ */
+uint8_t *zncc_engine_process_pair(zncc_engine_t *e, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t w, uint32_t h,
+                                  uint32_t *width, uint32_t *height)
+{
+    return process_pair(e, origImgL, origImgR, 0, w, h, width, height);
+}
+
+/******************************************************************************
+ *  Same, the working-size grey images are given (zncc_decode_grey_file) and the
+ *  resize stage is skipped
+ */
+uint8_t *zncc_engine_process_grey_pair(zncc_engine_t *e, const uint8_t *greyL, const uint8_t *greyR, uint32_t w, uint32_t h,
+                                       uint32_t *width, uint32_t *height)
+{
+    return process_pair(e, greyL, greyR, 1, w, h, width, height);
+}
+
+static uint8_t *process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint32_t w, uint32_t h,
+                             uint32_t *width, uint32_t *height)
+{
+    const uint8_t *crossChecked;
+    const float *delta;
+
+    if (e->workerCount) {
+        *width  = (uint32_t)(w/e->params.downscale);
+        *height = (uint32_t)(h/e->params.downscale);
+        return group_process_pair(e, imgL, imgR, grey, w, h);
+    }
+    resize_buffers(e, w, h);
+    *width  = e->Width;
+    *height = e->mapHeight;
+
+#ifndef ZNCC_NO_OPENCL
+    if (e->devicePostprocess && e->stripRows == e->mapHeight) {
+        // ******** Whole pipeline on the device, the final map is read straight into the result ********
+        uint8_t *Disparity = (uint8_t*) malloc(e->Width*e->Height);
+        if (!Disparity) {
+            perror("Fail to allocate the depth map, can not allocation memory !");
+            abort();
+        }
+        opencl_process_pair(e, imgL, imgR, grey, Disparity);
+        if (e->params.subpixel)
+            subpixel_combine(e, e->filled, e->delta);
+        return Disparity;
+    }
+#endif
+    crossChecked = correlate(e, imgL, imgR, grey, &delta);
+    return host_postprocess(e, crossChecked, delta);
+}
+
+/******************************************************************************
+ *  Buffers follow the input size
+ */
+static void resize_buffers(zncc_engine_t *e, uint32_t w, uint32_t h)
+{
+    if (w == e->origW && h == e->origH)
+        return;
+#ifndef ZNCC_NO_OPENCL
+    if (e->useOpenCL)
+        opencl_release_buffers(e);
+#endif
+    cpu_release_buffers(e);
+
+    e->origW     = w;
+    e->origH     = h;
+    e->Width     = (uint32_t)(w/e->params.downscale);
+    e->mapHeight = (uint32_t)(h/e->params.downscale);
+    plan_strips(e);
+    e->bufferRows = e->Height;
+
+    cpu_alloc_buffers(e);
+#ifndef ZNCC_NO_OPENCL
+    if (e->useOpenCL)
+        opencl_alloc_buffers(e);
+#endif
+}
+
+/******************************************************************************
+ *  Cross checked map of the pair (and its subpixel offsets in *delta) on the
+ *  engine backend, whole or strip by strip. Owned by the engine.
+ */
+static const uint8_t *correlate(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, const float **delta)
+{
+    if (e->stripRows < e->mapHeight) {
+        process_strips(e, imgL, imgR, grey);
+        *delta = e->mapDelta;
+        return e->map;
+    }
+#ifndef ZNCC_NO_OPENCL
+    if (e->useOpenCL)
+        opencl_process_pair(e, imgL, imgR, grey, NULL);
+    else
+#endif
+        cpu_process_pair(e, imgL, imgR, grey);
+    *delta = e->delta;
+    return e->dDisparity;
+}
+
+/******************************************************************************
+ *  Strip by strip: the grey images of every strip and its context rows go
+ *  through the backend, the cross checked rows of the strip are copied into the
+ *  whole map. A strip window starts at least halo rows above its strip (clamped
+ *  to the map), so every window row the ZNCC, cross check & subpixel stages see
+ *  is the same as with the whole map, and so is the stitched map.
+ */
+static void process_strips(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey)
+{
+    const zncc_params_t *p = &e->params;
+    const uint32_t Width = e->Width, mapHeight = e->mapHeight;
+    uint8_t *resL = NULL, *resR = NULL;
+    uint32_t y0, y1, s0;
+
+    // RGBA pairs are resized whole on the host, the strips are cut from the working-size grey images
+    if (!grey) {
+        resL = (uint8_t*) malloc((size_t)Width*mapHeight);
+        resR = (uint8_t*) malloc((size_t)Width*mapHeight);
+        if (!resL || !resR) {
+            perror("Fail to allocate the working-size images, can not allocation memory !");
+            abort();
+        }
+        host_resize(e, imgL, imgR, resL, resR);
+        imgL = resL;
+        imgR = resR;
+    }
+
+    for (y0 = 0; y0 < mapHeight; y0 += e->stripRows) {
+        y1 = y0 + e->stripRows < mapHeight ? y0 + e->stripRows : mapHeight;
+        s0 = y0 > e->stripHalo ? (y0 - e->stripHalo)/e->stripAlign*e->stripAlign : 0;
+        if (s0 > mapHeight - e->Height)
+            s0 = mapHeight - e->Height;
+
+#ifndef ZNCC_NO_OPENCL
+        if (e->useOpenCL)
+            opencl_process_pair(e, imgL + (size_t)s0*Width, imgR + (size_t)s0*Width, 1, NULL);
+        else
+#endif
+            cpu_process_pair(e, imgL + (size_t)s0*Width, imgR + (size_t)s0*Width, 1);
+
+        memcpy(e->map + (size_t)y0*Width, e->dDisparity + (size_t)(y0 - s0)*Width, (size_t)(y1 - y0)*Width);
+        if (p->subpixel)
+            memcpy(e->mapDelta + (size_t)y0*Width, e->delta + (size_t)(y0 - s0)*Width, (size_t)(y1 - y0)*Width*sizeof(float));
+    }
+    free(resL);
+    free(resR);
+}
+
+/******************************************************************************
+ *  Working-size grey images of an RGBA pair on the host, with the resize filter
+ */
+static void host_resize(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, uint8_t *resL, uint8_t *resR)
+{
+    const zncc_params_t *p = &e->params;
+    uint64_t start = zncc_profile_now();
+
+    if (p->resizeFilter == RESIZE_AREA)
+        cpu_resize_area(e->pool, imgL, imgR, e->origW, e->origH, resL, resR, e->Width, e->mapHeight, p->downscale);
+    else if (p->resizeFilter == RESIZE_BILINEAR)
+        cpu_resize_bilinear(e->pool, imgL, imgR, e->origW, e->origH, resL, resR, e->Width, e->mapHeight, p->downscale);
+    else
+        cpu_resize(e->pool, imgL, imgR, e->origW, e->origH, resL, resR, e->Width, e->mapHeight, p->downscale);
+    zncc_profile_host(p->profile, "resize", start);
+}
+
+/******************************************************************************
+ *  run occlusion_filling & nomalize on host-code, over the whole cross checked map
+ */
+static uint8_t *host_postprocess(zncc_engine_t *e, const uint8_t *crossChecked, const float *delta)
+{
+    uint8_t *Disparity;
+    uint64_t start;
+
+    start = zncc_profile_now();
+    if (e->params.occlusionFill == OCCLUSION_FILL_RING)
+        Disparity = occlusion_filling_ring(e->pool, crossChecked, e->Width, e->mapHeight);
+    else
+        Disparity = occlusion_filling(e->pool, crossChecked, e->Width, e->mapHeight);
+    zncc_profile_host(e->params.profile, "occlusion filling", start);
+    if (e->params.subpixel)
+        subpixel_combine(e, Disparity, delta);
+    start = zncc_profile_now();
+    normalization(e->pool, Disparity, e->Width, e->mapHeight);
+    zncc_profile_host(e->params.profile, "normalization", start);
+    return Disparity;
+}
+
+/******************************************************************************
+ *  Bytes per working-size row of the buffers the correlation stages allocate for
+ *  the current size & mode (pyramid levels & padded CPU planes included)
+ */
+static uint64_t strip_row_bytes(const zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    const uint64_t Width = e->Width;
+    const int32_t range = abs(p->mindisp) > abs(p->maxdisp) ? abs(p->mindisp) : abs(p->maxdisp);
+    uint64_t bytes = 5*Width;                       // both images, both disparity maps & the cross checked map
+
+    if (p->subpixel)
+        bytes += Width*sizeof(float);
+    if (p->pyramidLevels > 1)
+        bytes += 2*Width;                           // 4 maps at 1/4, 1/16.. of the size
+    if (p->sgmPaths) {
+        bytes += sgm_ndisp(p)*Width*(sizeof(uint8_t) + sizeof(uint16_t));   // cost volume & aggregated costs
+    } else if (p->cost == COST_CENSUS) {
+        bytes += 2*Width*sizeof(uint64_t);          // bitstrings of both images
+    } else if (!e->useOpenCL) {
+        // Zero padded float planes of both images in cpu_zncc, padded by up to 8 SIMD lanes more
+        bytes += 2*(Width + 2*(p->halfwinsizex + range + 8))*sizeof(float);
+    } else if (p->mode == ZNCC_MODE_INTEGRAL) {
+        bytes += (4 + p->maxdisp + 1)*(Width + 1)*sizeof(uint32_t);
+    } else if (p->mode == ZNCC_MODE_PRECOMPUTED) {
+        bytes += 4*Width*sizeof(float);
+    } else if (p->mode == ZNCC_MODE_FUSED) {
+        bytes += (p->maxdisp - p->mindisp + 1)*(Width + p->halfwinsizex)*sizeof(float);
+    }
+    return bytes;
+}
+
+/******************************************************************************
+ *  Disparities per pixel of the SGM cost volumes, the widest of both passes
+ *  (mindisp..maxdisp & -maxdisp..mindisp)
+ */
+static uint32_t sgm_ndisp(const zncc_params_t *p)
+{
+    const int32_t ndisp1 = p->maxdisp - p->mindisp + 1, ndisp2 = p->mindisp + p->maxdisp + 1;
+    return (uint32_t)(ndisp1 > ndisp2 ? ndisp1 : ndisp2);
+}
+
+/******************************************************************************
+ *  Context rows above & below a strip (or band) and alignment of its window.
+ *  The cross check indexes the flattened R vs L map at i - d, so the first d
+ *  pixels of a row read the end of the row above: one row more than the window.
+ *  The census bitstrings of the window rows need CENSUS_HALFWINSIZEY more.
+ */
+static void strip_context(zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    e->stripAlign = 1u << (p->pyramidLevels - 1);
+    e->stripHalo  = (p->pyramidLevels > 1) ? (uint32_t)(p->halfwinsizey + 1)*(2*e->stripAlign - 1) : (uint32_t)p->halfwinsizey + 1;
+    if (p->cost == COST_CENSUS)
+        e->stripHalo += CENSUS_HALFWINSIZEY;
+}
+
+/******************************************************************************
+ *  Strips of the current size. Without a budget, or when the buffers of the
+ *  whole map fit in it, one strip. Otherwise the strip windows are as high as the
+ *  budget allows, halo context rows on both sides included. With the pyramid the
+ *  halo covers the window rows of every level down the coarse-to-fine chain and
+ *  the windows start on multiples of the coarsest 2x2 blocks (stripAlign), so
+ *  the strip levels are rows of the whole map levels.
+ */
+static void plan_strips(zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    const uint64_t rowBytes = strip_row_bytes(e);
+    uint64_t rows, minRows;
+
+    e->Height    = e->mapHeight;
+    e->stripRows = e->mapHeight;
+    strip_context(e);
+    if (!p->memoryBudget || rowBytes*e->mapHeight <= p->memoryBudget)
+        return;
+    if (p->sgmPaths) {
+        // The SGM paths run across the whole map, a strip would cut them
+        printf("SGM needs the whole map: %.1f MB over the %.1f MB memory budget\n", rowBytes*e->mapHeight/1048576.0, p->memoryBudget/1048576.0);
+        return;
+    }
+
+    rows    = p->memoryBudget/rowBytes;
+    minRows = 2*e->stripHalo + 2*e->stripAlign - 1;
+    if (rows < minRows) {
+        printf("The memory budget holds %llu rows, less than a strip with its %u context rows on both sides\n", (unsigned long long)rows, e->stripHalo);
+        rows = minRows;
+    }
+    if (rows >= e->mapHeight)
+        return;
+    split_strips(e, (uint32_t)rows);
+    printf("Processing %u x %u in %u strips of %u rows + %u context rows (%.1f MB of %.1f MB)\n", e->Width, e->mapHeight,
+           (e->mapHeight + e->stripRows - 1)/e->stripRows, e->stripRows, e->stripHalo, e->Height*rowBytes/1048576.0, p->memoryBudget/1048576.0);
+}
+
+/******************************************************************************
+ *  Strip windows of at most rows rows over the map, none when it fits. The last
+ *  window ends on the last row and still starts on a block, so it can be a few
+ *  rows shorter than rows.
+ */
+static void split_strips(zncc_engine_t *e, uint32_t rows)
+{
+    e->Height    = e->mapHeight;
+    e->stripRows = e->mapHeight;
+    if (rows >= e->mapHeight)
+        return;
+    e->Height    = rows - (e->mapHeight - rows) % e->stripAlign;
+    e->stripRows = e->Height - 2*e->stripHalo - (e->stripAlign - 1);
+}
+
+/******************************************************************************
+ *  BACKEND_ALL workers are sized once for the whole map, a band runs on a window
+ *  of its first rows: the map gets the window height and the strips are split
+ *  again within the rows the buffers hold, nothing is reallocated.
+ */
+static void set_window(zncc_engine_t *e, uint32_t rows)
+{
+    e->mapHeight = rows;
+    split_strips(e, e->bufferRows);
+#ifndef ZNCC_NO_OPENCL
+    if (e->useOpenCL)
+        opencl_pyramid_sizes(e);
+#endif
+}
+
+/******************************************************************************
+ *  BACKEND_ALL workers: every device of every OpenCL platform, then the native
+ *  CPU backend. They are handed working-size grey windows and only correlate,
+ *  the group resizes, stitches & post-processes on the host.
+ */
+static void group_create(zncc_engine_t *e)
+{
+    zncc_params_t p = e->params;
+#ifndef ZNCC_NO_OPENCL
+    cl_platform_id platforms[MAX_WORKERS];
+    cl_device_id devices[MAX_WORKERS];
+    cl_uint platformCount = 0, deviceCount, i, d;
+    zncc_engine_t *w;
+#endif
+    uint32_t k;
+
+    p.downscale   = 1;
+    p.postprocess = POSTPROCESS_HOST;
+    p.profile     = NULL;
+    e->pool = thread_pool_create(0);
+
+#ifndef ZNCC_NO_OPENCL
+    if (clGetPlatformIDs(MAX_WORKERS, platforms, &platformCount) != CL_SUCCESS)
+        platformCount = 0;
+    for (i = 0; i < platformCount && i < MAX_WORKERS; i++) {
+        if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, MAX_WORKERS, devices, &deviceCount) != CL_SUCCESS)
+            continue;
+        for (d = 0; d < deviceCount && d < MAX_WORKERS && e->workerCount < MAX_WORKERS - 1; d++) {
+            w = (zncc_engine_t*) calloc(1, sizeof(zncc_engine_t));
+            if (!w) {
+                perror("Fail to create the ZNCC engine, can not allocation memory !");
+                abort();
+            }
+            w->params         = p;
+            w->params.backend = BACKEND_OPENCL;
+            if (opencl_create(w, platforms[i], devices[d])) {
+                free(w);
+                continue;
+            }
+            w->useOpenCL = 1;
+            w->pool      = thread_pool_create(1);
+            e->workers[e->workerCount++] = w;
+        }
+    }
+#endif
+
+    p.backend = BACKEND_CPU;
+    e->workers[e->workerCount++] = zncc_engine_create(&p);
+    printf("Splitting every pair over %u workers:", e->workerCount);
+    for (k = 0; k < e->workerCount; k++)
+        printf("%s %s", k ? "," : "", e->workers[k]->name);
+    printf("\n");
+}
+
+// Band of one worker: a window of the working-size grey images and the map rows it gives
+typedef struct {
+    zncc_engine_t *worker;
+    const uint8_t *imgL, *imgR;         // first row of the window
+    uint32_t width, rows;               // window size
+    uint32_t top, count;                // band rows, from the window top
+    uint8_t *map;                       // band rows of the stitched map & its subpixel offsets
+    float *mapDelta;
+    double seconds;
+} band_t;
+
+static void *band_thread(void *arg)
+{
+    band_t *b = (band_t*) arg;
+    const uint8_t *crossChecked;
+    const float *delta;
+    uint64_t start;
+
+    set_window(b->worker, b->rows);
+    start = zncc_profile_now();
+    crossChecked = correlate(b->worker, b->imgL, b->imgR, 1, &delta);
+    memcpy(b->map, crossChecked + (size_t)b->top*b->width, (size_t)b->count*b->width);
+    if (b->mapDelta)
+        memcpy(b->mapDelta, delta + (size_t)b->top*b->width, (size_t)b->count*b->width*sizeof(float));
+    b->seconds = (zncc_profile_now() - start)/1e9;
+    return NULL;
+}
+
+// Window of map rows [y0, y1) for worker k: context rows on both sides, clamped to the map, aligned start.
+// Never shorter than the smallest strip window, so the pyramid keeps all its levels near the map edges
+static void band_window(const zncc_engine_t *e, uint32_t k, band_t *b, const uint8_t *imgL, const uint8_t *imgR, uint32_t y0, uint32_t y1)
+{
+    const uint32_t minRows = 2*e->stripHalo + 2*e->stripAlign - 1;
+    uint32_t s0 = y0 > e->stripHalo ? (y0 - e->stripHalo)/e->stripAlign*e->stripAlign : 0;
+    uint32_t s1 = y1 + e->stripHalo;
+
+    if (s1 < s0 + minRows)
+        s1 = s0 + minRows;
+    if (s1 > e->mapHeight) {
+        s1 = e->mapHeight;
+        if (s1 < s0 + minRows)
+            s0 = s1 > minRows ? (s1 - minRows)/e->stripAlign*e->stripAlign : 0;
+    }
+
+    b->worker   = e->workers[k];
+    b->imgL     = imgL + (size_t)s0*e->Width;
+    b->imgR     = imgR + (size_t)s0*e->Width;
+    b->width    = e->Width;
+    b->rows     = s1 - s0;
+    b->top      = y0 - s0;
+    b->count    = y1 - y0;
+    b->map      = e->map + (size_t)y0*e->Width;
+    b->mapDelta = e->params.subpixel ? e->mapDelta + (size_t)y0*e->Width : NULL;
+}
+
+/******************************************************************************
+ *  One pair over the workers. At a new size the workers are sized for the whole
+ *  map (the budget still splits their windows into strips) and every worker first times the same
+ *  top rows of the pair (one after the other, so they do not share the cores),
+ *  then each pair is split into bands proportional to the rows/s of the workers,
+ *  run concurrently, and the rows/s measured on the bands size the next split.
+ */
+static uint8_t *group_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint32_t w, uint32_t h)
+{
+    const size_t mapSize = (size_t)(uint32_t)(w/e->params.downscale)*(uint32_t)(h/e->params.downscale);
+    pthread_t threads[MAX_WORKERS];
+    band_t bands[MAX_WORKERS];
+    double total = 0, cumulated = 0;
+    uint32_t k, y0, y1, sample;
+    uint64_t start;
+
+    if (w != e->origW || h != e->origH) {
+        cpu_release_buffers(e);
+        e->origW     = w;
+        e->origH     = h;
+        e->Width     = (uint32_t)(w/e->params.downscale);
+        e->mapHeight = e->Height = e->stripRows = (uint32_t)(h/e->params.downscale);
+        strip_context(e);
+        e->map = (uint8_t*) malloc(mapSize);
+        if (e->params.subpixel) {
+            e->mapDelta = (float*) malloc(mapSize*sizeof(float));
+            e->subpixel = (float*) malloc(mapSize*sizeof(float));
+        }
+        if (!e->map || (e->params.subpixel && (!e->mapDelta || !e->subpixel))) {
+            perror("Fail to allocate the stitched map, can not allocation memory !");
+            abort();
+        }
+        memset(e->rowsPerSecond, 0, sizeof(e->rowsPerSecond));
+        // Every worker holds the whole map, whatever band it gets: the bands change height from pair to pair
+        for (k = 0; k < e->workerCount; k++)
+            resize_buffers(e->workers[k], e->Width, e->mapHeight);
+    }
+
+    // RGBA pairs are resized on the host, the bands are cut from the working-size grey images
+    if (!grey) {
+        if (!e->imageL) {
+            e->imageL = (uint8_t*) malloc(mapSize);
+            e->imageR = (uint8_t*) malloc(mapSize);
+            if (!e->imageL || !e->imageR) {
+                perror("Fail to allocate the working-size images, can not allocation memory !");
+                abort();
+            }
+        }
+        host_resize(e, imgL, imgR, e->imageL, e->imageR);
+        imgL = e->imageL;
+        imgR = e->imageR;
+    }
+
+    // ******** Throughput of every worker on the same sample band ********
+    if (e->rowsPerSecond[0] == 0) {
+        start  = zncc_profile_now();
+        sample = e->mapHeight/16 > 16 ? e->mapHeight/16 : 16;
+        if (sample > e->mapHeight)
+            sample = e->mapHeight;
+        for (k = 0; k < e->workerCount; k++) {
+            band_window(e, k, &bands[k], imgL, imgR, 0, sample);
+            band_thread(&bands[k]);
+            e->rowsPerSecond[k] = bands[k].rows/(bands[k].seconds > 1e-9 ? bands[k].seconds : 1e-9);
+            printf("  %s: %.0f rows/s\n", e->workers[k]->name, e->rowsPerSecond[k]);
+        }
+        zncc_profile_host(e->params.profile, "calibration", start);
+    }
+
+    // ******** Bands proportional to the throughput, all workers at once ********
+    start = zncc_profile_now();
+    for (k = 0; k < e->workerCount; k++)
+        total += e->rowsPerSecond[k];
+    for (k = 0, y0 = 0; k < e->workerCount; k++, y0 = y1) {
+        cumulated += e->rowsPerSecond[k];
+        y1 = (k == e->workerCount - 1) ? e->mapHeight : (uint32_t)(e->mapHeight*cumulated/total + 0.5);
+        bands[k].count = 0;
+        if (y1 <= y0)
+            continue;
+        band_window(e, k, &bands[k], imgL, imgR, y0, y1);
+        if (pthread_create(&threads[k], NULL, band_thread, &bands[k])) {
+            fprintf(stderr, "Fail to start the band thread of '%s' !\n", e->workers[k]->name);
+            abort();
+        }
+    }
+    for (k = 0; k < e->workerCount; k++) {
+        if (!bands[k].count)
+            continue;
+        pthread_join(threads[k], NULL);
+        e->rowsPerSecond[k] = bands[k].rows/(bands[k].seconds > 1e-9 ? bands[k].seconds : 1e-9);
+    }
+    zncc_profile_host(e->params.profile, "bands", start);
+
+    return host_postprocess(e, e->map, e->mapDelta);
+}
+
+const float *zncc_engine_subpixel_map(const zncc_engine_t *e)
+{
+    return e->params.subpixel ? e->subpixel : NULL;
+}
+
+/******************************************************************************
+ *  Refined disparities: the occlusion filled map plus the subpixel offsets of the
+ *  pixels that passed the cross check (the filled ones have none)
+ */
+static void subpixel_combine(zncc_engine_t *e, const uint8_t *filled, const float *delta)
+{
+    const size_t size = (size_t)e->Width*e->mapHeight;
+    size_t k;
+    for (k = 0; k < size; k++)
+        e->subpixel[k] = filled[k] + delta[k];
+}
+
+const char *zncc_engine_backend_name(const zncc_engine_t *e)
+{
+    if (e->workerCount)
+        return e->workerCount > 1 ? "OpenCL + CPU" : "CPU";
+    return e->useOpenCL ? "OpenCL" : "CPU";
+}
+
+void zncc_engine_destroy(zncc_engine_t *e)
+{
+    uint32_t k;
+    if (!e)
+        return;
+    for (k = 0; k < e->workerCount; k++)
+        zncc_engine_destroy(e->workers[k]);
+#ifndef ZNCC_NO_OPENCL
+    if (e->useOpenCL) {
+        opencl_release_buffers(e);
+        opencl_destroy(e);
+    }
+#endif
+    cpu_release_buffers(e);
+    thread_pool_destroy(e->pool);
+    free(e);
+}
+
+/******************************************************************************
+ *  Host buffers of the current size, the working images & disparity maps are
+ *  only needed by the CPU backend
+ */
+static void cpu_alloc_buffers(zncc_engine_t *e)
+{
+    const size_t size = (size_t)e->Width*e->Height, mapSize = (size_t)e->Width*e->mapHeight;
+
+    e->dDisparity = (uint8_t*) malloc(size);
+    if (e->params.subpixel) {
+        e->delta    = (float*) malloc(size*sizeof(float));
+        e->subpixel = (float*) malloc(mapSize*sizeof(float));
+        e->filled   = (uint8_t*) malloc(size);
+        if (!e->delta || !e->subpixel || !e->filled) {
+            perror("Fail to allocate the subpixel buffers, can not allocation memory !");
+            abort();
+        }
+    }
+    if (e->stripRows < e->mapHeight) {
+        e->map = (uint8_t*) malloc(mapSize);
+        if (e->params.subpixel)
+            e->mapDelta = (float*) malloc(mapSize*sizeof(float));
+        if (!e->map || (e->params.subpixel && !e->mapDelta)) {
+            perror("Fail to allocate the stitched map, can not allocation memory !");
+            abort();
+        }
+    }
+    if (!e->useOpenCL) {
+        e->imageL   = (uint8_t*) malloc(size);
+        e->imageR   = (uint8_t*) malloc(size);
+        e->dispMap1 = (uint8_t*) malloc(size);
+        e->dispMap2 = (uint8_t*) malloc(size);
+        if (e->params.sgmPaths) {
+            e->cost      = (uint8_t*) malloc(size*sgm_ndisp(&e->params));
+            e->aggregate = (uint16_t*) malloc(size*sgm_ndisp(&e->params)*sizeof(uint16_t));
+            if (!e->cost || !e->aggregate) {
+                perror("Fail to allocate the SGM cost volume, can not allocation memory !");
+                abort();
+            }
+        }
+        if (e->params.cost == COST_CENSUS) {
+            e->censusL = (uint64_t*) malloc(size*sizeof(uint64_t));
+            e->censusR = (uint64_t*) malloc(size*sizeof(uint64_t));
+            if (!e->censusL || !e->censusR) {
+                perror("Fail to allocate the census bitstrings, can not allocation memory !");
+                abort();
+            }
+        }
+    }
+    if (!e->dDisparity || (!e->useOpenCL && (!e->imageL || !e->imageR || !e->dispMap1 || !e->dispMap2))) {
+        perror("Fail to allocate the engine buffers, can not allocation memory !");
+        abort();
+    }
+}
+
+static void cpu_release_buffers(zncc_engine_t *e)
+{
+    free(e->dDisparity);
+    free(e->delta);
+    free(e->subpixel);
+    free(e->filled);
+    free(e->imageL);
+    free(e->imageR);
+    free(e->dispMap1);
+    free(e->dispMap2);
+    free(e->map);
+    free(e->mapDelta);
+    free(e->censusL);
+    free(e->censusR);
+    free(e->cost);
+    free(e->aggregate);
+    e->censusL = e->censusR = NULL;
+    e->cost = NULL;
+    e->aggregate = NULL;
+    e->dDisparity = e->imageL = e->imageR = e->dispMap1 = e->dispMap2 = e->filled = e->map = NULL;
+    e->delta = e->subpixel = e->mapDelta = NULL;
+}
+
+/******************************************************************************
+ *  Same stages as opencl_process_pair on the native CPU backend (zncc_cpu.c)
+ */
+static void cpu_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey)
+{
+    const zncc_params_t *p = &e->params;
+    const uint32_t Width = e->Width, Height = e->Height;
+
+    uint64_t start = zncc_profile_now();
+
+    if (grey) {
+        memcpy(e->imageL, imgL, (size_t)Width*Height);
+        memcpy(e->imageR, imgR, (size_t)Width*Height);
+    } else {
+        if (p->resizeFilter == RESIZE_AREA)
+            cpu_resize_area(e->pool, imgL, imgR, e->origW, e->origH, e->imageL, e->imageR, Width, Height, p->downscale);
+        else if (p->resizeFilter == RESIZE_BILINEAR)
+            cpu_resize_bilinear(e->pool, imgL, imgR, e->origW, e->origH, e->imageL, e->imageR, Width, Height, p->downscale);
+        else
+            cpu_resize(e->pool, imgL, imgR, e->origW, e->origH, e->imageL, e->imageR, Width, Height, p->downscale);
+        zncc_profile_host(p->profile, "resize", start);
+    }
+    start = zncc_profile_now();
+    if (p->cost == COST_CENSUS) {
+        cpu_census(e->pool, e->imageL, e->censusL, Width, Height);
+        cpu_census(e->pool, e->imageR, e->censusR, Width, Height);
+        zncc_profile_host(p->profile, "census transform", start);
+        start = zncc_profile_now();
+        cpu_census_match(e->pool, e->censusL, e->censusR, e->dispMap1, Width, Height, p->halfwinsizex, p->halfwinsizey, p->mindisp, p->maxdisp);
+        zncc_profile_host(p->profile, "census L vs R", start);
+        start = zncc_profile_now();
+        cpu_census_match(e->pool, e->censusR, e->censusL, e->dispMap2, Width, Height, p->halfwinsizex, p->halfwinsizey, -p->maxdisp, p->mindisp);
+        zncc_profile_host(p->profile, "census R vs L", start);
+    } else if (p->sgmPaths) {
+        cpu_zncc_cost_volume(e->pool, e->imageL, e->imageR, e->cost, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, p->mindisp, p->maxdisp);
+        zncc_profile_host(p->profile, "cost volume L vs R", start);
+        start = zncc_profile_now();
+        cpu_sgm_aggregate(e->pool, e->cost, e->aggregate, Width, Height, p->mindisp, p->maxdisp, p->sgmPaths, p->sgmP1, p->sgmP2);
+        cpu_sgm_select(e->pool, e->aggregate, e->dispMap1, Width, Height, p->mindisp, p->maxdisp);
+        zncc_profile_host(p->profile, "sgm L vs R", start);
+        start = zncc_profile_now();
+        cpu_zncc_cost_volume(e->pool, e->imageR, e->imageL, e->cost, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, -p->maxdisp, p->mindisp);
+        zncc_profile_host(p->profile, "cost volume R vs L", start);
+        start = zncc_profile_now();
+        cpu_sgm_aggregate(e->pool, e->cost, e->aggregate, Width, Height, -p->maxdisp, p->mindisp, p->sgmPaths, p->sgmP1, p->sgmP2);
+        cpu_sgm_select(e->pool, e->aggregate, e->dispMap2, Width, Height, -p->maxdisp, p->mindisp);
+        zncc_profile_host(p->profile, "sgm R vs L", start);
+    } else if (p->pyramidLevels > 1) {
+        cpu_zncc_pyramid(e->pool, e->imageL, e->imageR, e->dispMap1, e->dispMap2, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, p->maxdisp, p->pyramidLevels, p->pyramidBand);
+        zncc_profile_host(p->profile, "zncc pyramid", start);
+    } else {
+        cpu_zncc(e->pool, e->imageL, e->imageR, e->dispMap1, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, p->mindisp, p->maxdisp);
+        zncc_profile_host(p->profile, "zncc L vs R", start);
+        start = zncc_profile_now();
+        cpu_zncc(e->pool, e->imageR, e->imageL, e->dispMap2, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, -p->maxdisp, p->mindisp);
+        zncc_profile_host(p->profile, "zncc R vs L", start);
+    }
+    start = zncc_profile_now();
+    cpu_cross_check(e->pool, e->dispMap1, e->dispMap2, e->dDisparity, Width, Height, p->threshold);
+    zncc_profile_host(p->profile, "cross check", start);
+    if (p->subpixel) {
+        start = zncc_profile_now();
+        cpu_subpixel(e->pool, e->imageL, e->imageR, e->dDisparity, e->delta, Width, Height, p->halfwinsizex, p->halfwinsizey, p->winsizearea, p->mindisp, p->maxdisp);
+        zncc_profile_host(p->profile, "subpixel", start);
+    }
+}
+
+#ifndef ZNCC_NO_OPENCL
+/******************************************************************************
+ *  Context, queue & every kernel the selected mode needs, built once.
+ *  Returns 1 when no OpenCL device is available.
+ */
+static int32_t opencl_create(zncc_engine_t *e, cl_platform_id platform, cl_device_id device)
+{
+    const zncc_params_t *p = &e->params;
+    cl_int status;
+
+    // ******** Setup OpenCL environment to run the kernel ********
+    cl_context_properties props[3] = { CL_CONTEXT_PLATFORM, 0, 0 };
+
+    if (!device) {
+        status = clGetPlatformIDs( 1, &platform, NULL );
+        printf("clGetPlatformIDs status == CL_SUCCESS - %d\n", status == CL_SUCCESS);
+        if(status != CL_SUCCESS)
+            return 1;
+        // GPU first, then a CPU OpenCL device
+        status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+        if(status != CL_SUCCESS)
+            status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+        if(status != CL_SUCCESS)
+            return 1;
+    }
+
+    e->device = device;
+    if (clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(e->name), e->name, NULL) != CL_SUCCESS)
+        snprintf(e->name, sizeof(e->name), "OpenCL device");
+    props[1] = (cl_context_properties)platform;
+    // context
+    e->ctx = clCreateContext( props, 1, &device, NULL, NULL, &status );
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create context for OpenCL !\n");
+        return 1;
+    }
+    printf("Running openCL implement of ZNCC on images. Please wait, this will take several minutes...\n");
+    // queue, with event timestamps for the timing report
+    e->queue = clCreateCommandQueue( e->ctx, device, p->profile ? CL_QUEUE_PROFILING_ENABLE : 0, &status );
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create queue for OpenCL context !\n");
+        abort();
+    }
+
+    // ******** Read the kernel files of the selected mode ********
+    // The occlusion filling & normalization run on the device, the ring search only exists on the host
+    e->devicePostprocess = p->postprocess == POSTPROCESS_DEVICE && p->occlusionFill != OCCLUSION_FILL_RING;
+    const char *modeFile = p->mode == ZNCC_MODE_INTEGRAL    ? "zncc_integral.cl" :
+                           p->mode == ZNCC_MODE_PRECOMPUTED ? "zncc_precomputed.cl" :
+                           p->mode == ZNCC_MODE_TILED       ? "zncc_tiled.cl" :
+                           p->mode == ZNCC_MODE_FUSED       ? "zncc_fused.cl" : NULL;
+    const char *files[KERNEL_FILES] = {
+        "resize.cl", "zncc.cl", "cross_check.cl", modeFile,
+        p->pyramidLevels > 1    ? "zncc_pyramid.cl" : NULL,
+        e->devicePostprocess    ? "occlusion_filling.cl" : NULL,
+        e->devicePostprocess    ? "normalize.cl" : NULL,
+        p->subpixel             ? "subpixel.cl" : NULL,
+        p->cost == COST_CENSUS  ? "census.cl" : NULL,
+        p->sgmPaths             ? "sgm.cl" : NULL
+    };
+    char *sources[KERNEL_FILES] = { NULL };
+    uint32_t f;
+    for (f = 0; f < KERNEL_FILES; f++) {
+        if (files[f] && !(sources[f] = read_kernel_file(files[f]))) {
+            while (f--)
+                free(sources[f]);
+            clReleaseCommandQueue(e->queue);
+            clReleaseContext(e->ctx);
+            return 1;
+        }
+    }
+
+    // ******* Init cl kernel from files, one program per file *******
+    e->cache.dir = p->kernelCacheDir;
+    // zncc.cl & zncc_fused.cl are specialized for the window and the disparity count when they are usual.
+    // The pyramid reuses zncc_kernel with a per-level range, and with MINDISP != 0 the R vs L pass
+    // (-MAXDISP..MINDISP) does not search as many disparities as the L vs R pass, both keep it generic.
+    char specializedOptions[256];
+    const char *znccOptions  = specialize_options(specializedOptions, sizeof(specializedOptions), p);
+    const char *fusedOptions = znccOptions;
+    if (p->pyramidLevels > 1 || p->mindisp != 0)
+        znccOptions = NULL;
+    cl_program program;
+
+    program = build_program(e, sources[KERNEL_RESIZE], files[KERNEL_RESIZE], NULL);
+    e->resize_kernel     = create_kernel(program, p->resizeFilter == RESIZE_AREA ? "resize_area" :
+                                         p->resizeFilter == RESIZE_BILINEAR ? "resize_bilinear" : "resize");
+    clReleaseProgram(program);
+    program = build_program(e, sources[KERNEL_ZNCC], files[KERNEL_ZNCC], znccOptions);
+    e->zncc_kernel       = create_kernel(program, "zncc");
+    clReleaseProgram(program);
+    program = build_program(e, sources[KERNEL_CROSS_CHECK], files[KERNEL_CROSS_CHECK], NULL);
+    e->cross_check_kernel= create_kernel(program, "cross_check");
+    clReleaseProgram(program);
+    if (modeFile) {
+        // zncc_reverse_best does not read the specialized constants, the fused program is built once
+        program = build_program(e, sources[KERNEL_MODE], modeFile, p->mode == ZNCC_MODE_FUSED ? fusedOptions : NULL);
+        if (p->mode == ZNCC_MODE_INTEGRAL) {
+            e->integral_rows_kernel    = create_kernel(program, "integral_rows");
+            e->integral_cols_kernel    = create_kernel(program, "integral_cols");
+            e->zncc_integral_kernel    = create_kernel(program, "zncc_integral");
+        }
+        if (p->mode == ZNCC_MODE_PRECOMPUTED) {
+            e->window_stats_kernel     = create_kernel(program, "window_stats");
+            e->zncc_precomputed_kernel = create_kernel(program, "zncc_precomputed");
+        }
+        if (p->mode == ZNCC_MODE_TILED)
+            e->zncc_tiled_kernel       = create_kernel(program, "zncc_tiled");
+        if (p->mode == ZNCC_MODE_FUSED) {
+            e->zncc_fused_kernel       = create_kernel(program, "zncc_fused");
+            e->zncc_reverse_best_kernel= create_kernel(program, "zncc_reverse_best");
+        }
+        clReleaseProgram(program);
+    }
+    if (p->pyramidLevels > 1) {
+        program = build_program(e, sources[KERNEL_PYRAMID], files[KERNEL_PYRAMID], NULL);
+        e->downsample_kernel       = create_kernel(program, "downsample");
+        e->zncc_guided_kernel      = create_kernel(program, "zncc_guided");
+        clReleaseProgram(program);
+    }
+    if (e->devicePostprocess) {
+        program = build_program(e, sources[KERNEL_OCCLUSION], files[KERNEL_OCCLUSION], NULL);
+        e->fill_row_tables_kernel  = create_kernel(program, "fill_row_tables");
+        e->fill_col_tables_kernel  = create_kernel(program, "fill_col_tables");
+        e->fill_occlusions_kernel  = create_kernel(program, "fill_occlusions");
+        clReleaseProgram(program);
+        program = build_program(e, sources[KERNEL_NORMALIZE], files[KERNEL_NORMALIZE], NULL);
+        e->minmax_partial_kernel   = create_kernel(program, "minmax_partial");
+        e->minmax_final_kernel     = create_kernel(program, "minmax_final");
+        e->normalize_kernel        = create_kernel(program, "normalize_disparity");
+        clReleaseProgram(program);
+    }
+    if (p->subpixel) {
+        program = build_program(e, sources[KERNEL_SUBPIXEL], files[KERNEL_SUBPIXEL], NULL);
+        e->subpixel_kernel         = create_kernel(program, "zncc_subpixel");
+        clReleaseProgram(program);
+    }
+    if (p->cost == COST_CENSUS) {
+        program = build_program(e, sources[KERNEL_CENSUS], files[KERNEL_CENSUS], NULL);
+        e->census_transform_kernel = create_kernel(program, "census_transform");
+        e->census_match_kernel     = create_kernel(program, "census_match");
+        clReleaseProgram(program);
+    }
+    if (p->sgmPaths) {
+        program = build_program(e, sources[KERNEL_SGM], files[KERNEL_SGM], NULL);
+        e->zncc_cost_volume_kernel = create_kernel(program, "zncc_cost_volume");
+        e->sgm_aggregate_kernel    = create_kernel(program, "sgm_aggregate");
+        e->sgm_select_kernel       = create_kernel(program, "sgm_select");
+        clReleaseProgram(program);
+    }
+
+    for (f = 0; f < KERNEL_FILES; f++)
+        free(sources[f]);
+
+    if (e->cache.dir)
+        printf("Kernel cache '%s': %u hits, %u misses (%u binaries rejected)\n", e->cache.dir, e->cache.hits, e->cache.misses, e->cache.rejected);
+    return 0;
+}
+
+/******************************************************************************
+ *  Device buffers of the current size
+ */
+static void opencl_alloc_buffers(zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    const uint32_t Width = e->Width, Height = e->Height;
+    cl_int status, s0, s1, s2, s3;
+    uint32_t l;
+
+    // ******** Create buffers memory objects ********
+    e->clmemImageL = clCreateBuffer(e->ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create buffer for the left image !\n");
+        abort();
+    }
+
+    e->clmemImageR = clCreateBuffer(e->ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create buffer for the right image !\n");
+        abort();
+    }
+
+    e->clmemDispMap1 = clCreateBuffer(e->ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create buffer for the Disparity map L vs R !\n");
+        abort();
+    }
+
+    e->clmemDispMap2 = clCreateBuffer(e->ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create buffer for the Disparity map R vs L !\n");
+        abort();
+    }
+
+    e->clmemDispMapCrossCheck = clCreateBuffer(e->ctx, CL_MEM_READ_ONLY, Width*Height, 0, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create buffer for the Disparity cross checking map !\n");
+        abort();
+    }
+
+    // Summed-area tables for the integral ZNCC mode: 4 image planes + one cross-product plane per |disparity|
+    if (p->mode == ZNCC_MODE_INTEGRAL) {
+        e->clmemIntegral = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, (4 + p->maxdisp + 1)*(Width+1)*(Height+1)*sizeof(cl_uint), 0, &status);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffer for the summed-area tables !\n");
+            abort();
+        }
+    }
+
+    // Window mean & 1/sigma planes of both images for the precomputed ZNCC mode
+    if (p->mode == ZNCC_MODE_PRECOMPUTED) {
+        e->clmemMeanL     = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_float), 0, &s0);
+        e->clmemInvSigmaL = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_float), 0, &s1);
+        e->clmemMeanR     = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_float), 0, &s2);
+        e->clmemInvSigmaR = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_float), 0, &s3);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS || s2 != CL_SUCCESS || s3 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for the window statistics !\n");
+            abort();
+        }
+    }
+
+    // Fused ZNCC mode: cost volume of every (pixel, d) score, left window centres run to Width+HALFWINSIZEX
+    if (p->mode == ZNCC_MODE_FUSED) {
+        e->clmemCostVolume = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, (p->maxdisp-p->mindisp+1)*Height*(Width+p->halfwinsizex)*sizeof(cl_float), 0, &status);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffer for the cost volume !\n");
+            abort();
+        }
+    }
+
+    // Device occlusion filling: row distances & next non-zero tables, filled map; min/max reduction results.
+    // Strips are filled & normalized on the host, once stitched
+    if (e->devicePostprocess && e->stripRows == e->mapHeight) {
+        e->clmemRowDist   = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_int), 0, &s0);
+        e->clmemNextDown  = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_int), 0, &s1);
+        e->clmemNextRight = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_int), 0, &s2);
+        e->clmemDepthMap  = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height, 0, &s3);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS || s2 != CL_SUCCESS || s3 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for the occlusion filling !\n");
+            abort();
+        }
+        e->clmemMinMaxPartial = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, 2*REDUCTION_GROUPS, 0, &s0);
+        e->clmemMinMax        = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, 2, 0, &s1);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for the normalization !\n");
+            abort();
+        }
+    }
+
+    if (p->subpixel) {
+        e->clmemDelta = clCreateBuffer(e->ctx, CL_MEM_WRITE_ONLY, Width*Height*sizeof(cl_float), 0, &status);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffer for the subpixel offsets !\n");
+            abort();
+        }
+    }
+
+    // SGM: 8-bit cost volume & 16-bit aggregated costs, one pass at a time
+    if (p->sgmPaths) {
+        if (sgm_ndisp(p) > SGM_MAX_NDISP) {
+            fprintf(stderr, "SGM handles up to %d disparities per pixel, not %u !\n", SGM_MAX_NDISP, sgm_ndisp(p));
+            abort();
+        }
+        e->clmemCost      = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sgm_ndisp(p), 0, &s0);
+        e->clmemAggregate = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sgm_ndisp(p)*sizeof(cl_ushort), 0, &s1);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for the SGM cost volume !\n");
+            abort();
+        }
+    }
+
+    // Census cost: 64-bit bitstrings of both images
+    if (p->cost == COST_CENSUS) {
+        e->clmemCensusL = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_ulong), 0, &s0);
+        e->clmemCensusR = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, Width*Height*sizeof(cl_ulong), 0, &s1);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for the census bitstrings !\n");
+            abort();
+        }
+    }
+
+    // Coarse-to-fine search: level 0 is the working resolution, the coarser levels halve it
+    opencl_pyramid_sizes(e);
+    e->pyramidBuffers   = e->pyramidLevels;
+    e->clmemPyrL[0]     = e->clmemImageL;
+    e->clmemPyrR[0]     = e->clmemImageR;
+    e->clmemPyrDisp1[0] = e->clmemDispMap1;
+    e->clmemPyrDisp2[0] = e->clmemDispMap2;
+    for (l = 1; l < e->pyramidBuffers; l++) {
+        e->clmemPyrL[l]     = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, e->pyrW[l]*e->pyrH[l], 0, &s0);
+        e->clmemPyrR[l]     = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, e->pyrW[l]*e->pyrH[l], 0, &s1);
+        e->clmemPyrDisp1[l] = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, e->pyrW[l]*e->pyrH[l], 0, &s2);
+        e->clmemPyrDisp2[l] = clCreateBuffer(e->ctx, CL_MEM_READ_WRITE, e->pyrW[l]*e->pyrH[l], 0, &s3);
+        if(s0 != CL_SUCCESS || s1 != CL_SUCCESS || s2 != CL_SUCCESS || s3 != CL_SUCCESS){
+            fprintf(stderr, "Fail to create buffers for pyramid level %u !\n", l);
+            abort();
+        }
+    }
+}
+
+/******************************************************************************
+ *  Pyramid levels & level sizes of the current working size. A smaller window
+ *  of a worker never gets more levels, nor larger ones, than its buffers hold
+ */
+static void opencl_pyramid_sizes(zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    uint32_t l;
+
+    e->pyramidLevels = 1;
+    if (p->pyramidLevels > 1)
+        e->pyramidLevels = zncc_pyramid_levels(p->pyramidLevels, e->Width, e->Height, p->halfwinsizex, p->halfwinsizey);
+    e->pyrW[0] = e->Width;
+    e->pyrH[0] = e->Height;
+    for (l = 1; l < e->pyramidLevels; l++) {
+        e->pyrW[l] = e->pyrW[l-1]/2;
+        e->pyrH[l] = e->pyrH[l-1]/2;
+    }
+}
+
+/******************************************************************************
+ *  Full size RGBA images, only created once a pair is given as RGBA images
+ */
+static void opencl_alloc_orig_images(zncc_engine_t *e)
+{
+    cl_int status;
+
+    e->clmemOrigImageL = clCreateImage2D(e->ctx, CL_MEM_READ_ONLY, &format, e->origW, e->origH, 0, NULL, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create Image for the left image !\n");
+        abort();
+    }
+
+    e->clmemOrigImageR = clCreateImage2D(e->ctx, CL_MEM_READ_ONLY, &format, e->origW, e->origH, 0, NULL, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create Image for the right image !\n");
+        abort();
+    }
+}
+
+static void opencl_release_buffers(zncc_engine_t *e)
+{
+    uint32_t l;
+
+    if (e->clmemOrigImageL) {
+        clReleaseMemObject(e->clmemOrigImageL);
+        clReleaseMemObject(e->clmemOrigImageR);
+        e->clmemOrigImageL = e->clmemOrigImageR = NULL;
+    }
+    if (!e->clmemImageL)
+        return;
+    clReleaseMemObject(e->clmemImageL);
+    clReleaseMemObject(e->clmemImageR);
+    clReleaseMemObject(e->clmemDispMap1);
+    clReleaseMemObject(e->clmemDispMap2);
+    clReleaseMemObject(e->clmemDispMapCrossCheck);
+    if (e->clmemIntegral)
+        clReleaseMemObject(e->clmemIntegral);
+    if (e->clmemCostVolume)
+        clReleaseMemObject(e->clmemCostVolume);
+    if (e->clmemMeanL) {
+        clReleaseMemObject(e->clmemMeanL);
+        clReleaseMemObject(e->clmemInvSigmaL);
+        clReleaseMemObject(e->clmemMeanR);
+        clReleaseMemObject(e->clmemInvSigmaR);
+    }
+    if (e->clmemRowDist) {
+        clReleaseMemObject(e->clmemRowDist);
+        clReleaseMemObject(e->clmemNextDown);
+        clReleaseMemObject(e->clmemNextRight);
+        clReleaseMemObject(e->clmemDepthMap);
+        clReleaseMemObject(e->clmemMinMaxPartial);
+        clReleaseMemObject(e->clmemMinMax);
+    }
+    if (e->params.subpixel)
+        clReleaseMemObject(e->clmemDelta);
+    if (e->clmemCensusL) {
+        clReleaseMemObject(e->clmemCensusL);
+        clReleaseMemObject(e->clmemCensusR);
+    }
+    if (e->clmemCost) {
+        clReleaseMemObject(e->clmemCost);
+        clReleaseMemObject(e->clmemAggregate);
+    }
+    for (l = 1; l < e->pyramidBuffers; l++) {
+        clReleaseMemObject(e->clmemPyrL[l]);
+        clReleaseMemObject(e->clmemPyrR[l]);
+        clReleaseMemObject(e->clmemPyrDisp1[l]);
+        clReleaseMemObject(e->clmemPyrDisp2[l]);
+    }
+    e->clmemImageL = e->clmemIntegral = e->clmemCostVolume = e->clmemMeanL = e->clmemRowDist = e->clmemCensusL = e->clmemCost = NULL;
+    e->pyramidLevels = e->pyramidBuffers = 1;
+}
+
+/******************************************************************************
+ *  Resize, ZNCC (L vs R & R vs L) and cross check with OpenCL, the cross checked
+ *  disparity map is read back in e->dDisparity. Grey working-size images are
+ *  written straight to the ZNCC inputs, without the resize stage.
+ */
+static void opencl_process_pair(zncc_engine_t *e, const uint8_t *imgL, const uint8_t *imgR, int32_t grey, uint8_t *depthMap)
+{
+    const zncc_params_t *p = &e->params;
+    const uint32_t Width = e->Width, Height = e->Height;
+    int32_t mind = p->mindisp, maxd = p->maxdisp;
+    cl_int status;
+
+    const size_t localWorkSize[]    = {16, 16};       // Local work size
+	  //const size_t localWorkSize[]    = {2, 2};       // Local work size (Odroid)
+		const size_t globalWorkSize[]   = {Height, Width};  // Global work size, one work-item per pixel of the working size
+
+    const size_t localWorkSize1D[]  = {localWorkSize[0]*localWorkSize[1]};      // 1-dimentional local work size
+    const size_t globalWorkSize1D[] = {globalWorkSize[0]*globalWorkSize[1]};    // 1-dimentional global work size
+
+    // zncc & cross_check have no bounds check: whole work-groups when they tile the image, the runtime picks otherwise
+    const size_t *pixelLocalWorkSize   = (Height % localWorkSize[0] == 0 && Width % localWorkSize[1] == 0) ? localWorkSize : NULL;
+    const size_t *pixelLocalWorkSize1D = (globalWorkSize1D[0] % localWorkSize1D[0] == 0) ? localWorkSize1D : NULL;
+
+    // Resize: RESIZE_PIXELS output pixels of a row per work-item, bounds checked
+    const size_t resizeGlobalWorkSize[] = {Height, (Width+RESIZE_PIXELS-1)/RESIZE_PIXELS};
+    const float scale = p->downscale;
+
+    // Summed-area tables for the integral ZNCC mode: 4 image planes + one cross-product plane per |disparity|
+    const size_t integralPlanes         = 4 + maxd + 1;
+    const size_t integralRowsWorkSize[] = {Height, integralPlanes};
+    const size_t integralColsWorkSize[] = {Width+1, integralPlanes};
+
+    // Tiled ZNCC mode: global size rounded up to whole work-groups, tiles sized by the window halo & disparity range
+    const size_t tiledGlobalWorkSize[] = {(Height+localWorkSize[0]-1)/localWorkSize[0]*localWorkSize[0],
+                                          (Width +localWorkSize[1]-1)/localWorkSize[1]*localWorkSize[1]};
+    const size_t leftTileSize  = (localWorkSize[0] + 2*p->halfwinsizey)*(localWorkSize[1] + 2*p->halfwinsizex);
+    const size_t rightTileSize = (localWorkSize[0] + 2*p->halfwinsizey)*(localWorkSize[1] + 2*p->halfwinsizex + maxd - mind);
+
+    // Fused ZNCC mode: left window centres run to Width+HALFWINSIZEX
+    const size_t fusedWidth = Width + p->halfwinsizex;
+    const size_t fusedGlobalWorkSize[] = {(Height    +localWorkSize[0]-1)/localWorkSize[0]*localWorkSize[0],
+                                          (fusedWidth+localWorkSize[1]-1)/localWorkSize[1]*localWorkSize[1]};
+
+    if (grey) {
+        // ******** Upload the grey images ********
+        status  = clEnqueueWriteBuffer(e->queue, e->clmemImageL, CL_FALSE, 0, Width*Height, imgL, 0, NULL, zncc_profile_event(e->params.profile, "upload L"));
+        status |= clEnqueueWriteBuffer(e->queue, e->clmemImageR, CL_FALSE, 0, Width*Height, imgR, 0, NULL, zncc_profile_event(e->params.profile, "upload R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Fail to upload the grey images to the device !\n");
+            abort();
+        }
+    } else {
+        // ******** Upload the original images ********
+        const size_t origin[] = {0, 0, 0};
+        const size_t region[] = {e->origW, e->origH, 1};
+        if (!e->clmemOrigImageL)
+            opencl_alloc_orig_images(e);
+        status  = clEnqueueWriteImage(e->queue, e->clmemOrigImageL, CL_FALSE, origin, region, e->origW*4, 0, imgL, 0, NULL, zncc_profile_event(e->params.profile, "upload L"));
+        status |= clEnqueueWriteImage(e->queue, e->clmemOrigImageR, CL_FALSE, origin, region, e->origW*4, 0, imgR, 0, NULL, zncc_profile_event(e->params.profile, "upload R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Fail to upload the original images to the device !\n");
+            abort();
+        }
+
+        // ******** Call the kernels ********
+        // Resize and grayscale kernel
+        status = 0;
+        status  = clSetKernelArg(e->resize_kernel, 0, sizeof(e->clmemOrigImageL), &e->clmemOrigImageL);
+        status |= clSetKernelArg(e->resize_kernel, 1, sizeof(e->clmemOrigImageR), &e->clmemOrigImageR);
+        status |= clSetKernelArg(e->resize_kernel, 2, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->resize_kernel, 3, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->resize_kernel, 4, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->resize_kernel, 5, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->resize_kernel, 6, sizeof(scale), &scale);
+
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'resize_kernel' !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->resize_kernel, 2, NULL, (const size_t*)&resizeGlobalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "resize"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'resize_kernel' on the device !\n");
+            abort();
+        }
+    }
+
+    if (p->cost == COST_CENSUS) {
+        // Census bitstrings of both images
+        status = 0;
+        status  = clSetKernelArg(e->census_transform_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->census_transform_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->census_transform_kernel, 2, sizeof(e->clmemCensusL), &e->clmemCensusL);
+        status |= clSetKernelArg(e->census_transform_kernel, 3, sizeof(e->clmemCensusR), &e->clmemCensusR);
+        status |= clSetKernelArg(e->census_transform_kernel, 4, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->census_transform_kernel, 5, sizeof(Height), &Height);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'census_transform_kernel' !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->census_transform_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "census transform"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'census_transform_kernel' on the device !\n");
+            abort();
+        }
+
+        // Disparity (L vs R) census kernel
+        status = 0;
+        status  = clSetKernelArg(e->census_match_kernel, 0, sizeof(e->clmemCensusL), &e->clmemCensusL);
+        status |= clSetKernelArg(e->census_match_kernel, 1, sizeof(e->clmemCensusR), &e->clmemCensusR);
+        status |= clSetKernelArg(e->census_match_kernel, 2, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->census_match_kernel, 3, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->census_match_kernel, 4, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->census_match_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->census_match_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->census_match_kernel, 7, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->census_match_kernel, 8, sizeof(maxd), &maxd);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'census_match_kernel', Dispmap1 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->census_match_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "census L vs R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'census_match_kernel' on the device, Dispmap1 !\n");
+            abort();
+        }
+
+        // Disparity (R vs L) census kernel
+        maxd *= -1;
+        status = 0;
+        status  = clSetKernelArg(e->census_match_kernel, 0, sizeof(e->clmemCensusR), &e->clmemCensusR);
+        status |= clSetKernelArg(e->census_match_kernel, 1, sizeof(e->clmemCensusL), &e->clmemCensusL);
+        status |= clSetKernelArg(e->census_match_kernel, 2, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->census_match_kernel, 7, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->census_match_kernel, 8, sizeof(mind), &mind);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'census_match_kernel', Dispmap2 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->census_match_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "census R vs L"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'census_match_kernel' on the device, Dispmap2 !\n");
+            abort();
+        }
+    } else if (p->sgmPaths) {
+        // Cost volumes & path aggregation instead of the winner-takes-all ZNCC passes
+        opencl_sgm(e);
+    } else if (p->pyramidLevels > 1) {
+        // Coarse-to-fine search, whatever the ZNCC mode
+        opencl_pyramid(e);
+    } else if (p->mode == ZNCC_MODE_INTEGRAL) {
+        // Summed-area tables of both images, their squares and the L x R cross products of every disparity
+        status = 0;
+        status  = clSetKernelArg(e->integral_rows_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->integral_rows_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->integral_rows_kernel, 2, sizeof(e->clmemIntegral), &e->clmemIntegral);
+        status |= clSetKernelArg(e->integral_rows_kernel, 3, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->integral_rows_kernel, 4, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->integral_cols_kernel, 0, sizeof(e->clmemIntegral), &e->clmemIntegral);
+        status |= clSetKernelArg(e->integral_cols_kernel, 1, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->integral_cols_kernel, 2, sizeof(Height), &Height);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'integral_kernel' !\n");
+            abort();
+        }
+
+        status  = clEnqueueNDRangeKernel(e->queue, e->integral_rows_kernel, 2, NULL, (const size_t*)&integralRowsWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "integral rows"));
+        status |= clEnqueueNDRangeKernel(e->queue, e->integral_cols_kernel, 2, NULL, (const size_t*)&integralColsWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "integral cols"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'integral_kernel' on the device !\n");
+            abort();
+        }
+
+        // Disparity (L vs R) and (R vs L) from the summed-area tables
+        int refPlane = 0, tgtPlane = 2, reverse = 0;
+        status = 0;
+        status  = clSetKernelArg(e->zncc_integral_kernel, 0, sizeof(e->clmemIntegral), &e->clmemIntegral);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 1, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 2, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 3, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 4, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 5, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 6, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 7, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 8, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 9, sizeof(refPlane), &refPlane);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 10, sizeof(tgtPlane), &tgtPlane);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 11, sizeof(reverse), &reverse);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_integral_kernel', Dispmap1 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_integral_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc integral L vs R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_integral_kernel' on the device, Dispmap1!\n");
+            abort();
+        }
+
+        maxd *= -1;
+        refPlane = 2; tgtPlane = 0; reverse = 1;
+        status = 0;
+        status  = clSetKernelArg(e->zncc_integral_kernel, 1, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 7, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 8, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 9, sizeof(refPlane), &refPlane);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 10, sizeof(tgtPlane), &tgtPlane);
+        status |= clSetKernelArg(e->zncc_integral_kernel, 11, sizeof(reverse), &reverse);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_integral_kernel' Dispmap2 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_integral_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc integral R vs L"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_integral_kernel' on the device, Dispmap2 !\n");
+            abort();
+        }
+    } else if (p->mode == ZNCC_MODE_PRECOMPUTED) {
+        // Window mean & 1/sigma of both images, shared by the two passes
+        status = 0;
+        status  = clSetKernelArg(e->window_stats_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->window_stats_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->window_stats_kernel, 2, sizeof(e->clmemMeanL), &e->clmemMeanL);
+        status |= clSetKernelArg(e->window_stats_kernel, 3, sizeof(e->clmemInvSigmaL), &e->clmemInvSigmaL);
+        status |= clSetKernelArg(e->window_stats_kernel, 4, sizeof(e->clmemMeanR), &e->clmemMeanR);
+        status |= clSetKernelArg(e->window_stats_kernel, 5, sizeof(e->clmemInvSigmaR), &e->clmemInvSigmaR);
+        status |= clSetKernelArg(e->window_stats_kernel, 6, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->window_stats_kernel, 7, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->window_stats_kernel, 8, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->window_stats_kernel, 9, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->window_stats_kernel, 10, sizeof(p->winsizearea), &p->winsizearea);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'window_stats_kernel' !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->window_stats_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "window stats"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'window_stats_kernel' on the device !\n");
+            abort();
+        }
+
+        // Disparity (L vs R) ZNCC kernel
+        status = 0;
+        status  = clSetKernelArg(e->zncc_precomputed_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 2, sizeof(e->clmemMeanL), &e->clmemMeanL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 3, sizeof(e->clmemInvSigmaL), &e->clmemInvSigmaL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 4, sizeof(e->clmemMeanR), &e->clmemMeanR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 5, sizeof(e->clmemInvSigmaR), &e->clmemInvSigmaR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 6, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 7, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 8, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 9, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 10, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 11, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 12, sizeof(maxd), &maxd);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_precomputed_kernel', Dispmap1 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_precomputed_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc precomputed L vs R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_precomputed_kernel' on the device, Dispmap1!\n");
+            abort();
+        }
+
+        // Disparity (R vs L) ZNCC kernel, same planes with the images swapped
+        maxd *= -1;
+        status = 0;
+        status  = clSetKernelArg(e->zncc_precomputed_kernel, 0, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 1, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 2, sizeof(e->clmemMeanR), &e->clmemMeanR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 3, sizeof(e->clmemInvSigmaR), &e->clmemInvSigmaR);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 4, sizeof(e->clmemMeanL), &e->clmemMeanL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 5, sizeof(e->clmemInvSigmaL), &e->clmemInvSigmaL);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 6, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 11, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_precomputed_kernel, 12, sizeof(mind), &mind);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_precomputed_kernel' Dispmap2 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_precomputed_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc precomputed R vs L"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_precomputed_kernel' on the device, Dispmap2 !\n");
+            abort();
+        }
+    } else if (p->mode == ZNCC_MODE_TILED) {
+        // Disparity (L vs R) ZNCC kernel, tiles in local memory
+        status = 0;
+        status  = clSetKernelArg(e->zncc_tiled_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 2, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 3, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 4, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 7, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 8, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 9, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 10, leftTileSize, NULL);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 11, rightTileSize, NULL);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_tiled_kernel', Dispmap1 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_tiled_kernel, 2, NULL, (const size_t*)&tiledGlobalWorkSize, (const size_t*)&localWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc tiled L vs R"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_tiled_kernel' on the device, Dispmap1!\n");
+            abort();
+        }
+
+        // Disparity (R vs L) ZNCC kernel, tiles in local memory
+        maxd *= -1;
+        status = 0;
+        status  = clSetKernelArg(e->zncc_tiled_kernel, 0, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 1, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 2, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 8, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_tiled_kernel, 9, sizeof(mind), &mind);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_tiled_kernel' Dispmap2 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_tiled_kernel, 2, NULL, (const size_t*)&tiledGlobalWorkSize, (const size_t*)&localWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc tiled R vs L"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_tiled_kernel' on the device, Dispmap2 !\n");
+            abort();
+        }
+    } else if (p->mode == ZNCC_MODE_FUSED) {
+        // Disparity (L vs R) ZNCC kernel, filling the cost volume on the way
+        status = 0;
+        status  = clSetKernelArg(e->zncc_fused_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 2, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 3, sizeof(e->clmemCostVolume), &e->clmemCostVolume);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 4, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 5, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 6, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 7, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 8, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 9, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_fused_kernel, 10, sizeof(maxd), &maxd);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_fused_kernel' !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_fused_kernel, 2, NULL, (const size_t*)&fusedGlobalWorkSize, (const size_t*)&localWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc fused"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_fused_kernel' on the device !\n");
+            abort();
+        }
+
+        // Disparity (R vs L) picked from the cost volume
+        status = 0;
+        status  = clSetKernelArg(e->zncc_reverse_best_kernel, 0, sizeof(e->clmemCostVolume), &e->clmemCostVolume);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 1, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 2, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 3, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 4, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 5, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_reverse_best_kernel, 6, sizeof(maxd), &maxd);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_reverse_best_kernel' !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_reverse_best_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc reverse best"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_reverse_best_kernel' on the device !\n");
+            abort();
+        }
+    } else {
+        // Disparity (L vs R) ZNCC kernel
+        status = 0;
+        status  = clSetKernelArg(e->zncc_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_kernel, 2, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+        status |= clSetKernelArg(e->zncc_kernel, 3, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_kernel, 4, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_kernel, 7, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_kernel, 8, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_kernel, 9, sizeof(maxd), &maxd);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_kernel', Dispmap1 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc L vs R"));
+
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_kernel' on the device, Dispmap1!\n");
+            abort();
+        }
+
+        // Disparity (R vs L) ZNCC kernel
+        maxd *= -1;
+        status = 0;
+        status  = clSetKernelArg(e->zncc_kernel, 0, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->zncc_kernel, 1, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->zncc_kernel, 2, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+        status |= clSetKernelArg(e->zncc_kernel, 3, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->zncc_kernel, 4, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->zncc_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_kernel, 7, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_kernel, 8, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_kernel, 9, sizeof(mind), &mind);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'zncc_kernel' Dispmap2 !\n");
+            abort();
+        }
+
+        status = clEnqueueNDRangeKernel(e->queue, e->zncc_kernel, 2, NULL, (const size_t*)&globalWorkSize, pixelLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "zncc R vs L"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_kernel' on the device, Dispmap2 !\n");
+            abort();
+        }
+    }
+
+    // Cross checking kernel
+    status = 0;
+    status  = clSetKernelArg(e->cross_check_kernel, 0, sizeof(e->clmemDispMap1), &e->clmemDispMap1);
+    status |= clSetKernelArg(e->cross_check_kernel, 1, sizeof(e->clmemDispMap2), &e->clmemDispMap2);
+    status |= clSetKernelArg(e->cross_check_kernel, 2, sizeof(e->clmemDispMapCrossCheck), &e->clmemDispMapCrossCheck);
+    status |= clSetKernelArg(e->cross_check_kernel, 3, sizeof(p->threshold), &p->threshold);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to set kernel arguments for 'cross_check_kernel' !\n");
+        abort();
+    }
+
+    status = clEnqueueNDRangeKernel(e->queue, e->cross_check_kernel, 1, NULL, (const size_t*)&globalWorkSize1D, pixelLocalWorkSize1D, 0, NULL, zncc_profile_event(e->params.profile, "cross check"));
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to execute 'cross_check_kernel' on the device !\n");
+        abort();
+    }
+
+    // Subpixel offsets of the cross checked map, read back with the final readback
+    if (p->subpixel) {
+        status = 0;
+        status  = clSetKernelArg(e->subpixel_kernel, 0, sizeof(e->clmemImageL), &e->clmemImageL);
+        status |= clSetKernelArg(e->subpixel_kernel, 1, sizeof(e->clmemImageR), &e->clmemImageR);
+        status |= clSetKernelArg(e->subpixel_kernel, 2, sizeof(e->clmemDispMapCrossCheck), &e->clmemDispMapCrossCheck);
+        status |= clSetKernelArg(e->subpixel_kernel, 3, sizeof(e->clmemDelta), &e->clmemDelta);
+        status |= clSetKernelArg(e->subpixel_kernel, 4, sizeof(Width), &Width);
+        status |= clSetKernelArg(e->subpixel_kernel, 5, sizeof(Height), &Height);
+        status |= clSetKernelArg(e->subpixel_kernel, 6, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->subpixel_kernel, 7, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->subpixel_kernel, 8, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->subpixel_kernel, 9, sizeof(p->mindisp), &p->mindisp);
+        status |= clSetKernelArg(e->subpixel_kernel, 10, sizeof(p->maxdisp), &p->maxdisp);
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to set kernel arguments for 'subpixel_kernel' !\n");
+            abort();
+        }
+
+        status  = clEnqueueNDRangeKernel(e->queue, e->subpixel_kernel, 2, NULL, (const size_t*)&globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "subpixel"));
+        status |= clEnqueueReadBuffer(e->queue, e->clmemDelta, CL_FALSE, 0, Width*Height*sizeof(cl_float), e->delta, 0, NULL, zncc_profile_event(e->params.profile, "readback subpixel"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'subpixel_kernel' on the device !\n");
+            abort();
+        }
+    }
+
+    // ******** One blocking readback: the final depth map, or the cross checked map for the host stages ********
+    if (depthMap) {
+        opencl_postprocess(e);
+        status = clEnqueueReadBuffer(e->queue, e->clmemDepthMap, CL_TRUE, 0, Width*Height, depthMap, 0, NULL, zncc_profile_event(e->params.profile, "readback"));
+    } else {
+        status = clEnqueueReadBuffer(e->queue, e->clmemDispMapCrossCheck, CL_TRUE, 0, Width*Height, e->dDisparity, 0, NULL, zncc_profile_event(e->params.profile, "readback"));
+    }
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "'cross_check_kernel': Failed to send the data to host !\n");
+        abort();
+    }
+    zncc_profile_collect(e->params.profile);
+}
+
+/******************************************************************************
+ *  Occlusion filling (occlusion_filling.cl) of clmemDispMapCrossCheck into clmemDepthMap, then
+ *  normalization (normalize.cl) in place: min/max of every work-group, min/max of the groups,
+ *  0..255 stretch. Same map as occlusion_filling & normalization on the host.
+ */
+static void opencl_postprocess(zncc_engine_t *e)
+{
+    const uint32_t Width = e->Width, Height = e->Height, pixels = Width*Height, groups = REDUCTION_GROUPS;
+    cl_int status;
+
+    const size_t rowsWorkSize[]     = {Height};
+    const size_t colsWorkSize[]     = {Width};
+    const size_t globalWorkSize[]   = {Height, Width};
+    const size_t globalWorkSize1D[] = {pixels};
+    const size_t partialWorkSize[]  = {REDUCTION_GROUPS*REDUCTION_LOCAL_SIZE};
+    const size_t reductionLocalWorkSize[] = {REDUCTION_LOCAL_SIZE};
+
+    // Occlusion filling kernels
+    status  = clSetKernelArg(e->fill_row_tables_kernel, 0, sizeof(e->clmemDispMapCrossCheck), &e->clmemDispMapCrossCheck);
+    status |= clSetKernelArg(e->fill_row_tables_kernel, 1, sizeof(e->clmemRowDist), &e->clmemRowDist);
+    status |= clSetKernelArg(e->fill_row_tables_kernel, 2, sizeof(e->clmemNextRight), &e->clmemNextRight);
+    status |= clSetKernelArg(e->fill_row_tables_kernel, 3, sizeof(Width), &Width);
+    status |= clSetKernelArg(e->fill_row_tables_kernel, 4, sizeof(Height), &Height);
+    status |= clSetKernelArg(e->fill_col_tables_kernel, 0, sizeof(e->clmemDispMapCrossCheck), &e->clmemDispMapCrossCheck);
+    status |= clSetKernelArg(e->fill_col_tables_kernel, 1, sizeof(e->clmemNextDown), &e->clmemNextDown);
+    status |= clSetKernelArg(e->fill_col_tables_kernel, 2, sizeof(Width), &Width);
+    status |= clSetKernelArg(e->fill_col_tables_kernel, 3, sizeof(Height), &Height);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 0, sizeof(e->clmemDispMapCrossCheck), &e->clmemDispMapCrossCheck);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 1, sizeof(e->clmemRowDist), &e->clmemRowDist);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 2, sizeof(e->clmemNextDown), &e->clmemNextDown);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 3, sizeof(e->clmemNextRight), &e->clmemNextRight);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 4, sizeof(e->clmemDepthMap), &e->clmemDepthMap);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 5, sizeof(Width), &Width);
+    status |= clSetKernelArg(e->fill_occlusions_kernel, 6, sizeof(Height), &Height);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to set kernel arguments for 'occlusion_filling_kernel' !\n");
+        abort();
+    }
+
+    status  = clEnqueueNDRangeKernel(e->queue, e->fill_row_tables_kernel, 1, NULL, rowsWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "fill row tables"));
+    status |= clEnqueueNDRangeKernel(e->queue, e->fill_col_tables_kernel, 1, NULL, colsWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "fill col tables"));
+    status |= clEnqueueNDRangeKernel(e->queue, e->fill_occlusions_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, "occlusion filling"));
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to execute 'occlusion_filling_kernel' on the device !\n");
+        abort();
+    }
+
+    // The refined map needs the filled disparities, the last blocking readback waits for this one
+    if (e->params.subpixel) {
+        status = clEnqueueReadBuffer(e->queue, e->clmemDepthMap, CL_FALSE, 0, Width*Height, e->filled, 0, NULL, zncc_profile_event(e->params.profile, "readback filled"));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "'occlusion_filling_kernel': Failed to send the data to host !\n");
+            abort();
+        }
+    }
+
+    // Normalization kernels
+    status  = clSetKernelArg(e->minmax_partial_kernel, 0, sizeof(e->clmemDepthMap), &e->clmemDepthMap);
+    status |= clSetKernelArg(e->minmax_partial_kernel, 1, sizeof(e->clmemMinMaxPartial), &e->clmemMinMaxPartial);
+    status |= clSetKernelArg(e->minmax_partial_kernel, 2, REDUCTION_LOCAL_SIZE, NULL);
+    status |= clSetKernelArg(e->minmax_partial_kernel, 3, REDUCTION_LOCAL_SIZE, NULL);
+    status |= clSetKernelArg(e->minmax_partial_kernel, 4, sizeof(pixels), &pixels);
+    status |= clSetKernelArg(e->minmax_final_kernel, 0, sizeof(e->clmemMinMaxPartial), &e->clmemMinMaxPartial);
+    status |= clSetKernelArg(e->minmax_final_kernel, 1, sizeof(e->clmemMinMax), &e->clmemMinMax);
+    status |= clSetKernelArg(e->minmax_final_kernel, 2, REDUCTION_LOCAL_SIZE, NULL);
+    status |= clSetKernelArg(e->minmax_final_kernel, 3, REDUCTION_LOCAL_SIZE, NULL);
+    status |= clSetKernelArg(e->minmax_final_kernel, 4, sizeof(groups), &groups);
+    status |= clSetKernelArg(e->normalize_kernel, 0, sizeof(e->clmemDepthMap), &e->clmemDepthMap);
+    status |= clSetKernelArg(e->normalize_kernel, 1, sizeof(e->clmemMinMax), &e->clmemMinMax);
+    status |= clSetKernelArg(e->normalize_kernel, 2, sizeof(pixels), &pixels);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to set kernel arguments for 'normalize_kernel' !\n");
+        abort();
+    }
+
+    status  = clEnqueueNDRangeKernel(e->queue, e->minmax_partial_kernel, 1, NULL, partialWorkSize, reductionLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "min/max partial"));
+    status |= clEnqueueNDRangeKernel(e->queue, e->minmax_final_kernel, 1, NULL, reductionLocalWorkSize, reductionLocalWorkSize, 0, NULL, zncc_profile_event(e->params.profile, "min/max final"));
+    status |= clEnqueueNDRangeKernel(e->queue, e->normalize_kernel, 1, NULL, globalWorkSize1D, NULL, 0, NULL, zncc_profile_event(e->params.profile, "normalization"));
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to execute 'normalize_kernel' on the device !\n");
+        abort();
+    }
+}
+
+static void opencl_destroy(zncc_engine_t *e)
+{
+    clReleaseKernel(e->resize_kernel);
+    clReleaseKernel(e->zncc_kernel);
+    clReleaseKernel(e->cross_check_kernel);
+    if (e->params.mode == ZNCC_MODE_INTEGRAL) {
+        clReleaseKernel(e->integral_rows_kernel);
+        clReleaseKernel(e->integral_cols_kernel);
+        clReleaseKernel(e->zncc_integral_kernel);
+    }
+    if (e->params.mode == ZNCC_MODE_PRECOMPUTED) {
+        clReleaseKernel(e->window_stats_kernel);
+        clReleaseKernel(e->zncc_precomputed_kernel);
+    }
+    if (e->params.mode == ZNCC_MODE_TILED)
+        clReleaseKernel(e->zncc_tiled_kernel);
+    if (e->params.mode == ZNCC_MODE_FUSED) {
+        clReleaseKernel(e->zncc_fused_kernel);
+        clReleaseKernel(e->zncc_reverse_best_kernel);
+    }
+    if (e->params.pyramidLevels > 1) {
+        clReleaseKernel(e->downsample_kernel);
+        clReleaseKernel(e->zncc_guided_kernel);
+    }
+    if (e->devicePostprocess) {
+        clReleaseKernel(e->fill_row_tables_kernel);
+        clReleaseKernel(e->fill_col_tables_kernel);
+        clReleaseKernel(e->fill_occlusions_kernel);
+        clReleaseKernel(e->minmax_partial_kernel);
+        clReleaseKernel(e->minmax_final_kernel);
+        clReleaseKernel(e->normalize_kernel);
+    }
+    if (e->params.subpixel)
+        clReleaseKernel(e->subpixel_kernel);
+    if (e->params.cost == COST_CENSUS) {
+        clReleaseKernel(e->census_transform_kernel);
+        clReleaseKernel(e->census_match_kernel);
+    }
+    if (e->params.sgmPaths) {
+        clReleaseKernel(e->zncc_cost_volume_kernel);
+        clReleaseKernel(e->sgm_aggregate_kernel);
+        clReleaseKernel(e->sgm_select_kernel);
+    }
+    clReleaseCommandQueue(e->queue);
+    clReleaseContext(e->ctx);
+}
+
+/******************************************************************************
+ *  Coarse-to-fine ZNCC (zncc_pyramid.cl): the working images are halved pyramidLevels-1 times, the
+ *  coarsest level runs zncc.cl over the whole scaled range, every finer level refines +-pyramidBand
+ *  around twice the disparity of its parent. Results land in clmemDispMap1 (L vs R) & clmemDispMap2 (R vs L).
+ */
+static void opencl_pyramid(zncc_engine_t *e)
+{
+    const zncc_params_t *p = &e->params;
+    cl_int status;
+    int32_t l, levels = e->pyramidLevels, mind, maxd, band = p->pyramidBand;
+    size_t globalWorkSize[2];
+    char stage[48];                     // timing report entry
+
+    // ******** Build the pyramid ********
+    for (l = 1; l < levels; l++) {
+        globalWorkSize[0] = e->pyrH[l];
+        globalWorkSize[1] = e->pyrW[l];
+        status  = clSetKernelArg(e->downsample_kernel, 0, sizeof(cl_mem), &e->clmemPyrL[l-1]);
+        status |= clSetKernelArg(e->downsample_kernel, 1, sizeof(cl_mem), &e->clmemPyrL[l]);
+        status |= clSetKernelArg(e->downsample_kernel, 2, sizeof(uint32_t), &e->pyrW[l-1]);
+        status |= clSetKernelArg(e->downsample_kernel, 3, sizeof(uint32_t), &e->pyrH[l-1]);
+        snprintf(stage, sizeof(stage), "downsample L level %d", l);
+        status |= clEnqueueNDRangeKernel(e->queue, e->downsample_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        status |= clSetKernelArg(e->downsample_kernel, 0, sizeof(cl_mem), &e->clmemPyrR[l-1]);
+        status |= clSetKernelArg(e->downsample_kernel, 1, sizeof(cl_mem), &e->clmemPyrR[l]);
+        snprintf(stage, sizeof(stage), "downsample R level %d", l);
+        status |= clEnqueueNDRangeKernel(e->queue, e->downsample_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'downsample_kernel' on the device, level %d !\n", l);
+            abort();
+        }
+    }
+
+    // ******** Full range on the coarsest level ********
+    l    = levels - 1;
+    mind = 0;
+    maxd = (p->maxdisp + (1 << l) - 1) >> l;
+    globalWorkSize[0] = e->pyrH[l];
+    globalWorkSize[1] = e->pyrW[l];
+    status  = clSetKernelArg(e->zncc_kernel, 0, sizeof(cl_mem), &e->clmemPyrL[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 1, sizeof(cl_mem), &e->clmemPyrR[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 2, sizeof(cl_mem), &e->clmemPyrDisp1[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 3, sizeof(uint32_t), &e->pyrW[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 4, sizeof(uint32_t), &e->pyrH[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+    status |= clSetKernelArg(e->zncc_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+    status |= clSetKernelArg(e->zncc_kernel, 7, sizeof(p->winsizearea), &p->winsizearea);
+    status |= clSetKernelArg(e->zncc_kernel, 8, sizeof(mind), &mind);
+    status |= clSetKernelArg(e->zncc_kernel, 9, sizeof(maxd), &maxd);
+    snprintf(stage, sizeof(stage), "zncc L vs R level %d", l);
+    status |= clEnqueueNDRangeKernel(e->queue, e->zncc_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+    maxd = -maxd;
+    status |= clSetKernelArg(e->zncc_kernel, 0, sizeof(cl_mem), &e->clmemPyrR[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 1, sizeof(cl_mem), &e->clmemPyrL[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 2, sizeof(cl_mem), &e->clmemPyrDisp2[l]);
+    status |= clSetKernelArg(e->zncc_kernel, 8, sizeof(maxd), &maxd);
+    status |= clSetKernelArg(e->zncc_kernel, 9, sizeof(mind), &mind);
+    snprintf(stage, sizeof(stage), "zncc R vs L level %d", l);
+    status |= clEnqueueNDRangeKernel(e->queue, e->zncc_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Failed to execute 'zncc_kernel' on the coarsest pyramid level !\n");
+        abort();
+    }
+
+    // ******** Refine around the parent disparity down to the working resolution ********
+    for (l = levels - 2; l >= 0; l--) {
+        mind = 0;
+        maxd = (p->maxdisp + (1 << l) - 1) >> l;
+        globalWorkSize[0] = e->pyrH[l];
+        globalWorkSize[1] = e->pyrW[l];
+        status  = clSetKernelArg(e->zncc_guided_kernel, 0, sizeof(cl_mem), &e->clmemPyrL[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 1, sizeof(cl_mem), &e->clmemPyrR[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 2, sizeof(cl_mem), &e->clmemPyrDisp1[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 3, sizeof(cl_mem), &e->clmemPyrDisp1[l+1]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 4, sizeof(uint32_t), &e->pyrW[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 5, sizeof(uint32_t), &e->pyrH[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 6, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 7, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 8, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 9, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 10, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 11, sizeof(uint32_t), &e->pyrW[l+1]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 12, sizeof(uint32_t), &e->pyrH[l+1]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 13, sizeof(band), &band);
+        snprintf(stage, sizeof(stage), "zncc guided L vs R level %d", l);
+        status |= clEnqueueNDRangeKernel(e->queue, e->zncc_guided_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        maxd = -maxd;
+        status |= clSetKernelArg(e->zncc_guided_kernel, 0, sizeof(cl_mem), &e->clmemPyrR[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 1, sizeof(cl_mem), &e->clmemPyrL[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 2, sizeof(cl_mem), &e->clmemPyrDisp2[l]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 3, sizeof(cl_mem), &e->clmemPyrDisp2[l+1]);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 9, sizeof(maxd), &maxd);
+        status |= clSetKernelArg(e->zncc_guided_kernel, 10, sizeof(mind), &mind);
+        snprintf(stage, sizeof(stage), "zncc guided R vs L level %d", l);
+        status |= clEnqueueNDRangeKernel(e->queue, e->zncc_guided_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_guided_kernel' on pyramid level %d !\n", l);
+            abort();
+        }
+    }
+}
+
+/******************************************************************************
+ *  Semi-global matching (sgm.cl), for each pass: the ZNCC cost volume, the path
+ *  directions one after the other (one work-group per scanline, the sums of a
+ *  direction are added to the previous ones) and the lowest sum of every pixel.
+ *  Results land in clmemDispMap1 (L vs R) & clmemDispMap2 (R vs L).
+ */
+static void opencl_sgm(zncc_engine_t *e)
+{
+    // Left to right, right to left, top to bottom, bottom to top, then the diagonals
+    static const int32_t directions[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1} };
+    const zncc_params_t *p = &e->params;
+    const size_t localWorkSize[] = {SGM_LOCAL_SIZE};
+    size_t globalWorkSize[2];
+    cl_mem passL[2], passR[2], passDisp[2];
+    int32_t pass, r, mind, maxd, ndisp, dx, dy, first;
+    cl_int status;
+    char stage[48];                     // timing report entry
+
+    passL[0] = e->clmemImageL; passR[0] = e->clmemImageR; passDisp[0] = e->clmemDispMap1;
+    passL[1] = e->clmemImageR; passR[1] = e->clmemImageL; passDisp[1] = e->clmemDispMap2;
+    for (pass = 0; pass < 2; pass++) {
+        mind  = pass ? -p->maxdisp : p->mindisp;
+        maxd  = pass ? p->mindisp : p->maxdisp;
+        ndisp = maxd - mind + 1;
+
+        // ******** ZNCC cost volume ********
+        globalWorkSize[0] = e->Height;
+        globalWorkSize[1] = e->Width;
+        status  = clSetKernelArg(e->zncc_cost_volume_kernel, 0, sizeof(cl_mem), &passL[pass]);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 1, sizeof(cl_mem), &passR[pass]);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 2, sizeof(cl_mem), &e->clmemCost);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 3, sizeof(uint32_t), &e->Width);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 4, sizeof(uint32_t), &e->Height);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 5, sizeof(p->halfwinsizex), &p->halfwinsizex);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 6, sizeof(p->halfwinsizey), &p->halfwinsizey);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 7, sizeof(p->winsizearea), &p->winsizearea);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 8, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->zncc_cost_volume_kernel, 9, sizeof(maxd), &maxd);
+        snprintf(stage, sizeof(stage), "cost volume %s", pass ? "R vs L" : "L vs R");
+        status |= clEnqueueNDRangeKernel(e->queue, e->zncc_cost_volume_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'zncc_cost_volume_kernel' on the device, pass %d !\n", pass);
+            abort();
+        }
+
+        // ******** Path aggregation, one direction after the other ********
+        for (r = 0; r < p->sgmPaths; r++) {
+            dx    = directions[r][0];
+            dy    = directions[r][1];
+            first = r == 0;
+            globalWorkSize[0] = ((dy ? e->Width : 0) + (dx ? (dy ? e->Height - 1 : e->Height) : 0))*SGM_LOCAL_SIZE;
+            status  = clSetKernelArg(e->sgm_aggregate_kernel, 0, sizeof(cl_mem), &e->clmemCost);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 1, sizeof(cl_mem), &e->clmemAggregate);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 2, sizeof(uint32_t), &e->Width);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 3, sizeof(uint32_t), &e->Height);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 4, sizeof(ndisp), &ndisp);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 5, sizeof(dx), &dx);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 6, sizeof(dy), &dy);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 7, sizeof(p->sgmP1), &p->sgmP1);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 8, sizeof(p->sgmP2), &p->sgmP2);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 9, sizeof(first), &first);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 10, (ndisp + 2)*sizeof(cl_ushort), NULL);
+            status |= clSetKernelArg(e->sgm_aggregate_kernel, 11, SGM_LOCAL_SIZE*sizeof(cl_ushort), NULL);
+            snprintf(stage, sizeof(stage), "sgm %s path (%d,%d)", pass ? "R vs L" : "L vs R", dx, dy);
+            status |= clEnqueueNDRangeKernel(e->queue, e->sgm_aggregate_kernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, zncc_profile_event(e->params.profile, stage));
+            if(status != CL_SUCCESS){
+                fprintf(stderr, "Failed to execute 'sgm_aggregate_kernel' on the device, pass %d, path %d !\n", pass, r);
+                abort();
+            }
+        }
+
+        // ******** Lowest aggregated cost ********
+        globalWorkSize[0] = e->Height;
+        globalWorkSize[1] = e->Width;
+        status  = clSetKernelArg(e->sgm_select_kernel, 0, sizeof(cl_mem), &e->clmemAggregate);
+        status |= clSetKernelArg(e->sgm_select_kernel, 1, sizeof(cl_mem), &passDisp[pass]);
+        status |= clSetKernelArg(e->sgm_select_kernel, 2, sizeof(uint32_t), &e->Width);
+        status |= clSetKernelArg(e->sgm_select_kernel, 3, sizeof(uint32_t), &e->Height);
+        status |= clSetKernelArg(e->sgm_select_kernel, 4, sizeof(mind), &mind);
+        status |= clSetKernelArg(e->sgm_select_kernel, 5, sizeof(maxd), &maxd);
+        snprintf(stage, sizeof(stage), "sgm select %s", pass ? "R vs L" : "L vs R");
+        status |= clEnqueueNDRangeKernel(e->queue, e->sgm_select_kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, zncc_profile_event(e->params.profile, stage));
+        if(status != CL_SUCCESS){
+            fprintf(stderr, "Failed to execute 'sgm_select_kernel' on the device, pass %d !\n", pass);
+            abort();
+        }
+    }
+}
+
+/******************************************************************************
+ *  Function that use to read kernel file, NULL when it can not be opened
+ */
+char *read_kernel_file(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "Fail to open kernel file '%s' !\n", filename);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *res = (char *) malloc(size+1);
+    if(!res) { // check error
+        perror("Fail to read file, can not allocation memory !");
+        abort();
+    }
+
+    // read file from stream
+    if(fread(res, 1, size, f) < size) { // check error
+        perror("Fail to read file, fread abort !");
+        abort();
+    }
+
+    fclose(f);
+    res[size] = '\0';
+    return res;
+}
+
+/******************************************************************************
+ *  -D options that turn the window and the number of disparities of zncc.cl / zncc_fused.cl into
+ *  compile-time constants, NULL for sizes too unusual to be worth a program of their own
+ */
+static const char *specialize_options(char *options, size_t size, const zncc_params_t *p)
+{
+    const int32_t ndisp = p->maxdisp - p->mindisp + 1;
+    if (p->halfwinsizex < 1 || p->halfwinsizex > 16 || p->halfwinsizey < 1 || p->halfwinsizey > 32 || ndisp < 1 || ndisp > 256)
+        return NULL;
+    snprintf(options, size, "-D ZNCC_SPECIALIZED -D ZNCC_HALFWINSIZEX=%d -D ZNCC_HALFWINSIZEY=%d -D ZNCC_WINSIZEAREA=%d -D ZNCC_NDISP=%d",
+             p->halfwinsizex, p->halfwinsizey, p->winsizearea, ndisp);
+    return options;
+}
+
+/******************************************************************************
+ *  Function that use to build the program of a kernel file, through the engine's program binary cache.
+ *  Specialized builds (options != NULL) fall back to the generic program when they fail.
+ */
+static cl_program build_program(zncc_engine_t *e, const char *source, const char *filename, const char *options)
+{
+    cl_program program = NULL;
+
+    printf("Building program '%s'%s\n", filename, options ? " (specialized)" : "");
+    // build program, or load it from the cache
+    if (options) {
+        program = kernel_cache_build(&e->cache, e->ctx, e->device, source, options);
+        if (!program)
+            fprintf(stderr, "Specialized build of '%s' failed, using the generic program\n", filename);
+    }
+    if (!program)
+        program = kernel_cache_build(&e->cache, e->ctx, e->device, source, "");
+    if (!program) {
+        fprintf(stderr, "Fail to build kernel file: '%s' !\n", filename);
+        abort();
+    }
+    return program;
+}
+
+/******************************************************************************
+ *  Function that use to create a kernel of a built program, the kernel keeps the program
+ */
+static cl_kernel create_kernel(cl_program program, const char *kernel_name)
+{
+    cl_int status;
+    cl_kernel res = clCreateKernel(program, kernel_name, &status);
+    if(status != CL_SUCCESS){
+        fprintf(stderr, "Fail to create kernel, in kernel file: '%s' !\n", kernel_name);
+        abort();
+    }
+    printf("Succefully builed kernel '%s'\n", kernel_name);
+    return res;
+}
+#endif
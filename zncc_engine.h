@@ -0,0 +1,106 @@
+/******************************************************************************
+ * FILENAME :        zncc_engine.h
+ *
+ * DESCRIPTION :
+ *       Persistent stereo engine: one handle keeps the OpenCL context, queue,
+ *       compiled kernels and device buffers (or the native CPU backend state)
+ *       alive across image pairs.
+ *       + zncc_engine_create        : pick the backend (or all of them), build every
+ *                                     kernel once
+ *       + zncc_engine_process_pair  : resize, ZNCC, cross check, occlusion filling
+ *                                     & normalization of one RGBA pair, all on the
+ *                                     device with the OpenCL backend
+ *       + zncc_engine_process_grey_pair : same from pre-downscaled grey images
+ *       + zncc_engine_destroy       : release everything
+ *       Buffers are keyed by the input size, they are only reallocated when a
+ *       pair of another size comes in. With a memory budget they only hold a
+ *       strip of the map, the pair is processed strip by strip.
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_ENGINE_H
+#define ZNCC_ENGINE_H
+
+#include <stdint.h>
+#include "zncc_profile.h"
+
+typedef enum {
+    ZNCC_MODE_NAIVE = 0,            // zncc.cl, full window loops for every disparity
+    ZNCC_MODE_INTEGRAL,             // zncc_integral.cl, summed-area table lookups, cost independent of window size
+    ZNCC_MODE_PRECOMPUTED,          // zncc_precomputed.cl, window mean & 1/sigma planes computed once for all disparities
+    ZNCC_MODE_TILED,                // zncc_tiled.cl, left & right tiles staged in local memory per work-group
+    ZNCC_MODE_FUSED                 // zncc_fused.cl, one correlation pass into a cost volume feeds both disparity maps
+} zncc_mode_t;
+
+typedef enum {
+    COST_ZNCC = 0,                  // ZNCC score of the --zncc mode
+    COST_CENSUS                     // census.cl, Hamming distance of 9x7 census bitstrings summed over the window
+} matching_cost_t;
+
+typedef enum {
+    BACKEND_AUTO = 0,               // OpenCL when a device is available, native CPU backend otherwise
+    BACKEND_OPENCL,
+    BACKEND_CPU,                    // zncc_cpu.c, multithreaded SIMD, no OpenCL needed
+    BACKEND_ALL                     // every OpenCL device of every platform and the CPU backend, each pair split
+                                    // into row bands sized after their measured throughput, run concurrently
+} backend_t;
+
+typedef enum {
+    OCCLUSION_FILL_TRANSFORM = 0,   // occlusion_filling, distance transform, O(w*h) whatever the occlusion width
+    OCCLUSION_FILL_RING             // occlusion_filling_ring, growing square search, O(k^2) per occluded pixel
+} occlusion_fill_t;
+
+typedef enum {
+    POSTPROCESS_DEVICE = 0,         // occlusion_filling.cl & normalize.cl, one readback of the final depth map
+    POSTPROCESS_HOST                // occlusion_filling & normalization on the host, after reading the cross checked map
+} postprocess_t;
+
+typedef enum {
+    RESIZE_POINT = 0,               // resize, one source pixel per output pixel
+    RESIZE_AREA,                    // resize_area, box average of the whole source area
+    RESIZE_BILINEAR                 // resize_bilinear, interpolation at the centre of the output pixel
+} resize_filter_t;
+
+typedef struct {
+    float downscale;                // the output is (w/downscale) x (h/downscale), any factor >= 1
+    resize_filter_t resizeFilter;   // RGBA pairs only, grey pairs come pre-downscaled
+    int32_t halfwinsizex;
+    int32_t halfwinsizey;
+    int32_t winsizearea;
+    int32_t mindisp;
+    int32_t maxdisp;
+    int32_t threshold;              // cross check threshold
+    occlusion_fill_t occlusionFill; // same depth map either way
+    postprocess_t postprocess;      // OpenCL backend only, OCCLUSION_FILL_RING always runs on the host
+    int32_t subpixel;               // parabola refinement of the disparities, see zncc_engine_subpixel_map
+    matching_cost_t cost;           // COST_CENSUS replaces the ZNCC passes, the mode is not used then
+    zncc_mode_t mode;               // OpenCL ZNCC kernel
+    int32_t sgmPaths;               // 4 or 8: semi-global matching over the ZNCC cost volume instead of
+    int32_t sgmP1, sgmP2;           // winner-takes-all, penalties of +-1 & larger disparity steps; 0 = off
+    backend_t backend;
+    uint64_t memoryBudget;          // bytes of correlation buffers (device, or host with the CPU backend), the
+                                    // map is processed in strips of halfwinsizey context rows that fit; 0 = whole map
+    uint32_t pyramidLevels;         // coarse-to-fine levels, 1 = exhaustive search
+    int32_t pyramidBand;
+    const char *kernelCacheDir;     // compiled OpenCL programs are cached there, NULL = no cache
+    zncc_profile_t *profile;        // per-stage timings are appended there, NULL = no profiling
+} zncc_params_t;
+
+typedef struct zncc_engine zncc_engine_t;
+
+// NULL when BACKEND_OPENCL is asked for and no OpenCL device is available
+zncc_engine_t *zncc_engine_create(const zncc_params_t *params);
+// Normalized depth map of (w/downscale) x (h/downscale) pixels, to be freed by the caller
+uint8_t *zncc_engine_process_pair(zncc_engine_t *engine, const uint8_t *origImgL, const uint8_t *origImgR, uint32_t w, uint32_t h,
+                                  uint32_t *width, uint32_t *height);
+// Same from the (w/downscale) x (h/downscale) grey images of zncc_decode_grey_file, no resize stage
+uint8_t *zncc_engine_process_grey_pair(zncc_engine_t *engine, const uint8_t *greyL, const uint8_t *greyR, uint32_t w, uint32_t h,
+                                       uint32_t *width, uint32_t *height);
+// Float disparities (working-size pixels) behind the last depth map, before normalization: occlusion
+// filled map + subpixel offset of every cross checked pixel. Owned by the engine, valid until the next
+// pair; NULL unless params.subpixel is set
+const float *zncc_engine_subpixel_map(const zncc_engine_t *engine);
+const char *zncc_engine_backend_name(const zncc_engine_t *engine);     // "OpenCL", "CPU" or "OpenCL + CPU"
+void zncc_engine_destroy(zncc_engine_t *engine);
+
+#endif
@@ -0,0 +1,109 @@
+// Bidirectional ZNCC in one correlation pass. The score of left pixel (i,j) at disparity d is the score of
+// right pixel (i,j-d) at disparity -d (same windows, same valid columns, same float operations up to
+// commutativity), so every (pixel, d) pair is correlated once and stored in a cost volume:
+//   costVolume[(d-mind)*h*vw + i*vw + j],  vw = w + halfwinsizex
+// zncc_fused keeps the L vs R winner on the fly, zncc_reverse_best then picks the R vs L winner from the
+// volume. Columns j in [w, vw) are left window centres outside the image whose windows still overlap it,
+// they are only needed by the R vs L pass.
+// Built with -D ZNCC_SPECIALIZED (see zncc.cl) the window and the number of disparities are compile-time constants.
+#ifdef ZNCC_SPECIALIZED
+#define HALFWINSIZEX ZNCC_HALFWINSIZEX
+#define HALFWINSIZEY ZNCC_HALFWINSIZEY
+#define WINSIZEAREA  ZNCC_WINSIZEAREA
+#define NDISP        ZNCC_NDISP
+#else
+#define HALFWINSIZEX halfwinsizex
+#define HALFWINSIZEY halfwinsizey
+#define WINSIZEAREA  winsizearea
+#define NDISP        (maxd - mind + 1)
+#endif
+
+__kernel void zncc_fused(__global uchar *leftImg, __global uchar *rightImg, __global uchar *dispMap, __global float *costVolume, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    const int vw = w + HALFWINSIZEX;
+    if (i >= h || j >= vw)
+        return;
+
+    // Rows of the window inside the image, the same for every disparity
+    const int r0 = max(-HALFWINSIZEY, -i);
+    const int r1 = min(HALFWINSIZEY, h - i);
+
+    int ii, jj, d, best_d, c0, c1; //declare idx, d is disparity value
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation;
+    float currZNCC, bestZNCC; // current and best ZNCC value
+
+    // Searching for d with best ZNCC score for the each pixels
+    best_d = maxd;
+    bestZNCC = -1;
+    for (d = mind; d < mind + NDISP; d++) {
+        // Columns of the window inside both images
+        c0 = max(-j, d - j);
+        c1 = min(w - j, w - j + d);
+        // Calculating the window average
+        avgLeft = avgRight = 0;
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -HALFWINSIZEX; jj < HALFWINSIZEX; jj++) {
+                if (c0 <= jj && jj < c1) {
+                    // Sum all pixels in window size
+                    avgLeft  += leftImg [(i+ii)*w + (j+jj)];
+                    avgRight += rightImg[(i+ii)*w + (j+jj-d)];
+                }
+            }
+        }
+        avgLeft  /= WINSIZEAREA;
+        avgRight /= WINSIZEAREA;
+        leftStdDeviation = rightStdDeviation = currZNCC = 0;
+
+        // Calculate using the ZNCC formula
+        for (ii = r0; ii < r1; ii++) {
+            for (jj = -HALFWINSIZEX; jj < HALFWINSIZEX; jj++) {
+                if (c0 <= jj && jj < c1) {
+                    leftWinValue       = leftImg[(i+ii)*w + (j+jj)] - avgLeft;
+                    rightWinValue      = rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
+                    currZNCC          += leftWinValue*rightWinValue;
+                    leftStdDeviation  += leftWinValue*leftWinValue;
+                    rightStdDeviation += rightWinValue*rightWinValue;
+                }
+            }
+        }
+        // Calculate current ZNCC value
+        currZNCC /= native_sqrt(leftStdDeviation)*native_sqrt(rightStdDeviation);
+        costVolume[(d-mind)*h*vw + i*vw + j] = currZNCC;
+        // Winner-takes-it-all-approach, get d with the best ZNCC value
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = d;
+        }
+    }
+    if (j < w)
+        dispMap[i*w+j] = (uint)abs(best_d);
+}
+
+// R vs L winner of right pixel (i,j) from the cost volume of zncc_fused, visiting the disparities in the
+// same order as zncc.cl run with the images swapped and the range negated.
+__kernel void zncc_reverse_best(__global float *costVolume, __global uchar *dispMap, int w, int h, int halfwinsizex, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    const int vw = w + halfwinsizex;
+    if (i >= h || j >= w)
+        return;
+
+    int d, best_d;
+    float currZNCC, bestZNCC;
+
+    best_d = -mind;
+    bestZNCC = -1;
+    for (d = maxd; d >= mind; d--) {
+        if (j+d >= vw)
+            continue;
+        currZNCC = costVolume[(d-mind)*h*vw + i*vw + (j+d)];
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = -d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
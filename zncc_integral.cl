@@ -0,0 +1,114 @@
+// Summed-area table layout : every plane is (w+1) x (h+1) uints with a zero first row and column.
+//   plane 0 : left image          plane 1 : left image squared
+//   plane 2 : right image         plane 3 : right image squared
+//   plane 4+d : left(y,x) * right(y,x-d) for d = 0..ndisp-1 (zero where x-d falls outside the image)
+// The tables wrap around modulo 2^32, but every window sum is smaller than 2^32 so the
+// differences taken in rect_sum() are exact.
+
+inline uint rect_sum(__global uint *plane, int w1, int r0, int r1, int c0, int c1) {
+    return plane[r1*w1 + c1] - plane[r0*w1 + c1] - plane[r1*w1 + c0] + plane[r0*w1 + c0];
+}
+
+__kernel void integral_rows(__global uchar *leftImg, __global uchar *rightImg, __global uint *sat, int w, int h) {
+    const int i = get_global_id(0); // row
+    const int p = get_global_id(1); // plane
+    const int w1 = w + 1;
+    __global uint *plane = sat + p*w1*(h+1);
+
+    int j, d;
+    uint value, sum = 0;
+
+    // Row 0 of each plane is zero, work-item of the first row takes care of it
+    if (i == 0) {
+        for (j = 0; j <= w; j++)
+            plane[j] = 0;
+    }
+    plane[(i+1)*w1] = 0;
+
+    d = p - 4;
+    for (j = 0; j < w; j++) {
+        if (p == 0)      value = leftImg[i*w + j];
+        else if (p == 1) value = leftImg[i*w + j]*leftImg[i*w + j];
+        else if (p == 2) value = rightImg[i*w + j];
+        else if (p == 3) value = rightImg[i*w + j]*rightImg[i*w + j];
+        else             value = (j-d >= 0) ? leftImg[i*w + j]*rightImg[i*w + j-d] : 0;
+        sum += value;
+        plane[(i+1)*w1 + j+1] = sum;
+    }
+}
+
+__kernel void integral_cols(__global uint *sat, int w, int h) {
+    const int j = get_global_id(0); // column
+    const int p = get_global_id(1); // plane
+    const int w1 = w + 1;
+    __global uint *plane = sat + p*w1*(h+1);
+
+    int i;
+    uint sum = 0;
+    for (i = 1; i <= h; i++) {
+        sum += plane[i*w1 + j];
+        plane[i*w1 + j] = sum;
+    }
+}
+
+// Same score as zncc.cl, but every window statistic is an O(1) lookup in the summed-area tables.
+// refPlane/tgtPlane select the reference and target images (0 or 2). For the R vs L pass (reverse != 0)
+// the cross-product planes of the L vs R pass are reused, indexed by |d| on the left (target) columns.
+__kernel void zncc_integral(__global uint *sat, __global uchar *dispMap, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd, int refPlane, int tgtPlane, int reverse) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    if (i >= h || j >= w)
+        return;
+
+    const int w1 = w + 1;
+    const int planeSize = w1*(h+1);
+    __global uint *ref   = sat + refPlane*planeSize;
+    __global uint *refSq = sat + (refPlane+1)*planeSize;
+    __global uint *tgt   = sat + tgtPlane*planeSize;
+    __global uint *tgtSq = sat + (tgtPlane+1)*planeSize;
+
+    const long area2 = (long)winsizearea*winsizearea;
+    const int r0 = max(i-halfwinsizey, 0);
+    const int r1 = min(i+halfwinsizey, h);
+
+    int c0, c1, n, d, best_d, shift;
+    long sumRef, sumTgt, sumRefSq, sumTgtSq, sumCross, k;
+    float covariance, refVariance, tgtVariance;
+    float currZNCC, bestZNCC; // current and best ZNCC value
+
+    // Searching for d with best ZNCC score for the each pixels
+    best_d = maxd;
+    bestZNCC = -1;
+    for (d = mind; d <= maxd; d++) {
+        // Window columns where both the reference and the shifted target pixels exist
+        c0 = max(max(j-halfwinsizex, 0), d);
+        c1 = min(min(j+halfwinsizex, w), w+d);
+        if (r0 >= r1 || c0 >= c1)
+            continue;
+        n = (r1-r0)*(c1-c0);
+        shift = reverse ? d : 0;
+
+        sumRef   = rect_sum(ref,   w1, r0, r1, c0, c1);
+        sumRefSq = rect_sum(refSq, w1, r0, r1, c0, c1);
+        sumTgt   = rect_sum(tgt,   w1, r0, r1, c0-d, c1-d);
+        sumTgtSq = rect_sum(tgtSq, w1, r0, r1, c0-d, c1-d);
+        sumCross = rect_sum(sat + (4+abs(d))*planeSize, w1, r0, r1, c0-shift, c1-shift);
+
+        // Window average is sum/winsizearea as in zncc.cl, everything below is scaled by winsizearea^2
+        // so it stays exact in integers until the final division
+        k = 2*winsizearea - n;
+        covariance  = (float)(area2*sumCross - k*sumRef*sumTgt);
+        refVariance = (float)(area2*sumRefSq - k*sumRef*sumRef);
+        tgtVariance = (float)(area2*sumTgtSq - k*sumTgt*sumTgt);
+
+        // Calculate current ZNCC value
+        currZNCC = covariance / (native_sqrt(refVariance)*native_sqrt(tgtVariance));
+        // Winner-takes-it-all-approach, get d with the best ZNCC value
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
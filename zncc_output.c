@@ -0,0 +1,101 @@
+/******************************************************************************
+ * FILENAME :        zncc_output.c
+ *
+ * DESCRIPTION :
+ *       Float disparity map writers, see zncc_output.h
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lodepng.h"
+#include "zncc_output.h"
+
+/******************************************************************************
+ *  PFM: text header, then the rows bottom to top in host byte order, told by the
+ *  sign of the scale (negative = little endian)
+ */
+int32_t zncc_write_pfm(const char *path, const float *disparity, uint32_t w, uint32_t h)
+{
+    const uint16_t one = 1;
+    const int32_t littleEndian = *(const uint8_t*)&one == 1;
+    uint32_t i;
+    int32_t err = 0;
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return 1;
+
+    fprintf(f, "Pf\n%u %u\n%s\n", w, h, littleEndian ? "-1.0" : "1.0");
+    for (i = h; i-- > 0; )
+        if (fwrite(disparity + (size_t)i*w, sizeof(float), w, f) != w)
+            err = 1;
+    if (fclose(f))
+        err = 1;
+    return err;
+}
+
+/******************************************************************************
+ *  16-bit PNG: rounded disparity * ZNCC_PNG16_SCALE, big endian samples
+ */
+uint32_t zncc_write_png16(const char *path, const float *disparity, uint32_t w, uint32_t h)
+{
+    const size_t size = (size_t)w*h;
+    uint8_t *image = (uint8_t*) malloc(2*size);
+    uint32_t value, err;
+    float scaled;
+    size_t k;
+    if (!image) {
+        perror("Fail to write the disparity map, can not allocation memory !");
+        abort();
+    }
+
+    for (k = 0; k < size; k++) {
+        scaled = disparity[k]*ZNCC_PNG16_SCALE + 0.5f;
+        value  = scaled <= 0 ? 0 : scaled >= 65535 ? 65535 : (uint32_t)scaled;
+        image[2*k]     = (uint8_t)(value >> 8);
+        image[2*k + 1] = (uint8_t)(value & 255);
+    }
+    err = lodepng_encode_file(path, image, w, h, LCT_GREY, 16);
+    free(image);
+    return err;
+}
+
+uint32_t zncc_write_disparity(const char *path, const float *disparity, uint32_t w, uint32_t h)
+{
+    const size_t len = strlen(path);
+    if (len >= 4 && strcmp(path + len - 4, ".pfm") == 0)
+        return (uint32_t) zncc_write_pfm(path, disparity, w, h);
+    return zncc_write_png16(path, disparity, w, h);
+}
+
+/******************************************************************************
+ *  8-bit depth map. The fast profiles skip the colour analysis and the filter
+ *  choice (the "up" filter suits the rows of a depth map best) and trade size
+ *  for speed: one hash probe or runs only, fixed Huffman codes
+ */
+uint32_t zncc_write_depthmap(const char *path, const uint8_t *depthMap, uint32_t w, uint32_t h, encode_profile_t profile)
+{
+    LodePNGState state;
+    unsigned char *png = NULL;
+    size_t pngSize = 0;
+    uint32_t err;
+    if (profile == ENCODE_DEFAULT)
+        return lodepng_encode_file(path, depthMap, w, h, LCT_GREY, 8);
+
+    lodepng_state_init(&state);
+    state.info_raw.colortype = LCT_GREY;
+    state.info_raw.bitdepth = 8;
+    state.info_png.color.colortype = LCT_GREY;
+    state.info_png.color.bitdepth = 8;
+    state.encoder.auto_convert = 0;
+    state.encoder.filter_strategy = LFS_TWO;
+    state.encoder.zlibsettings.btype = 1;
+    state.encoder.zlibsettings.match_strategy = profile == ENCODE_RLE ? LMS_RLE : LMS_GREEDY;
+    err = lodepng_encode(&png, &pngSize, depthMap, w, h, &state);
+    if (!err)
+        err = lodepng_save_file(png, pngSize, path);
+    free(png);
+    lodepng_state_cleanup(&state);
+    return err;
+}
@@ -0,0 +1,36 @@
+/******************************************************************************
+ * FILENAME :        zncc_output.h
+ *
+ * DESCRIPTION :
+ *       Writers of the float disparity map of zncc_engine_subpixel_map
+ *       + zncc_write_pfm   : Portable Float Map, 32-bit floats (grey "Pf")
+ *       + zncc_write_png16 : 16-bit grey PNG, fixed point disparity * 64
+ *       + zncc_write_disparity : PFM for a *.pfm path, 16-bit PNG otherwise
+ *       + zncc_write_depthmap  : 8-bit grey PNG of the depth map, lodepng
+ *                                default encoder or one of the fast profiles
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_OUTPUT_H
+#define ZNCC_OUTPUT_H
+
+#include <stdint.h>
+
+#define ZNCC_PNG16_SCALE 64         // 1/64 pixel steps, disparities up to 1023.98
+
+typedef enum {
+    ENCODE_DEFAULT = 0,             // lodepng defaults: colour conversion, min-sum filters, lazy hash chains, dynamic Huffman
+    ENCODE_FAST,                    // grey, "up" filter, greedy single-probe matches, fixed Huffman codes
+    ENCODE_RLE,                     // grey, "up" filter, run-length matches only, fixed Huffman codes
+} encode_profile_t;
+
+// 0 on success, 1 when the file can not be written
+int32_t zncc_write_pfm(const char *path, const float *disparity, uint32_t w, uint32_t h);
+// lodepng error code, 0 on success
+uint32_t zncc_write_png16(const char *path, const float *disparity, uint32_t w, uint32_t h);
+// 0 on success
+uint32_t zncc_write_disparity(const char *path, const float *disparity, uint32_t w, uint32_t h);
+// lodepng error code, 0 on success
+uint32_t zncc_write_depthmap(const char *path, const uint8_t *depthMap, uint32_t w, uint32_t h, encode_profile_t profile);
+
+#endif
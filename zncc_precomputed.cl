@@ -0,0 +1,82 @@
+// Window mean and 1/sigma of every pixel of both images. They do not depend on the disparity, so
+// they are computed once here and shared by the L vs R and R vs L passes of zncc_precomputed.
+__kernel void window_stats(__global uchar *leftImg, __global uchar *rightImg, __global float *meanL, __global float *invSigmaL, __global float *meanR, __global float *invSigmaR, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    if (i >= h || j >= w)
+        return;
+
+    int ii, jj;
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftVariance, rightVariance;
+
+    // Calculating the window average
+    avgLeft = avgRight = 0;
+    for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+        for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+            if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w) {
+                avgLeft  += leftImg [(i+ii)*w + (j+jj)];
+                avgRight += rightImg[(i+ii)*w + (j+jj)];
+            }
+        }
+    }
+    avgLeft  /= winsizearea;
+    avgRight /= winsizearea;
+
+    // Calculating the window variance
+    leftVariance = rightVariance = 0;
+    for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+        for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+            if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w) {
+                leftWinValue   = leftImg [(i+ii)*w + (j+jj)] - avgLeft;
+                rightWinValue  = rightImg[(i+ii)*w + (j+jj)] - avgRight;
+                leftVariance  += leftWinValue*leftWinValue;
+                rightVariance += rightWinValue*rightWinValue;
+            }
+        }
+    }
+    meanL[i*w+j]     = avgLeft;
+    meanR[i*w+j]     = avgRight;
+    invSigmaL[i*w+j] = native_rsqrt(leftVariance);
+    invSigmaR[i*w+j] = native_rsqrt(rightVariance);
+}
+
+// ZNCC with the window statistics read from the window_stats planes, only the cross term is left in the
+// disparity loop. Disparities whose target centre pixel falls outside the image are skipped.
+__kernel void zncc_precomputed(__global uchar *leftImg, __global uchar *rightImg, __global float *meanLeft, __global float *invSigmaLeft, __global float *meanRight, __global float *invSigmaRight, __global uchar *dispMap, int w, int h, int halfwinsizex, int halfwinsizey, int mind, int maxd) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    if (i >= h || j >= w)
+        return;
+
+    int ii, jj, d, best_d;
+    float avgLeft, avgRight, currZNCC, bestZNCC; // current and best ZNCC value
+
+    avgLeft = meanLeft[i*w+j];
+
+    // Searching for d with best ZNCC score for the each pixels
+    best_d = maxd;
+    bestZNCC = -1;
+    for (d = mind; d <= maxd; d++) {
+        if (j-d < 0 || j-d >= w)
+            continue;
+        avgRight = meanRight[i*w + (j-d)];
+        currZNCC = 0;
+        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+                    currZNCC += (leftImg[(i+ii)*w + (j+jj)] - avgLeft)*(rightImg[(i+ii)*w + (j+jj-d)] - avgRight);
+                }
+            }
+        }
+        // Calculate current ZNCC value
+        currZNCC *= invSigmaLeft[i*w+j]*invSigmaRight[i*w + (j-d)];
+        // Winner-takes-it-all-approach, get d with the best ZNCC value
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
@@ -0,0 +1,177 @@
+/******************************************************************************
+ * FILENAME :        zncc_profile.c
+ *
+ * DESCRIPTION :
+ *       Per-stage timing report, see zncc_profile.h
+ *       + host stages   : queued = submit = start, all on the CLOCK_MONOTONIC time base
+ *       + device stages : the four CL_PROFILING_COMMAND_* timestamps, on the device
+ *                         time base (the "clock" column tells them apart)
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zncc_profile.h"
+
+typedef struct {
+    char stage[48];
+    int32_t device;                     // 1 = OpenCL event timestamps, 0 = host clock
+    uint64_t queued, submit, start, end;
+#ifndef ZNCC_NO_OPENCL
+    cl_event event;                     // pending until zncc_profile_collect
+#endif
+} stage_record_t;
+
+struct zncc_profile {
+    stage_record_t *records;
+    uint32_t count, capacity;
+};
+
+zncc_profile_t *zncc_profile_create(void)
+{
+    zncc_profile_t *prof = (zncc_profile_t*) calloc(1, sizeof(zncc_profile_t));
+    if (!prof) {
+        perror("Fail to create the timing report, can not allocation memory !");
+        abort();
+    }
+    return prof;
+}
+
+uint64_t zncc_profile_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static stage_record_t *add_record(zncc_profile_t *prof, const char *stage, int32_t device)
+{
+    stage_record_t *rec;
+    if (prof->count == prof->capacity) {
+        prof->capacity = prof->capacity ? 2*prof->capacity : 64;
+        prof->records  = (stage_record_t*) realloc(prof->records, prof->capacity*sizeof(stage_record_t));
+        if (!prof->records) {
+            perror("Fail to grow the timing report, can not allocation memory !");
+            abort();
+        }
+    }
+    rec = &prof->records[prof->count++];
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->stage, sizeof(rec->stage), "%s", stage);
+    rec->device = device;
+    return rec;
+}
+
+void zncc_profile_host(zncc_profile_t *prof, const char *stage, uint64_t start)
+{
+    stage_record_t *rec;
+    if (!prof)
+        return;
+    rec = add_record(prof, stage, 0);
+    rec->queued = rec->submit = rec->start = start;
+    rec->end    = zncc_profile_now();
+}
+
+#ifndef ZNCC_NO_OPENCL
+cl_event *zncc_profile_event(zncc_profile_t *prof, const char *stage)
+{
+    if (!prof)
+        return NULL;
+    return &add_record(prof, stage, 1)->event;
+}
+
+/******************************************************************************
+ *  Timestamps of every pending event, to be called once the commands are done
+ *  (after a blocking read or clFinish). The events are released.
+ */
+void zncc_profile_collect(zncc_profile_t *prof)
+{
+    uint32_t i;
+    if (!prof)
+        return;
+    for (i = 0; i < prof->count; i++) {
+        stage_record_t *rec = &prof->records[i];
+        cl_ulong t[4] = {0, 0, 0, 0};
+        if (!rec->event)
+            continue;
+        // Zeros when the queue was created without CL_QUEUE_PROFILING_ENABLE
+        clGetEventProfilingInfo(rec->event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &t[0], NULL);
+        clGetEventProfilingInfo(rec->event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &t[1], NULL);
+        clGetEventProfilingInfo(rec->event, CL_PROFILING_COMMAND_START,  sizeof(cl_ulong), &t[2], NULL);
+        clGetEventProfilingInfo(rec->event, CL_PROFILING_COMMAND_END,    sizeof(cl_ulong), &t[3], NULL);
+        rec->queued = t[0];
+        rec->submit = t[1];
+        rec->start  = t[2];
+        rec->end    = t[3];
+        clReleaseEvent(rec->event);
+        rec->event = NULL;
+    }
+}
+#endif
+
+void zncc_profile_print(const zncc_profile_t *prof)
+{
+    uint32_t i;
+    if (!prof)
+        return;
+    for (i = 0; i < prof->count; i++) {
+        const stage_record_t *rec = &prof->records[i];
+        printf("    %-28s %-6s %10.3f ms\n", rec->stage, rec->device ? "device" : "host", (double)(rec->end - rec->start)/1000000);
+    }
+}
+
+/******************************************************************************
+ *  CSV when path ends in ".csv", JSON otherwise. Times are in ns.
+ *      CSV  : stage,clock,queued_ns,submit_ns,start_ns,end_ns,duration_ns
+ *      JSON : {"stages": [{"stage": .., "clock": "host"|"device", "queued_ns": .., ...}, ...]}
+ */
+int32_t zncc_profile_write(const zncc_profile_t *prof, const char *path)
+{
+    const size_t len = strlen(path);
+    const int32_t csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    uint32_t i;
+    FILE *f;
+
+    if (!prof)
+        return 0;
+    f = fopen(path, "w");
+    if (!f)
+        return 1;
+
+    if (csv)
+        fprintf(f, "stage,clock,queued_ns,submit_ns,start_ns,end_ns,duration_ns\n");
+    else
+        fprintf(f, "{\n  \"stages\": [");
+    for (i = 0; i < prof->count; i++) {
+        const stage_record_t *rec = &prof->records[i];
+        const char *clock = rec->device ? "device" : "host";
+        if (csv)
+            fprintf(f, "%s,%s,%llu,%llu,%llu,%llu,%llu\n", rec->stage, clock,
+                    (unsigned long long)rec->queued, (unsigned long long)rec->submit, (unsigned long long)rec->start,
+                    (unsigned long long)rec->end, (unsigned long long)(rec->end - rec->start));
+        else
+            fprintf(f, "%s\n    {\"stage\": \"%s\", \"clock\": \"%s\", \"queued_ns\": %llu, \"submit_ns\": %llu, \"start_ns\": %llu, \"end_ns\": %llu, \"duration_ns\": %llu}",
+                    i ? "," : "", rec->stage, clock,
+                    (unsigned long long)rec->queued, (unsigned long long)rec->submit, (unsigned long long)rec->start,
+                    (unsigned long long)rec->end, (unsigned long long)(rec->end - rec->start));
+    }
+    if (!csv)
+        fprintf(f, "\n  ]\n}\n");
+    return fclose(f) ? 1 : 0;
+}
+
+void zncc_profile_destroy(zncc_profile_t *prof)
+{
+    if (!prof)
+        return;
+#ifndef ZNCC_NO_OPENCL
+    uint32_t i;
+    for (i = 0; i < prof->count; i++)
+        if (prof->records[i].event)
+            clReleaseEvent(prof->records[i].event);
+#endif
+    free(prof->records);
+    free(prof);
+}
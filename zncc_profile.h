@@ -0,0 +1,46 @@
+/******************************************************************************
+ * FILENAME :        zncc_profile.h
+ *
+ * DESCRIPTION :
+ *       Per-stage timing report. Host stages (decode, occlusion filling,
+ *       normalization, encode, the CPU backend stages) are timed with
+ *       CLOCK_MONOTONIC, device stages (uploads, kernels, readback) with the
+ *       CL_PROFILING_COMMAND_QUEUED/SUBMIT/START/END info of their event.
+ *       + zncc_profile_host    : record a host stage that started at <start>
+ *       + zncc_profile_event   : event slot to pass to the next clEnqueue*
+ *       + zncc_profile_collect : read the pending events once the queue is done
+ *       + zncc_profile_write   : CSV report for a *.csv path, JSON otherwise
+ *       Every function accepts a NULL profile and then does nothing, so the
+ *       callers need no "profiling on?" branch.
+ *
+ ******************************************************************************/
+
+#ifndef ZNCC_PROFILE_H
+#define ZNCC_PROFILE_H
+
+#include <stdint.h>
+
+#ifndef ZNCC_NO_OPENCL
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+typedef struct zncc_profile zncc_profile_t;
+
+zncc_profile_t *zncc_profile_create(void);
+uint64_t zncc_profile_now(void);                                        // host clock, ns
+void zncc_profile_host(zncc_profile_t *prof, const char *stage, uint64_t start);
+#ifndef ZNCC_NO_OPENCL
+// Valid until the next zncc_profile_event call, NULL when prof is NULL
+cl_event *zncc_profile_event(zncc_profile_t *prof, const char *stage);
+void zncc_profile_collect(zncc_profile_t *prof);
+#endif
+void zncc_profile_print(const zncc_profile_t *prof);                    // one line per stage on stdout
+int32_t zncc_profile_write(const zncc_profile_t *prof, const char *path); // 0 on success
+void zncc_profile_destroy(zncc_profile_t *prof);
+
+#endif
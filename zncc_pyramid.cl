@@ -0,0 +1,74 @@
+// Coarse-to-fine disparity search. Each pyramid level halves the grey images with a 2x2 box filter, the
+// coarsest level runs zncc.cl over the whole (scaled) range, every finer level only searches a band of
+// +-band disparities around twice the disparity of its parent pixel.
+
+__kernel void downsample(__global uchar *src, __global uchar *dst, int w, int h) {
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    const int dw = w/2;
+    if (i >= h/2 || j >= dw)
+        return;
+
+    dst[i*dw + j] = (src[(2*i)*w + 2*j] + src[(2*i)*w + 2*j+1] + src[(2*i+1)*w + 2*j] + src[(2*i+1)*w + 2*j+1] + 2)/4;
+}
+
+// zncc.cl restricted to [centre-band, centre+band] clipped to [mind, maxd], centre = 2 x guide disparity of
+// the parent pixel. The guide stores |d| like every disparity map, it is negated for the R vs L pass.
+__kernel void zncc_guided(__global uchar *leftImg, __global uchar *rightImg, __global uchar *dispMap, __global uchar *guide, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd, int guideW, int guideH, int band) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    if (i >= h || j >= w)
+        return;
+
+    int ii, jj, d, best_d, centre, lo, hi; //declare idx, d is disparity value
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation;
+    float currZNCC, bestZNCC; // current and best ZNCC value
+
+    centre = 2*guide[min(i/2, guideH-1)*guideW + min(j/2, guideW-1)];
+    if (mind < 0)
+        centre = -centre;
+    lo = max(mind, centre-band);
+    hi = min(maxd, centre+band);
+
+    // Searching for d with best ZNCC score for the each pixels
+    best_d = hi;
+    bestZNCC = -1;
+    for (d = lo; d <= hi; d++) {
+        // Calculating the window average
+        avgLeft = avgRight = 0;
+        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+                    // Sum all pixels in window size
+                    avgLeft  += leftImg [(i+ii)*w + (j+jj)];
+                    avgRight += rightImg[(i+ii)*w + (j+jj-d)];
+                }
+            }
+        }
+        avgLeft  /= winsizearea;
+        avgRight /= winsizearea;
+        leftStdDeviation = rightStdDeviation = currZNCC = 0;
+
+        // Calculate using the ZNCC formula
+        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+                    leftWinValue       = leftImg[(i+ii)*w + (j+jj)] - avgLeft;
+                    rightWinValue      = rightImg[(i+ii)*w + (j+jj-d)] - avgRight;
+                    currZNCC          += leftWinValue*rightWinValue;
+                    leftStdDeviation  += leftWinValue*leftWinValue;
+                    rightStdDeviation += rightWinValue*rightWinValue;
+                }
+            }
+        }
+        // Calculate current ZNCC value
+        currZNCC /= native_sqrt(leftStdDeviation)*native_sqrt(rightStdDeviation);
+        // Winner-takes-it-all-approach, get d with the best ZNCC value
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}
@@ -0,0 +1,81 @@
+// Same computation as zncc.cl, but the work-group first stages its left tile (local size + window halo)
+// and its right tile (left tile widened by the disparity range) in local memory, so the window loops
+// never touch global memory. The host rounds the global work size up to a multiple of the local size
+// and passes the two tiles as dynamically sized __local arguments.
+__kernel void zncc_tiled(__global uchar *leftImg, __global uchar *rightImg, __global uchar *dispMap, int w, int h, int halfwinsizex, int halfwinsizey, int winsizearea, int mind, int maxd, __local uchar *leftTile, __local uchar *rightTile) {
+
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    // Tile origins in image coordinates and tile sizes
+    const int tileRow  = (int)(get_group_id(0)*get_local_size(0)) - halfwinsizey;
+    const int tileCol  = (int)(get_group_id(1)*get_local_size(1)) - halfwinsizex;
+    const int tileH    = (int)get_local_size(0) + 2*halfwinsizey;
+    const int tileW    = (int)get_local_size(1) + 2*halfwinsizex;
+    const int rightCol = tileCol - maxd;
+    const int rightW   = tileW + maxd - mind;
+
+    const int lid    = (int)(get_local_id(0)*get_local_size(1) + get_local_id(1));
+    const int stride = (int)(get_local_size(0)*get_local_size(1));
+
+    int ii, jj, d, best_d, k, r, c; //declare idx, d is disparity value
+    float avgLeft, avgRight, leftWinValue, rightWinValue, leftStdDeviation, rightStdDeviation;
+    float currZNCC, bestZNCC; // current and best ZNCC value
+
+    // Cooperative loading of both tiles, pixels outside the image are never read back
+    for (k = lid; k < tileH*tileW; k += stride) {
+        r = tileRow + k/tileW;
+        c = tileCol + k%tileW;
+        leftTile[k] = (0<=r && r<h && 0<=c && c<w) ? leftImg[r*w + c] : 0;
+    }
+    for (k = lid; k < tileH*rightW; k += stride) {
+        r = tileRow + k/rightW;
+        c = rightCol + k%rightW;
+        rightTile[k] = (0<=r && r<h && 0<=c && c<w) ? rightImg[r*w + c] : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (i >= h || j >= w)
+        return;
+
+    // Searching for d with best ZNCC score for the each pixels
+    best_d = maxd;
+    bestZNCC = -1;
+    for (d = mind; d <= maxd; d++) {
+        // Calculating the window average
+        avgLeft = avgRight = 0;
+        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+                    // Sum all pixels in window size
+                    avgLeft  += leftTile [(i+ii-tileRow)*tileW  + (j+jj-tileCol)];
+                    avgRight += rightTile[(i+ii-tileRow)*rightW + (j+jj-d-rightCol)];
+                }
+            }
+        }
+        avgLeft  /= winsizearea;
+        avgRight /= winsizearea;
+        leftStdDeviation = rightStdDeviation = currZNCC = 0;
+
+        // Calculate using the ZNCC formula
+        for (ii = -halfwinsizey; ii < halfwinsizey; ii++) {
+            for (jj = -halfwinsizex; jj < halfwinsizex; jj++) {
+                if (0<=i+ii && i+ii<h && 0<=j+jj && j+jj<w && 0<=j+jj-d && j+jj-d<w) {
+                    leftWinValue       = leftTile [(i+ii-tileRow)*tileW  + (j+jj-tileCol)] - avgLeft;
+                    rightWinValue      = rightTile[(i+ii-tileRow)*rightW + (j+jj-d-rightCol)] - avgRight;
+                    currZNCC          += leftWinValue*rightWinValue;
+                    leftStdDeviation  += leftWinValue*leftWinValue;
+                    rightStdDeviation += rightWinValue*rightWinValue;
+                }
+            }
+        }
+        // Calculate current ZNCC value
+        currZNCC /= native_sqrt(leftStdDeviation)*native_sqrt(rightStdDeviation);
+        // Winner-takes-it-all-approach, get d with the best ZNCC value
+        if (currZNCC > bestZNCC) {
+            bestZNCC = currZNCC;
+            best_d = d;
+        }
+    }
+    dispMap[i*w+j] = (uint)abs(best_d);
+}